@@ -39,7 +39,7 @@ debug = 1   # set to 1 to see lots of additional output!!
 # that do various 'things' - compiled C is used to (hopefully!) provide something  
 # common that can be used in different IoT contexts 
 #  The .so library is created with the following gcc compiler command (where folder paths will have to be adjusted!):
-#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl
+#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl -lz
 # The following 'install' may be needed on a RPi:
 # sudo apt install curl                       (this is usually already installed)
 # sudo apt-get install libcurl4-openssl-dev   (this is more likely to be needed to avoid a gcc fatal error from curl/curl.h not being found)
@@ -40,7 +40,7 @@ debug = 1   # set to 1 to see lots of additional output!!
 # that do various 'things' - compiled C is used to (hopefully!) provide something  
 # common that can be used in different IoT contexts 
 #  The .so library is created with the following gcc compiler command (where folder paths will have to be adjusted!):
-#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl
+#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl -lz
 # The following 'install' may be needed on a RPi:
 # sudo apt install curl                       (this is usually already installed)
 # sudo apt-get install libcurl4-openssl-dev   (this is more likely to be needed to avoid a gcc fatal error from curl/curl.h not being found)
@@ -92,8 +92,10 @@ b_access_token = access_token.encode('utf-8')
 # it correctly defined char variables using ctypes   #
 # returns TRUE if found date is newer than sent date #
 ######################################################
-pi_iot_control_YYMMDD.webpage_datetimecheck.restype = ctypes.c_char_p # override the default return type (int)
-timeresponse = (pi_iot_control_YYMMDD.webpage_datetimecheck(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_page), ctypes.c_char_p(b_access_token), ctypes.c_char_p(b_infront_text), ctypes.c_int(datelen), ctypes.c_char_p(b_refdatetime), ctypes.c_char_p(b_datetime_fmt) ) )
+pi_iot_control_YYMMDD.webpage_datetimecheck.restype = ctypes.c_void_p # keep the raw pointer so the returned string can be released
+result_ptr = pi_iot_control_YYMMDD.webpage_datetimecheck(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_page), ctypes.c_char_p(b_access_token), ctypes.c_char_p(b_infront_text), ctypes.c_int(datelen), ctypes.c_char_p(b_refdatetime), ctypes.c_char_p(b_datetime_fmt) )
+timeresponse = ctypes.string_at(result_ptr)   # copy the returned text into Python bytes ...
+pi_iot_control_YYMMDD.tiki_free(ctypes.c_void_p(result_ptr))   # ... then release the string allocated by the C library
 print ("response: " + str(timeresponse))
 if "true" in str(timeresponse):
     print ("\n*** webpage_datetimecheck is TRUE\n")
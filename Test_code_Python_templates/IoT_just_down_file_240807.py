@@ -39,7 +39,7 @@ debug = 1   # set to 1 to see lots of additional output!!
 # that do various 'things' - compiled C is used to (hopefully!) provide something  
 # common that can be used in different IoT contexts 
 #  The .so library is created with the following gcc compiler command (where folder paths will have to be adjusted!):
-#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl
+#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl -lz
 # The following 'install' may be needed on a RPi:
 # sudo apt install curl                       (this is usually already installed)
 # sudo apt-get install libcurl4-openssl-dev   (this is more likely to be needed to avoid a gcc fatal error from curl/curl.h not being found)
@@ -93,8 +93,10 @@ b_downheaderfilename2 = downheaderfilename2.encode('utf-8')
 # an existing file gallery file passing it an       #
 # explicit file name                                #
 #####################################################
-pi_iot_control_YYMMDD.gallery_filedownload.restype = ctypes.c_char_p # override the default return type (int)
-response = str( pi_iot_control_YYMMDD.gallery_filedownload(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_access_token), ctypes.c_char_p(b_fileIddown), ctypes.c_char_p(b_filespath), ctypes.c_char_p(b_downfilename), ctypes.c_char_p(b_downheaderfilename)  ) )
+pi_iot_control_YYMMDD.gallery_filedownload.restype = ctypes.c_void_p # keep the raw pointer so the returned string can be released
+result_ptr = pi_iot_control_YYMMDD.gallery_filedownload(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_access_token), ctypes.c_char_p(b_fileIddown), ctypes.c_char_p(b_filespath), ctypes.c_char_p(b_downfilename), ctypes.c_char_p(b_downheaderfilename)  )
+response = str( ctypes.string_at(result_ptr) )   # copy the returned text into a Python string ...
+pi_iot_control_YYMMDD.tiki_free(ctypes.c_void_p(result_ptr))   # ... then release the string allocated by the C library
 
 print ("\n*** gallery_filedownload response: " )
 print ( response ) 
@@ -106,8 +108,10 @@ print ( response )
 # an existing file gallery file passing it an       #
 # empty file name to trigger the use of a temp name #
 #####################################################
-pi_iot_control_YYMMDD.gallery_filedownload.restype = ctypes.c_char_p # override the default return type (int)
-response = str( pi_iot_control_YYMMDD.gallery_filedownload(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_access_token), ctypes.c_char_p(b_fileIddown), ctypes.c_char_p(b_filespath), ctypes.c_char_p(b_emptyfilename), ctypes.c_char_p(b_downheaderfilename2)  ) )
+pi_iot_control_YYMMDD.gallery_filedownload.restype = ctypes.c_void_p # keep the raw pointer so the returned string can be released
+result_ptr = pi_iot_control_YYMMDD.gallery_filedownload(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_access_token), ctypes.c_char_p(b_fileIddown), ctypes.c_char_p(b_filespath), ctypes.c_char_p(b_emptyfilename), ctypes.c_char_p(b_downheaderfilename2)  )
+response = str( ctypes.string_at(result_ptr) )   # copy the returned text into a Python string ...
+pi_iot_control_YYMMDD.tiki_free(ctypes.c_void_p(result_ptr))   # ... then release the string allocated by the C library
 
 print ("\n*** gallery_filedownload response: " )
 print ( response )
\ No newline at end of file
@@ -40,7 +40,7 @@ debug = 1   # set to 1 to see lots of additional output!!
 # that do various 'things' - compiled C is used to (hopefully!) provide something  
 # common that can be used in different IoT contexts 
 #  The .so library is created with the following gcc compiler command (where folder paths will have to be adjusted!):
-#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl
+#  gcc -shared -o /your_file_path/libcontrol_iot_YYMMDD.so -fPIC /your_file_path/control_iot_YYMMDD.c -I/usr/local/include -L/usr/local/lib -lcurl -lz
 # The following 'install' may be needed on a RPi:
 # sudo apt install curl                       (this is usually already installed)
 # sudo apt-get install libcurl4-openssl-dev   (this is more likely to be needed to avoid a gcc fatal error from curl/curl.h not being found)
@@ -78,8 +78,10 @@ b_page = page.encode('utf-8')
 # call the webpage_download C function, passing     #
 # it correctly defined char variables using ctypes  #
 #####################################################
-pi_iot_control_YYMMDD.webpage_download.restype = ctypes.c_char_p # override the default return type (int)
-response = str(pi_iot_control_YYMMDD.webpage_download(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_page), ctypes.c_char_p(b_access_token) ) )
+pi_iot_control_YYMMDD.webpage_download.restype = ctypes.c_void_p # keep the raw pointer so the returned string can be released
+result_ptr = pi_iot_control_YYMMDD.webpage_download(ctypes.c_int(debug), ctypes.c_char_p(b_domain), ctypes.c_char_p(b_page), ctypes.c_char_p(b_access_token) )
+response = str( ctypes.string_at(result_ptr) )   # copy the returned text into a Python string ...
+pi_iot_control_YYMMDD.tiki_free(ctypes.c_void_p(result_ptr))   # ... then release the string allocated by the C library
 
 print ("\n*** wiki page download response: " )
 print ( response )
@@ -7,7 +7,7 @@
 // using many of the examples from https://curl.se/libcurl/c/libcurl.html
 
 // compiled using gcc on a local 'integrating' hub device using the command:
-// gcc -o /your_path_to_compiled_result/Ctest_IoT_240807.exe /your_path_to_this_file/IoT_Ctest_template_240807.c /your_path_to/control_iot_240807.c -I/usr/local/include -L/usr/local/lib -lcurl
+// gcc -o /your_path_to_compiled_result/Ctest_IoT_240807.exe /your_path_to_this_file/IoT_Ctest_template_240807.c /your_path_to/control_iot_240807.c -I/usr/local/include -L/usr/local/lib -lcurl -lz
 
 // run using the command: /your_path_to/Ctest_IoT_240807.exe
 
@@ -37,6 +37,10 @@ char* tracker_itemget(int debug, const char* domain, char* access_token, const c
 char* gallery_filedownload(int debug, const char* domain, char* access_token, const char* fileId, const char* filespath, const char* bodyfilename, const char* headerfilename);
 char* gallery_fileupload(int debug, const char* domain, char* access_token, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc);
 char* gallery_fileupdate(int debug, const char* domain, char* access_token, const char* fileId, const char* filepath, const char* filename, const char* filetitle, const char* filedesc);
+void tiki_free(char* result);
+tiki_session* tiki_session_create(int debug, const char* domain, char* access_token);
+void tiki_session_destroy(tiki_session* session);
+char* tracker_itempost_session(int debug, tiki_session* session, const char* trackerId, const char* post_data);
 
 
 // ******************************
@@ -107,5 +111,18 @@ int main(){
     printf ("\n************ post tracker item ************************************\n");
     printf ("tracker upload response is: %s\n", response);;
 
+    // when many posts are made, e.g. a hub forwarding sensor readings, use a persistent session so that
+    //  the same curl handle and keep-alive connection to the Tiki site are re-used for every post
+    tiki_session* session = tiki_session_create(debug, domain, access_token);
+    if (session != NULL) {
+        for (int i = 0; i < 3; i++) {
+            response = tracker_itempost_session(debug, session, trackerId, post_data);
+            printf ("\n************ post tracker item %d using the session ************\n", i+1);
+            printf ("tracker upload response is: %s\n", response);
+            tiki_free(response);   // every returned string is allocated by the library so release it once used
+        }
+        tiki_session_destroy(session);
+    }
+
     return 0; 
 }	
\ No newline at end of file
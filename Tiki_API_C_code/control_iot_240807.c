@@ -20,19 +20,702 @@
 #include <stdlib.h>
 #include <stdbool.h>   // allows the use of bool, true and false which are otherwise not available in C
 #include <string.h>
+#include <strings.h>   // for strncasecmp
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>   // the outbox drains in a background thread
+#include <stdarg.h>    // for the log functions
 #include <curl/curl.h>
+#include <zlib.h>      // tracker post data can be sent gzip compressed
 #include "control_iot_240807.h"
 
-int debug;
+const char swver[8] = "240807";
+
+// the library's shared mutable state, and how each part is kept safe, is:
+//  - the curl share set up once here (see library_init), whose DNS and TLS session caches each have a lock
+//  - the settings for new sessions (time limits, compression, breaker thresholds) and the bytes-on-wire
+//     counters, which are only read and changed with atomics
+//  - the log ring, whose slots are claimed with atomics and written out by the one writer thread
+//     (tiki_log_start and tiki_log_stop themselves are for one thread to call, at start up and shut down)
+//  - the circuit breaker table, changed under breaker_lock, with each breaker's open flag also read with atomics
+//  - the rate limit buckets, changed under bucket_lock, with the limited and urgent counts also read with atomics
+//  - the latency and queue-wait histograms: each thread claims its own block, with atomics, from a list
+//     that only grows, and only that thread writes to it
+//  everything else belongs to a session, tiki_multi, tiki_batch or tiki_outbox - so any number of threads
+//  can call the functions at the same time, each with its own session
+static pthread_once_t library_once = PTHREAD_ONCE_INIT;
+
+// every curl handle the library makes shares one DNS cache and TLS session cache, so a new session
+//  (or a one-shot call) resumes a cached TLS session rather than doing its own DNS lookup and full
+//  handshake - each kind of shared data has its own lock so a DNS lookup never waits for a TLS session
+// connections are NOT shared: libcurl does not support one connection pool used by handles on many
+//  threads at once, so each session keeps its own kept-alive connection and each tiki_multi its own
+static CURLSH *share_handle = NULL;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+#define TIKI_PREWARM_MAX  16      // the most connections tiki_prewarm opens
+
+// time limits that new sessions start with (see tiki_settimeouts) - so a slow or unresponsive Tiki site
+//  can not hold up a call, and everything queued behind it on the hub, indefinitely
+static long timeout_connect = 10000;    // ms allowed for the DNS lookup, TCP connect and TLS handshake
+static long timeout_deadline = 0;       // ms allowed for the whole call - 0 for no limit, as big files can take a while
+static long timeout_stall = 30000;      // ms with less than 1 byte/s going either way before the call is given up
+
+// per-domain circuit breakers (see tiki_setbreaker): after breaker_failures calls in a row to a domain have failed
+//  the calls fail fast without touching the network, while a background thread probes the site until it answers
+#define TIKI_BREAKER_MAX          16          // the most domains that get a breaker
+#define TIKI_BREAKER_MAXPROBEMS   (60 * 1000) // the wait between probes doubles after each failed probe up to this
+static int breaker_failures = 5;
+static long breaker_probems = 5000;
+
+// priority classes (see tiki_session_setpriority and tiki_multi_setpriority): calls waiting for a domain's rate
+//  limit (see tiki_setratelimit) are let through in class order, a tiki_multi starts its queued operations in
+//  class order, and bulk transfers stand aside while an urgent call to the same domain is in flight
+#define TIKI_PRIORITY_BYCALL   -1    // File gallery transfers are bulk and everything else is normal
+#define TIKI_PRIORITY_URGENT   0
+#define TIKI_PRIORITY_NORMAL   1
+#define TIKI_PRIORITY_BULK     2
+#define TIKI_PRIORITIES        3
+#define TIKI_BUCKET_MAX        16    // the most domains that get a rate limit
+#define TIKI_BUCKET_WAITMS     100   // a call waiting for a token checks its cancel handle at least this often
+#define TIKI_YIELD_SLICEMS     5     // a bulk call standing aside sleeps this long at a time ...
+#define TIKI_YIELD_MAXMS       1000  // ... for up to this long each time curl reports its progress
+
+// opt-in compression: the settings that new sessions start with (see tiki_setcompression), and the request
+//  and response body bytes of every session as sent/received on the wire and as they would have been uncompressed
+static int compress_accept = 0;
+static size_t compress_postmin = 0;
+static long long wire_sent, plain_sent, wire_received, plain_received;
+
+// sizes for the streaming JSON scanner - all its state is held in fixed size arrays so it never allocates
+#define TIKI_JSON_MAXKEYS   4     // the most keys whose values can be wanted from one response
+#define TIKI_JSON_KEYLEN    32    // longer keys in the response can never match a wanted key
+#define TIKI_JSON_VALUELEN  64    // the first (VALUELEN - 1) characters of each wanted value are kept
+
+struct json_value {
+  const char *key;                 // the key whose value is wanted e.g. "itemId"
+  int found;                       // set to 1 once the whole value has been scanned
+  size_t start;                    // byte offset of the value in the response (after the opening " of a string)
+  size_t end;                      // byte offset just after the value (before the closing " of a string)
+  size_t len;                      // number of characters kept in text
+  char text[TIKI_JSON_VALUELEN];   // the start of the value, without the quotes for a string
+};
+
+struct json_scan {
+  struct json_value wanted[TIKI_JSON_MAXKEYS];
+  int nwanted;
+  const char *marker;              // text looked for anywhere in the response e.g. "Success", or NULL
+  size_t markermatch;              // number of marker characters matched so far
+  int markerfound;
+  // tokenizer state
+  size_t pos;                      // number of bytes scanned so far
+  int depth;                       // current object/array nesting depth
+  unsigned long long objects;      // bit (depth-1) is set when that level is an object rather than an array
+  int instring;
+  int escape;
+  int iskey;                       // the string being scanned is an object key
+  int expectkey;                   // the next string will be an object key
+  char key[TIKI_JSON_KEYLEN];
+  size_t keylen;
+  int lastkey;                     // index of the wanted key just scanned, whose value comes next, or -1
+  int capture;                     // index of the wanted value being scanned, or -1
+  int capdepth;                    // depth at which the captured object/array started
+  char captype;                    // '"' string, '{' object or array, 'n' number or literal
+};
+
+// the most texts that webpage_checkall can look for on one page, one bit of its result each
+#define TIKI_MATCH_MAXTEXTS  64
+
+// Aho-Corasick matcher that looks for a set of texts in one pass over a page
+struct text_match {
+  int (*next)[256];                // state reached from each state on each byte - failure links are already folded in
+  unsigned long long *output;      // bit i is set in the states where text i ends
+  int *textlen;
+  int ntexts;
+  int state;                       // current state, carried from one chunk of the page to the next
+  size_t pos;                      // number of bytes scanned so far
+  unsigned long long found;        // bit i is set once text i has been seen
+  unsigned long long all;          // found has every bit in all set once every text has been seen
+  long *offsets;                   // if set, the byte offset where each text was first seen, or -1
+  int stop;                        // if set the download is stopped once every text has been seen
+};
+
+// the most fields (conversions, literal characters and white space) in a compiled date-time format
+#define TIKI_DATETIME_MAXFIELDS  64
+
+struct tiki_datetime {
+  char conv[TIKI_DATETIME_MAXFIELDS];      // conversion letter of each field, ' ' for white space or 0 for a literal character
+  char literal[TIKI_DATETIME_MAXFIELDS];   // the character of each literal field
+  int nfields;
+  char *fallback;                          // the datetime_fmt if it has conversions the fast parser does not handle, otherwise NULL
+};
 
-char swver[8] = "240807";
+// response memory is grown by doubling from this size, or pre-sized from the Content-Length header
+#define TIKI_MEMORY_MINSIZE  256
+// a larger Content-Length is not trusted to pre-size the response memory, which is then just grown as the data arrives
+#define TIKI_MEMORY_PRESIZE_MAX  (64 * 1024 * 1024)
 
 struct MemoryStruct {
   char *memory;
   size_t size;
+  size_t capacity;                 // number of bytes allocated for memory, always more than size
+  struct tiki_session *session;    // if set, memory is handed back to this session for re-use when freed
+  struct json_scan *scan;          // if set, the response is scanned for wanted JSON values as it arrives
+  struct text_match *match;        // if set, the response is searched for a set of texts as it arrives
+  int buffered;                    // if 0 the response is only scanned and not kept in memory
+};
+
+// a cancel handle (see tiki_cancel_create) - triggered from any thread, it stops the calls of every session
+//  it is set on: in-flight transfers are aborted (within about a second) and new calls fail straight away
+struct tiki_cancel {
+  int cancelled;                 // only read and written with atomics
+};
+
+struct tiki_breaker {
+  char domain[100];
+  int failures;                  // the calls in a row that have failed
+  int open;                      // set while calls fail fast - read without the lock, so only written with atomics
+  long long probe_ms;            // while open: when the site is next probed ...
+  long backoff_ms;               // ... and the wait after that if the probe fails
+};
+
+// a domain's rate limit: a token bucket that holds up to burst tokens and is topped up at rate tokens a second
+struct tiki_bucket {
+  char domain[100];
+  int limited;                   // set while calls are rate limited - read without the lock, so only written with atomics
+  double rate;
+  double burst;
+  double tokens;
+  long long refill_us;           // when tokens was last topped up
+  int waiting[TIKI_PRIORITIES];  // the calls of each class waiting for a token
+  int urgent;                    // urgent calls in flight - only read and written with atomics
+};
+
+struct tiki_session {
+  CURL *curl_handle;             // the long-lived easy handle that is re-used for every request
+  struct curl_slist *jsonchunk;  // cached 'accept' + access token headers
+  struct curl_slist *formchunk;  // cached headers for urlencoded tracker POSTs
+  struct curl_slist *mimechunk;  // cached headers for multipart/form-data File gallery POSTs
+  char domain[100];              // main URL text including https:// but no trailing /
+  char *arena;                   // response memory kept from the previous request for re-use, or NULL
+  size_t arenasize;              // number of bytes allocated for arena
+  size_t arenamax;               // response memory up to this size is kept for re-use - 0 (the default) keeps none
+  struct tiki_cache *cache;      // web page responses kept for conditional GETs, or NULL (the default) for none
+  struct tiki_dedup *dedup;      // content hashes of earlier File gallery updates, or NULL (the default) for none
+  int compress;                  // if set, responses are asked for gzip/deflate compressed and curl decompresses them as they arrive
+  size_t compress_min;           // tracker post data of at least this many bytes is sent gzip compressed - 0 sends it all as is
+  struct curl_slist *gzipchunk;  // formchunk headers plus Content-Encoding: gzip
+  char *postgz;                  // the compressed post data of the current request, or NULL
+  long connect_ms;               // the time limits of each call - see tiki_settimeouts
+  long deadline_ms;
+  long stall_ms;
+  struct tiki_cancel *cancel;    // if set, the calls stop when it is triggered
+  struct tiki_breaker *breaker;  // the circuit breaker of the session's domain, or NULL if there are too many domains
+  struct tiki_bucket *bucket;    // the rate limit of the session's domain, or NULL if there are too many domains
+  int priority;                  // the class of the session's calls, or TIKI_PRIORITY_BYCALL (the default)
+  int yielding;                  // set while a bulk call is in flight, so it stands aside for urgent ones
+};
+
+// where the data part of a File gallery upload comes from: either a file that curl reads itself, or memory
+//  (e.g. a captured camera frame or an mmap'd region) that curl reads through a callback without it being copied
+struct upload_data {
+  const char *filepath;          // the file to be uploaded, or NULL if the data is in memory
+  const char *buffer;            // the data in memory ...
+  size_t size;                   // ... and its size
+  size_t pos;                    // how much of the buffer curl has read so far
+};
+
+// resumable File gallery downloads: the file is written to a .part file whose progress is checkpointed so an
+//  interrupted download carries on from where it stopped, and big files are fetched as parallel Range segments
+#define TIKI_RANGE_MAGIC        "TIKIPART1"
+#define TIKI_RANGE_MAXSEGMENTS  16
+#define TIKI_RANGE_MINSEGMENT   (1024 * 1024)    // files are only split into segments of at least this size
+#define TIKI_RANGE_CHECKPOINT   (1024 * 1024)    // progress is checkpointed after this many bytes, and after each failure
+#define TIKI_RANGE_RETRYMS      500              // the first wait before a failed segment is tried again, doubled after each failure ...
+#define TIKI_RANGE_MAXRETRYMS   (30 * 1000)      // ... up to this
+
+struct range_segment {
+  curl_off_t start;              // first byte of the segment
+  curl_off_t next;               // next byte to be received
+  curl_off_t end;                // last byte of the segment, or -1 if the file size is not known
+  CURL *curl_handle;             // only set while the segment is in flight
+  long status;                   // HTTP status of the current response
+  int failures;                  // failures in a row without any progress
+  long long retry_ms;            // the segment is not tried again before this time
+  struct range_download *download;
+};
+
+struct range_download {
+  int debug;
+  int fd;                        // the .part file
+  char part[200];
+  char checkpoint[210];
+  char filename[100];            // the name the file gets once it is complete
+  char validator[128];           // ETag (or else Last-Modified) sent as If-Range so a changed file is not spliced
+  curl_off_t size;               // the file size, or -1 if the server does not do ranges
+  int ranged;                    // set if the server answers Range requests
+  int restart;                   // set if the server sent the whole file to a Range request, i.e. it has changed
+  curl_off_t unsynced;           // bytes written since the last checkpoint
+  int nsegments;
+  struct range_segment segments[TIKI_RANGE_MAXSEGMENTS];
+};
+
+// the ETag and Last-Modified values of a web page response are only kept if they are shorter than this
+#define TIKI_CACHE_VALIDATORLEN  128
+#define TIKI_CACHE_MAGIC         "TIKICACHE1"
+
+struct tiki_cache_entry {
+  char *url;                     // the full API URL that the page was downloaded from
+  char etag[TIKI_CACHE_VALIDATORLEN];      // ETag of the kept page, or empty
+  char lastmod[TIKI_CACHE_VALIDATORLEN];   // Last-Modified of the kept page, or empty
+  char *body;                    // the kept page content
+  size_t size;
+  unsigned long used;            // when the entry was last used, for least recently used eviction
+};
+
+struct tiki_cache {
+  struct tiki_cache_entry *entries;
+  int nentries;
+  int max_entries;               // the most pages kept in memory ...
+  size_t bytes;
+  size_t max_bytes;              // ... and the most page content bytes kept in memory
+  unsigned long clock;
+  char *cachedir;                // directory that every kept page is also written to, or NULL for memory only
+};
+
+// the ETag and Last-Modified headers of a web page response, collected as it arrives
+struct cache_response {
+  struct MemoryStruct *mem;
+  char etag[TIKI_CACHE_VALIDATORLEN];
+  char lastmod[TIKI_CACHE_VALIDATORLEN];
+};
+
+// File gallery update deduplication: an update that would send exactly what the last successful update
+//  of the same file sent is skipped and answered with the response kept from that update
+#define TIKI_DEDUP_MAGIC     "TIKIDEDUP1"
+#define TIKI_DEDUP_CHUNK     (64 * 1024)     // file contents are hashed this many bytes at a time
+
+struct dedup_entry {
+  char fileId[24];
+  uint64_t hash;                 // 64-bit FNV-1a of the file contents, name, title and description that were sent
+  char *result;                  // the response to that update
+};
+
+struct tiki_dedup {
+  struct dedup_entry *entries;
+  int nentries;
+  int capacity;
+  char *indexpath;               // file the index is kept in, so that it outlives the session (and the hub)
+};
+
+// per-call latency instrumentation: the time each API call spends in each phase of its transfer is counted
+//  in log-linear (HDR-style) histograms - exact below 16 microseconds, then 8 buckets per power of 2, so
+//  every value is kept to within 12.5% - up to 2^32 microseconds (71 minutes), which is where longer times go
+#define TIKI_CALL_WEBPAGE       0
+#define TIKI_CALL_ITEMPOST      1
+#define TIKI_CALL_ITEMUPDATE    2
+#define TIKI_CALL_ITEMGET       3
+#define TIKI_CALL_FILEDOWNLOAD  4
+#define TIKI_CALL_FILEUPLOAD    5
+#define TIKI_CALL_FILEUPDATE    6
+#define TIKI_STATS_CALLS        7
+#define TIKI_STATS_PHASES       6     // dns, connect, tls, server, transfer and total - see stats_phases
+#define TIKI_STATS_BUCKETS      240
+
+struct stats_histogram {
+  uint32_t counts[TIKI_STATS_BUCKETS];
+  uint64_t count;
+  uint64_t sum_us;
+};
+
+// each thread counts into its own block, so recording a call takes no lock and shares no cache lines -
+//  a block is kept (with its counts) when its thread ends and is taken over by the next new thread
+struct stats_thread {
+  struct stats_histogram phases[TIKI_STATS_CALLS][TIKI_STATS_PHASES];
+  uint64_t sent[TIKI_STATS_CALLS];      // request and ...
+  uint64_t received[TIKI_STATS_CALLS];  // ... response body bytes as they went over the wire
+  struct stats_histogram queue[TIKI_PRIORITIES];   // the time calls of each priority class waited to be sent
+  int owned;                     // set while a thread is counting into the block
+  struct stats_thread *next;
+};
+
+#define TIKI_MULTI_ITEMPOST    1
+#define TIKI_MULTI_ITEMUPDATE  2
+#define TIKI_MULTI_ITEMGET     3
+#define TIKI_MULTI_FILEDOWNLOAD 4
+#define TIKI_MULTI_FILEUPLOAD  5
+
+// a File gallery file being downloaded by a tiki_multi, written straight to its final path
+struct file_download {
+  char fileId[24];
+  char filespath[100];           // folder the file is stored in, including both the first and last /
+  char filename[100];            // the dictated file name, or the one from the Content-Disposition header, or empty
+  int dictated;                  // set if filename was passed by the caller rather than taken from the headers
+  char target[200];              // the full path of the file once it has been opened
+  FILE *fp;                      // opened when the first bytes of the file arrive
+  int skipping;                  // set if the response is an HTTP error page, which is not stored
+  curl_off_t written;            // bytes of the (decompressed) file written so far
+  CURL *curl_handle;
+};
+
+// a file being uploaded to a File gallery by a tiki_multi - curl reads the file itself as it is sent
+struct file_upload {
+  char filepath[200];
+  char galId[24];
+  char filename[100];
+  char *filetitle;               // the operation's own copies of the title ...
+  char *filedesc;                // ... and description
+  curl_mime *form;               // only set while the operation is in flight
+};
+
+struct tiki_multi_op {
+  int opId;                      // Id returned to the caller when the operation was submitted
+  int optype;                    // one of the TIKI_MULTI_ values above
+  char API_URL[200];
+  char *post_data;               // the operation's own copy of the post data
+  char *postgz;                  // the post data gzip compressed while the operation is in flight, or NULL
+  struct MemoryStruct memchunk;  // the API response text
+  struct json_scan scan;         // the JSON values wanted from the API response
+  CURL *curl_handle;             // only set while the operation is in flight
+  char *result;                  // the extracted result once the operation is complete
+  CURLcode res;                  // the curl result and ...
+  long httpcode;                 // ... the HTTP response code once the operation is complete
+  curl_off_t bytes;              // the number of response bytes received ...
+  double seconds;                // ... and how long the whole transfer took
+  struct file_download download; // only used by TIKI_MULTI_FILEDOWNLOAD operations
+  struct file_upload upload;     // only used by TIKI_MULTI_FILEUPLOAD operations
+  int priority;                  // the operation's priority class
+  long long queued_us;           // when it was queued
+  int paused;                    // set while a bulk transfer is paused for urgent ones
+  struct tiki_multi_op *next;
+};
+
+struct tiki_multi {
+  int debug;
+  tiki_session *session;         // provides the domain and the cached header lists
+  CURLM *multi_handle;
+  int max_inflight;              // the most requests that are in flight at the same time - urgent ones may go beyond it
+  int inflight;
+  int urgent;                    // urgent requests in flight
+  int queued;
+  int nextId;
+  int priority;                  // the class of the operations submitted from now on
+  long token_ms;                 // while queued operations are held up by the rate limit: the wait for the next token
+  CURL **idle;                   // easy handles kept for re-use by the next queued operation
+  int nidle;
+  struct tiki_multi_op *queue_head[TIKI_PRIORITIES], *queue_tail[TIKI_PRIORITIES];    // submitted but not yet started, by class
+  struct tiki_multi_op *active;                     // in flight
+  struct tiki_multi_op *done_head, *done_tail;      // complete and waiting for tiki_multi_poll
+  tiki_multi_callback callback;
+  void *userdata;
+};
+
+struct tiki_batch_reading {
+  int readingId;                 // Id returned to the caller when the reading was added
+  char *post_data;               // the reading's own copy of the post data
+  struct tiki_batch_reading *next;
+};
+
+struct tiki_batch_tracker {
+  char trackerId[20];
+  struct tiki_batch_reading *head, *tail;    // readings waiting to be flushed
+  int count;
+  size_t bytes;                  // total length of the waiting post data
+  long long oldest_ms;           // when the oldest waiting reading was added
+};
+
+struct tiki_batch_slot {
+  int opId;                      // the tiki_multi operation that a reading was sent as, or 0 if the slot is free
+  int readingId;
+  int tracker;                   // index of the reading's tracker in trackers
+};
+
+struct tiki_batch {
+  int debug;
+  tiki_multi *multi;             // sends the flushed readings as concurrent item posts
+  int max_pending;               // the most readings that are waiting, in flight or not yet collected
+  int max_count;                 // a tracker's readings are flushed when this many are waiting ...
+  size_t max_bytes;              // ... or their post data adds up to this many bytes ...
+  int max_age_ms;                // ... or the oldest has waited this long
+  int pending;
+  int nextId;
+  struct tiki_batch_tracker *trackers;
+  int ntrackers;
+  int maxtrackers;
+  struct tiki_batch_slot *slots; // max_pending slots, each operation's slot is found from opId % max_pending onwards
+  tiki_batch_callback callback;
+  void *userdata;
+};
+
+// the outbox file is a header followed by the appended records, each a multiple of 8 bytes long
+#define TIKI_OUTBOX_MAGIC      "TIKIOBX1"
+#define TIKI_OUTBOX_HEADSIZE   64
+#define TIKI_OUTBOX_MINSIZE    (1024 * 1024)    // the outbox file starts this size and is doubled when full
+#define TIKI_OUTBOX_PENDING    0
+#define TIKI_OUTBOX_DONE       1
+#define TIKI_OUTBOX_SYNCCOUNT  64     // appended records are fsync'ed in batches of this many ...
+#define TIKI_OUTBOX_SYNCMS     100    // ... or when the oldest has waited this long
+#define TIKI_OUTBOX_FAILURES   3      // this many failures in a row (or max_inflight if more) means the Tiki site is down ...
+#define TIKI_OUTBOX_RETRYMS    1000   // ... and the first wait before trying it again is this long ...
+#define TIKI_OUTBOX_MAXRETRYMS (5 * 60 * 1000)  // ... doubled after each failure up to this
+
+struct outbox_header {
+  char magic[8];
+  uint64_t head;                 // offset of the first record that is not yet done
+  uint64_t tail;                 // offset just after the last record
+};
+
+struct outbox_record {
+  uint32_t length;               // of the whole record including the post data and padding
+  uint32_t state;                // TIKI_OUTBOX_PENDING or TIKI_OUTBOX_DONE
+  uint32_t checksum;             // FNV-1a of everything after this field, so a torn append is found when reopened
+  uint32_t optype;               // TIKI_MULTI_ITEMPOST or TIKI_MULTI_ITEMUPDATE
+  char trackerId[20];
+  char itemId[20];
+  char post_data[];              // 0 terminated
+};
+
+struct outbox_inflight {
+  int opId;                      // the tiki_multi operation the record was sent as
+  uint64_t offset;               // the record's offset in the outbox file
+};
+
+struct tiki_outbox {
+  int debug;
+  int fd;
+  char *map;                     // the whole outbox file mapped into memory
+  size_t mapsize;
+  tiki_multi *multi;             // replays the records - only used by the drain thread
+  pthread_t thread;
+  pthread_mutex_t lock;          // protects everything below, and the mapped file
+  pthread_cond_t wake;
+  int stop;
+  uint64_t cursor;               // offset of the next record to send
+  int pending;                   // records that are not yet done
+  int unsynced;                  // records appended since the last fsync
+  long long unsynced_ms;         // when the oldest of them was appended
+  int failures;                  // records that failed to reach the Tiki site in a row
+  int down_after;                // this many failures in a row means the site is down
+  long long retry_ms;            // no records are sent before this time
+  long long retry_wait_ms;       // the wait before retry_ms, doubled each time the site is found to be still down
+  struct outbox_inflight *inflight;
+  int ninflight;
+  int max_inflight;
+};
+
+
+// leveled logging: every message is logged through one of the macros below, and messages of a level
+//  above TIKI_LOG_LEVEL are compiled out altogether - build with e.g. -DTIKI_LOG_LEVEL=TIKI_LOG_WARN so that
+//  the debug parameter of the functions costs nothing, or leave it at the default to keep the debug output
+#define TIKI_LOG_ERROR  1
+#define TIKI_LOG_WARN   2
+#define TIKI_LOG_INFO   3
+#define TIKI_LOG_DEBUG  4
+#ifndef TIKI_LOG_LEVEL
+#define TIKI_LOG_LEVEL  TIKI_LOG_DEBUG
+#endif
+
+#define TIKI_ERROR(...)        do { if (TIKI_LOG_LEVEL >= TIKI_LOG_ERROR) log_write(TIKI_LOG_ERROR, __VA_ARGS__); } while (0)
+#define TIKI_WARN(...)         do { if (TIKI_LOG_LEVEL >= TIKI_LOG_WARN) log_write(TIKI_LOG_WARN, __VA_ARGS__); } while (0)
+#define TIKI_DEBUGGING(debug)  (TIKI_LOG_LEVEL >= TIKI_LOG_DEBUG && (debug) == 1)
+#define TIKI_DEBUG(debug, ...) do { if (TIKI_DEBUGGING(debug)) log_write(TIKI_LOG_DEBUG, __VA_ARGS__); } while (0)
+
+// once tiki_log_start has been called messages are queued in a lock-free ring of slots, which a background
+//  thread writes out, so a request never waits for the terminal or the disk - a message takes as many slots
+//  as its text needs, and is dropped (and counted) rather than waited for if the ring is full
+#define TIKI_LOG_SLOTS     1024    // a power of 2
+#define TIKI_LOG_SLOTTEXT  248     // text bytes in each slot
+#define TIKI_LOG_MAXTEXT   8192    // longer messages (e.g. whole web pages) are cut short when queued
+#define TIKI_LOG_IDLEMS    20      // the writer sleeps this long once it has written everything queued
+
+struct log_slot {
+  uint64_t seq;                  // the ring position the slot is free for, or that position + 1 once it is written
+  int nslots;                    // in the first slot of a message, the number of slots it takes
+  int len;                       // text bytes in this slot
+  char text[TIKI_LOG_SLOTTEXT];
 };
 
+static struct log_slot *log_ring = NULL;
+static uint64_t log_head = 0;    // next ring position to be claimed by a message
+static uint64_t log_tail = 0;    // next ring position to be written out - only used by the writer
+static uint64_t log_dropped = 0; // messages dropped because the ring was full
+static FILE *log_fp = NULL;
+static int log_running = 0;      // set while the writer thread is running
+static int log_stop = 0;
+static pthread_t log_thread;
+
+
+// ***************************************************************************
+// write a log message: straight to stdout (stderr for errors) as printf
+//  would, or if the background writer is running, into the ring for it
+// ***************************************************************************
+static void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void log_write(int level, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+        vfprintf((level == TIKI_LOG_ERROR) ? stderr : stdout, fmt, args);
+        va_end(args);
+        return;
+    }
+    char text[TIKI_LOG_MAXTEXT];
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+    if (len >= (int)sizeof(text)) {
+        len = sizeof(text) - 1;
+        memcpy(text + len - 5, "...\n", 5);
+        len--;
+    }
+    int nslots = (len + TIKI_LOG_SLOTTEXT - 1) / TIKI_LOG_SLOTTEXT;
+    if (nslots == 0) {
+        return;
+    }
+
+    /* claim nslots consecutive positions: they are free once the last of them is, as the writer frees them in order */
+    uint64_t pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    for (;;) {
+        struct log_slot *last = &log_ring[(pos + nslots - 1) & (TIKI_LOG_SLOTS - 1)];
+        uint64_t seq = __atomic_load_n(&last->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos + nslots - 1) {
+            if (__atomic_compare_exchange_n(&log_head, &pos, pos + nslots, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (seq < pos + nslots - 1) {
+            /* the ring is full */
+            __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+        }
+    }
+    int i;
+    for (i = 0; i < nslots; i++) {
+        struct log_slot *slot = &log_ring[(pos + i) & (TIKI_LOG_SLOTS - 1)];
+        slot->nslots = (i == 0) ? nslots : 0;
+        slot->len = (len - i * TIKI_LOG_SLOTTEXT < TIKI_LOG_SLOTTEXT) ? len - i * TIKI_LOG_SLOTTEXT : TIKI_LOG_SLOTTEXT;
+        memcpy(slot->text, text + i * TIKI_LOG_SLOTTEXT, slot->len);
+        __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+    }
+}
+
+
+// ***************************************************************************
+// the background writer: writes out every complete message in the ring, in
+//  the order they were queued, then sleeps for a while once it has caught up
+// ***************************************************************************
+static int log_drain(void)
+{
+    int written = 0;
+    for (;;) {
+        struct log_slot *slot = &log_ring[log_tail & (TIKI_LOG_SLOTS - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_tail + 1) {
+            break;
+        }
+        int nslots = slot->nslots;
+        struct log_slot *last = &log_ring[(log_tail + nslots - 1) & (TIKI_LOG_SLOTS - 1)];
+        if (__atomic_load_n(&last->seq, __ATOMIC_ACQUIRE) != log_tail + nslots) {
+            /* the rest of the message is still being copied in */
+            break;
+        }
+        int i;
+        for (i = 0; i < nslots; i++) {
+            slot = &log_ring[(log_tail + i) & (TIKI_LOG_SLOTS - 1)];
+            fwrite(slot->text, 1, slot->len, log_fp);
+            __atomic_store_n(&slot->seq, log_tail + i + TIKI_LOG_SLOTS, __ATOMIC_RELEASE);
+        }
+        log_tail += nslots;
+        written = 1;
+    }
+    uint64_t dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        fprintf(log_fp, "\n*** %llu log messages dropped as the log ring was full ***\n", (unsigned long long)dropped);
+        written = 1;
+    }
+    if (written) {
+        fflush(log_fp);
+    }
+    return written;
+}
+
+static void* log_writer(void *arg)
+{
+    struct timespec idle = { 0, TIKI_LOG_IDLEMS * 1000000L };
+    while (!__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE)) {
+        if (!log_drain()) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    log_drain();
+    return NULL;
+}
+
+
+// ***************************************************************************
+// start and stop the background log writer - until it is started (and once
+//  it is stopped) messages are written straight out as they are logged
+// ***************************************************************************
+int tiki_log_start(const char* filepath)
+{
+    // filepath: full path-name of a file the messages are appended to, or NULL for stdout
+    // call this before the other functions are used, as it is not synchronised with messages being logged
+    // returns 0 if the writer was started or -1 if it could not be
+
+    if (log_running) {
+        return 0;
+    }
+    log_ring = calloc(TIKI_LOG_SLOTS, sizeof(struct log_slot));
+    log_fp = (filepath != NULL) ? fopen(filepath, "a") : stdout;
+    if (log_ring == NULL || log_fp == NULL) {
+        fprintf(stderr, "tiki_log_start() failed: %s\n", (log_ring == NULL) ? "not enough memory" : "the log file could not be opened");
+        free(log_ring);
+        log_ring = NULL;
+        return -1;
+    }
+    uint64_t i;
+    for (i = 0; i < TIKI_LOG_SLOTS; i++) {
+        log_ring[i].seq = i;
+    }
+    log_head = 0;
+    log_tail = 0;
+    log_stop = 0;
+    if (pthread_create(&log_thread, NULL, log_writer, NULL) != 0) {
+        fprintf(stderr, "tiki_log_start() failed: the writer thread could not be started\n");
+        if (log_fp != stdout) {
+            fclose(log_fp);
+        }
+        free(log_ring);
+        log_ring = NULL;
+        return -1;
+    }
+    __atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void tiki_log_stop(void)
+{
+    // writes out everything still queued - call it once no other functions are in use
+
+    if (!log_running) {
+        return;
+    }
+    __atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&log_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(log_thread, NULL);
+    if (log_fp != stdout) {
+        fclose(log_fp);
+    }
+    log_fp = NULL;
+    free(log_ring);
+    log_ring = NULL;
+}
+
 
 // ************************************
 // Function to get the size of a file
@@ -56,15 +739,50 @@ long int findSize(const char* file_name)
 char* copyString(char s[])
 {
     // passed parameter s is the string to be copied
-    // returns a copy of the string
+    // returns a copy of the string that is allocated at exactly the length needed
+    //  and which the caller owns and should release with tiki_free
     char* s2;
-    s2 = (char*)malloc(10000);   // this is made very large just in case some API responses are very long!
- 
+    s2 = (char*)malloc(strlen(s) + 1);
+    if (s2 == NULL) {
+        return NULL;
+    }
     strcpy(s2, s);  // s2 is the destination string, s is the source string
     return (char*)s2;
 }
 
 
+// ********************************************
+// Function to join two strings into a new copy
+// ********************************************
+char* concatString(const char* s1, const char* s2)
+{
+    // passed parameters s1 and s2 are the strings to be joined
+    // returns a new string of s1 followed by s2 that the caller should release with tiki_free
+    size_t len1 = strlen(s1);
+    size_t len2 = strlen(s2);
+    char* s3 = (char*)malloc(len1 + len2 + 1);
+    if (s3 == NULL) {
+        return NULL;
+    }
+    memcpy(s3, s1, len1);
+    memcpy(s3 + len1, s2, len2 + 1);
+    return s3;
+}
+
+
+// ***********************************************************************
+// Function to release a result string returned by any of the functions
+//  in this library: every char* result (including the error message
+//  texts) is allocated by the library so must be released once used -
+//  this is also the entry point to use from Python via ctypes
+// ***********************************************************************
+void tiki_free(char* result)
+{
+    // result: a string returned by one of the library functions - NULL is ignored
+    free(result);
+}
+
+
 // ***********************************************************************************************************
 // the function below removes rm_length characters from a string after character index. Taken from :
 //  https://codereview.stackexchange.com/questions/116004/remove-specified-number-of-characters-from-a-string
@@ -99,1617 +817,6436 @@ void connect_iot()
 }
 
 
+// ***************************************************************************
+// one-time library set up: curl_global_init is not thread safe (and neither
+//  is curl_global_cleanup, which is therefore never called) so it is done
+//  exactly once, by whichever thread creates the first session - along with
+//  the share of the DNS cache and TLS sessions, which is
+//  then kept for as long as the program runs
+// ***************************************************************************
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    pthread_mutex_lock(&share_locks[data]);
+}
 
-// ***************************************************************
-//   download full web page function
-// curl code based upon https://curl.se/libcurl/c/getinmemory.html
-// ***************************************************************
-char* webpage_download(int debug, const char* domain, const char* page, char* access_token)
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
 {
-    // debug: if set to 1 this produces (lots!!) of additional output
-    // domain: string used for the main URL text that must include https:// but no trailing /
-    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
-    // access_token: the API access token that enables specific permissions for the API usage
-    // web page content is returned as returnstr from the cURL response
+    pthread_mutex_unlock(&share_locks[data]);
+}
 
-    char *returnstr = "";
-	if (debug==1)
-    {
-       printf ("\n *** debug from webpage_download ...\n");
-       printf ("domain name is: %s\n", domain);
-       printf ("page name is: %s\n", page);
+static void library_init(void)
+{
+    int i;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share_locks[i], NULL);
     }
-    // build the full wiki API URL
-    char wiki_api[15] = "/api/wiki/page";
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, wiki_api);
-	strcat(API_URL, page);
-	if (debug==1)
-    {
-       printf ("\n *** debug from webpage_download ...\n");
-       printf ("API URL is: %s\n", API_URL);
-	}
+    share_handle = curl_share_init();
+    if (share_handle == NULL) {
+        TIKI_WARN("curl_share_init failed: each curl handle will keep its own DNS and TLS session caches\n");
+        return;
+    }
+    curl_share_setopt(share_handle, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share_handle, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
 
-    // GET the content of the web page
-    CURL *curl_handle;
-    CURLcode res;
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;    /* no data at this point */
- 
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-    /* specify URL to get */
+
+// ***************************************************************************
+// a new curl easy handle that uses the library-wide shared caches - the
+//  share stays attached through curl_easy_reset
+// ***************************************************************************
+static CURL* share_easy_init(void)
+{
+    pthread_once(&library_once, library_init);
+    CURL *curl_handle = curl_easy_init();
+    if (curl_handle != NULL && share_handle != NULL) {
+        curl_easy_setopt(curl_handle, CURLOPT_SHARE, share_handle);
+    }
+    return curl_handle;
+}
+
+
+// ***************************************************************************
+// per-domain circuit breakers: when a Tiki site is down (or overloaded) the
+//  calls to it fail fast rather than each one waiting for its own time out,
+//  so the hub's queues keep moving - and a background thread probes the site
+//  with HEAD requests, backing off, until it answers and the breaker closes
+// ***************************************************************************
+static struct tiki_breaker breakers[TIKI_BREAKER_MAX];
+static int nbreakers = 0;
+static int breaker_probing = 0;          // set while the probe thread is running
+static pthread_mutex_t breaker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long breaker_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// the breaker of a domain, added if it has none yet - breakers are never removed
+static struct tiki_breaker* breaker_find(const char* domain)
+{
+    struct tiki_breaker *breaker = NULL;
+    int i;
+    pthread_mutex_lock(&breaker_lock);
+    for (i = 0; i < nbreakers; i++) {
+        if (strcmp(breakers[i].domain, domain) == 0) {
+            breaker = &breakers[i];
+            break;
+        }
+    }
+    if (breaker == NULL && nbreakers < TIKI_BREAKER_MAX) {
+        breaker = &breakers[nbreakers++];
+        snprintf(breaker->domain, sizeof(breaker->domain), "%s", domain);
+    }
+    pthread_mutex_unlock(&breaker_lock);
+    return breaker;
+}
+
+// is the Tiki site answering? any response other than a server error counts
+static int breaker_probe(const char* domain)
+{
+    char API_URL[104];
+    long httpcode = 0;
+    snprintf(API_URL, sizeof(API_URL), "%s/", domain);
+    CURL *curl_handle = share_easy_init();
+    if (curl_handle == NULL) {
+        return 0;
+    }
     curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
-    /* send all data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
     curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT_MS, __atomic_load_n(&timeout_connect, __ATOMIC_RELAXED));
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, 10000L);
+    CURLcode res = curl_easy_perform(curl_handle);
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpcode);
+    curl_easy_cleanup(curl_handle);
+    return (res == CURLE_OK && httpcode < 500);
+}
 
-    // set the custom headers 
-    struct curl_slist *headchunk = NULL;
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the authorization header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
- 
-    /* get it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        returnstr = copyString("curl access to the Tiki site for the web page download function failed");
-    } else if (memchunk.size == 0) {
-        printf("the curl request may have been processed BUT there was no response from the server API\n");
-        returnstr = copyString("no response from the curl request sent to the server API");
-    } else {
-        /*
-        * Now, our memchunk.memory points to a memory block that is memchunk.size
-        * bytes big and contains the web page content.
-        *
-        */
-	    if (debug==1)
-        {
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full wiki page text is: %s\n", memchunk.memory);
+// the background thread that probes every open breaker when it is due - it
+//  stops once no breaker is open, and is started again when one next opens
+static void* breaker_prober(void *arg)
+{
+    char domain[100];
+    int i;
+    pthread_mutex_lock(&breaker_lock);
+    while (1) {
+        struct tiki_breaker *due = NULL;
+        int anyopen = 0;
+        long long now = breaker_now_ms();
+        long long wait = TIKI_BREAKER_MAXPROBEMS;
+        for (i = 0; i < nbreakers; i++) {
+            if (!breakers[i].open) {
+                continue;
+            }
+            anyopen = 1;
+            if (breakers[i].probe_ms <= now) {
+                due = &breakers[i];
+                break;
+            }
+            if (breakers[i].probe_ms - now < wait) {
+                wait = breakers[i].probe_ms - now;
+            }
+        }
+        if (!anyopen) {
+            breaker_probing = 0;
+            break;
+        }
+        if (due == NULL) {
+            pthread_mutex_unlock(&breaker_lock);
+            struct timespec pause = { wait / 1000, (wait % 1000) * 1000000 };
+            nanosleep(&pause, NULL);
+            pthread_mutex_lock(&breaker_lock);
+            continue;
+        }
+
+        strcpy(domain, due->domain);
+        pthread_mutex_unlock(&breaker_lock);
+        int answered = breaker_probe(domain);
+        pthread_mutex_lock(&breaker_lock);
+        if (answered) {
+            due->failures = 0;
+            __atomic_store_n(&due->open, 0, __ATOMIC_RELEASE);
+            TIKI_WARN("circuit breaker for %s closed: the site is answering again\n", domain);
+        } else {
+            due->probe_ms = breaker_now_ms() + due->backoff_ms;
+            due->backoff_ms = (due->backoff_ms * 2 < TIKI_BREAKER_MAXPROBEMS) ? due->backoff_ms * 2 : TIKI_BREAKER_MAXPROBEMS;
         }
-        returnstr = copyString(memchunk.memory);
     }
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-    free(memchunk.memory);
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
+    pthread_mutex_unlock(&breaker_lock);
+    return NULL;
+}
 
-	return returnstr;
+// count the outcome of a transfer - transport failures and server (5xx)
+//  errors count against the site, anything else closes the count again
+static void breaker_record(struct tiki_breaker* breaker, CURL* curl_handle, CURLcode res)
+{
+    long httpcode = 0;
+    if (breaker == NULL || res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_WRITE_ERROR) {
+        // cancelled, or stopped on purpose (or by the disk) on the hub's side - which says nothing about the site
+        return;
+    }
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpcode);
+    int failed = (res != CURLE_OK || httpcode >= 500);
+    int threshold = __atomic_load_n(&breaker_failures, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&breaker_lock);
+    if (!failed) {
+        breaker->failures = 0;
+    } else if (++breaker->failures >= threshold && threshold > 0 && !breaker->open) {
+        breaker->backoff_ms = __atomic_load_n(&breaker_probems, __ATOMIC_RELAXED);
+        breaker->probe_ms = breaker_now_ms() + breaker->backoff_ms;
+        __atomic_store_n(&breaker->open, 1, __ATOMIC_RELEASE);
+        TIKI_WARN("circuit breaker for %s opened after %d failed calls in a row: calls fail fast until the site answers a probe\n",
+                  breaker->domain, breaker->failures);
+        if (!breaker_probing) {
+            pthread_t prober;
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            breaker_probing = (pthread_create(&prober, &attr, breaker_prober, NULL) == 0);
+            pthread_attr_destroy(&attr);
+            if (!breaker_probing) {
+                // with no prober the breaker could never close again
+                __atomic_store_n(&breaker->open, 0, __ATOMIC_RELEASE);
+                TIKI_ERROR("circuit breaker for %s: the probe thread could not be started\n", breaker->domain);
+            }
+        }
+    }
+    pthread_mutex_unlock(&breaker_lock);
 }
 
 
-// ***************************************************************
-// web page simple/general content check function: looks for 
-//  specific content on a page and returns 0 if false or 1 if true
-// curl code based upon https://curl.se/libcurl/c/getinmemory.html
-// ***************************************************************
-_Bool webpage_check(int debug, const char* domain, const char* page, char* access_token, const char* check_text)
+// ***************************************************************************
+// set how the circuit breakers trip: after failures calls in a row to a
+//  domain have failed, and the first background probe is probe_ms later
+// ***************************************************************************
+void tiki_setbreaker(int failures, long probe_ms)
 {
-    // debug: if set to 1 this produces (lots!!) of additional output
-    // domain: string used for the main URL text that must include https:// but no trailing /
-    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
-    // access_token: the API access token that enables specific permissions for the API usage
-    // check_text: text string that is 'looked for' on the web page content
-    // check_result is returned as either TRUE or FALSE
+    // failures: the failed calls in a row that open a domain's breaker - 0 turns the breakers off
+    // probe_ms: the wait before the first probe of an opened breaker, doubled after each failed probe up to a minute
+    // turning the breakers off also closes any that are open
 
-    bool check_result = false;
-	if (debug==1)
-    {
-       printf ("\n *** debug from webpage_check ...\n");
-       printf ("domain name is: %s\n", domain);
-       printf ("page name is: %s\n", page);
-       printf ("text to be found is: %s\n", check_text);
+    int i;
+    __atomic_store_n(&breaker_failures, failures, __ATOMIC_RELAXED);
+    __atomic_store_n(&breaker_probems, (probe_ms > 0) ? probe_ms : 1, __ATOMIC_RELAXED);
+    if (failures <= 0) {
+        pthread_mutex_lock(&breaker_lock);
+        for (i = 0; i < nbreakers; i++) {
+            breakers[i].failures = 0;
+            __atomic_store_n(&breakers[i].open, 0, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&breaker_lock);
     }
-    // build the full wiki API URL
-    char wiki_api[15] = "/api/wiki/page";
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, wiki_api);
-	strcat(API_URL, page);
-	if (debug==1)
-    {
-       printf ("\n *** debug from webpage_check ...\n");
-       printf ("API URL is: %s\n", API_URL);
-	}
+}
 
-    // GET the content of the web page
-    CURL *curl_handle;
-    CURLcode res;
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;    /* no data at this point */
- 
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-    /* specify URL to get */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
-    /* send all data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
 
-    // set the custom headers 
-    struct curl_slist *headchunk = NULL;
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the authorization header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
- 
-    /* get it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        // check_result is already set to false - so no need to update it
-    } else if (memchunk.size == 0) {
-        printf("the curl request may have been processed BUT there was no response from the server API\n");
-        check_result = false;
-    } else {
-        /*
-        * Now, our memchunk.memory points to a memory block that is memchunk.size
-        * bytes big and contains the web page content.
-        *
-        * content check code below does a string check against the 'check_text' string
-        */
-	    if (debug==1)
-        {
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             //printf("the full wiki page text is: %s\n", memchunk.memory);
+// ***************************************************************************
+// whether calls to a domain are currently failing fast - e.g. so a hub can
+//  keep readings in its outbox rather than trying to send them
+// ***************************************************************************
+int tiki_breaker_open(const char* domain)
+{
+    // domain: the main URL text exactly as given to the other functions
+    // returns 1 if the domain's breaker is open or 0 if it is closed (or the domain has not been used)
+
+    int open = 0;
+    int i;
+    pthread_mutex_lock(&breaker_lock);
+    for (i = 0; i < nbreakers; i++) {
+        if (strcmp(breakers[i].domain, domain) == 0) {
+            open = breakers[i].open;
+            break;
         }
-         char *found;
-         // use strstr to check if the check_text is 'in' memchunk.memory
-         //  - returns pointer to start if found, or a null pointer if not
-         found = strstr(memchunk.memory, check_text);  // found is now the whole string from check_text onwards if found
-         // now remove all the characters after the check_text characters
-         removeString(found, strlen(check_text), strlen(memchunk.memory));
-         if ( found != NULL )  {  // check_text string must have been found!
-		     check_result = true;
-	         if (debug==1)
-             {
-                 printf ("\ntext found - cropped found text is: %s\n", found);
-             }
+    }
+    pthread_mutex_unlock(&breaker_lock);
+    return open;
+}
 
-         } else {
-	         if (debug==1)
-             {
-                 printf ("\ntext not found\n");
-             }
-             check_result = false;
-         }
+
+// ***************************************************************************
+// per-domain rate limits: a token bucket for each Tiki site, shared by every
+//  session, tiki_multi, tiki_batch and tiki_outbox calling it, so a hub with
+//  many threads (or a burst of readings) keeps within what the site can take.
+//  Each call takes a token, and calls waiting for one are let through in
+//  priority class order - an urgent alarm update never waits behind bulk calls
+// ***************************************************************************
+static struct tiki_bucket buckets[TIKI_BUCKET_MAX];
+static int nbuckets = 0;
+static pthread_mutex_t bucket_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bucket_wake = PTHREAD_COND_INITIALIZER;    // broadcast when a token is taken or the limit changes
+
+static long long bucket_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// the rate limit of a domain, added (with no limit) if it has none yet - rate limits are never removed
+static struct tiki_bucket* bucket_find(const char* domain)
+{
+    struct tiki_bucket *bucket = NULL;
+    int i;
+    pthread_mutex_lock(&bucket_lock);
+    for (i = 0; i < nbuckets; i++) {
+        if (strcmp(buckets[i].domain, domain) == 0) {
+            bucket = &buckets[i];
+            break;
+        }
     }
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-    free(memchunk.memory);
-    if (debug==1)
-    {
-        printf ("\ncurl_handle cleaned up and memchunk.memory freed\n");
+    if (bucket == NULL && nbuckets < TIKI_BUCKET_MAX) {
+        bucket = &buckets[nbuckets++];
+        snprintf(bucket->domain, sizeof(bucket->domain), "%s", domain);
     }
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-    if (debug==1)
-    {
-        printf ("curl_global cleaned up and returning check_result: %s\n", check_result?"true":"false");
+    pthread_mutex_unlock(&bucket_lock);
+    return bucket;
+}
+
+// top up the tokens for the time since they were last topped up - called with bucket_lock held
+static void bucket_refill(struct tiki_bucket* bucket, long long now_us)
+{
+    bucket->tokens += (now_us - bucket->refill_us) * bucket->rate / 1000000.0;
+    if (bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
     }
-	return check_result;
+    bucket->refill_us = now_us;
 }
 
+// whether calls of a higher class than priority are waiting for a token - called with bucket_lock held
+static int bucket_ahead(struct tiki_bucket* bucket, int priority)
+{
+    int p;
+    for (p = 0; p < priority; p++) {
+        if (bucket->waiting[p] > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-// *********************************************************************
-// web page content date check function: looks for a specific 
-//  date in the content on a page and returns various status text e.g 
-//  'true' if the found date is more recent than the passed check date 
-//  or 'false' if not and various other error status results.
-// this version allows the date character length to be set 
-// curl code based upon https://curl.se/libcurl/c/getinmemory.html
-// *********************************************************************
-char* webpage_datetimecheck(int debug, const char* domain, const char* page, char* access_token, const char* infront_text, int datelen, const char* ref_datetime, const char* datetime_fmt)
+// wait for a token for a blocking call - returns CURLE_OK once it has one, or
+//  CURLE_ABORTED_BY_CALLBACK if the call was cancelled while it waited
+static CURLcode bucket_take(struct tiki_bucket* bucket, int priority, struct tiki_cancel* cancel)
+{
+    CURLcode res = CURLE_OK;
+    if (bucket == NULL || !__atomic_load_n(&bucket->limited, __ATOMIC_ACQUIRE)) {
+        return res;
+    }
+    pthread_mutex_lock(&bucket_lock);
+    bucket->waiting[priority]++;
+    while (bucket->limited) {
+        bucket_refill(bucket, bucket_now_us());
+        long long wait_us = TIKI_BUCKET_WAITMS * 1000;
+        if (!bucket_ahead(bucket, priority)) {
+            if (bucket->tokens >= 1) {
+                bucket->tokens -= 1;
+                break;
+            }
+            long long next_us = (long long)((1 - bucket->tokens) * 1000000.0 / bucket->rate) + 1;
+            if (next_us < wait_us) {
+                wait_us = next_us;
+            }
+        }
+        if (cancel != NULL && __atomic_load_n(&cancel->cancelled, __ATOMIC_ACQUIRE)) {
+            res = CURLE_ABORTED_BY_CALLBACK;
+            break;
+        }
+        /* a condition variable waits against the real-time clock - a clock change just ends one short wait early or late */
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += (wait_us % 1000000) * 1000;
+        until.tv_sec += wait_us / 1000000 + until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&bucket_wake, &bucket_lock, &until);
+    }
+    bucket->waiting[priority]--;
+    pthread_mutex_unlock(&bucket_lock);
+    /* the calls of lower classes that were held back behind this one can now go */
+    pthread_cond_broadcast(&bucket_wake);
+    return res;
+}
+
+// take a token for a tiki_multi operation without waiting - returns 0 if it
+//  has one, or the ms until the next one is due
+static long bucket_trytake(struct tiki_bucket* bucket, int priority)
+{
+    long wait_ms = 0;
+    if (bucket == NULL || !__atomic_load_n(&bucket->limited, __ATOMIC_ACQUIRE)) {
+        return wait_ms;
+    }
+    pthread_mutex_lock(&bucket_lock);
+    if (bucket->limited) {
+        bucket_refill(bucket, bucket_now_us());
+        if (bucket_ahead(bucket, priority)) {
+            /* blocking calls of a higher class are waiting, and go first */
+            wait_ms = TIKI_YIELD_SLICEMS;
+        } else if (bucket->tokens >= 1) {
+            bucket->tokens -= 1;
+        } else {
+            wait_ms = (long)((1 - bucket->tokens) * 1000.0 / bucket->rate) + 1;
+        }
+    }
+    pthread_mutex_unlock(&bucket_lock);
+    return wait_ms;
+}
+
+
+// ***************************************************************************
+// set the rate limit of a domain: it applies straight away to every session
+//  (including those that already exist) and every tiki_multi, tiki_batch and
+//  tiki_outbox calling it, so it can be lowered e.g. when the site is busy
+// ***************************************************************************
+int tiki_setratelimit(const char* domain, double per_second, int burst)
+{
+    // domain: the main URL text exactly as given to the other functions
+    // per_second: the calls allowed each second on average - 0 (the default) for no limit
+    // burst: the calls allowed straight after each other once the domain has been left alone for a while - at least 1
+    // returns 0 if the limit is set, or -1 if too many domains have been used to give this one a limit
+
+    struct tiki_bucket *bucket = bucket_find(domain);
+    if (bucket == NULL) {
+        TIKI_ERROR("tiki_setratelimit() failed: too many domains for %s to have a rate limit\n", domain);
+        return -1;
+    }
+    pthread_mutex_lock(&bucket_lock);
+    bucket->rate = (per_second > 0) ? per_second : 0;
+    bucket->burst = (burst > 1) ? burst : 1;
+    bucket->tokens = bucket->burst;
+    bucket->refill_us = bucket_now_us();
+    __atomic_store_n(&bucket->limited, (per_second > 0), __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&bucket_lock);
+    /* calls already waiting go again with the new limit (or none) */
+    pthread_cond_broadcast(&bucket_wake);
+    return 0;
+}
+
+
+// ***************************************************************************
+// persistent session functions: a tiki_session owns one long-lived curl easy
+//  handle plus the cached request header lists so that a hub making many
+//  API calls re-uses the same keep-alive (HTTPS) connection to the Tiki site
+//  rather than doing a new TCP connection and TLS handshake on every call
+// ***************************************************************************
+tiki_session* tiki_session_create(int debug, const char* domain, char* access_token)
 {
     // debug: if set to 1 this produces (lots!!) of additional output
     // domain: string used for the main URL text that must include https:// but no trailing /
-    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
     // access_token: the API access token that enables specific permissions for the API usage
-    // infront_text: text string that is a marker on the web page that proceeds the date and can be 'looked for' in the web page content
-    // datelen: is the character length of the date text
-    // ref_datetime: is a string of the integer linux time that is being checked against
-    // datetime_fmt: is the expected format of the date text in the web page content e.g. "%a %b %d, %Y %H:%M:%S %Z"
-    // check_result_text is returned as a string to indicate the result
+    // returns a pointer to the new session or NULL if it could not be created
+    // a session must only be used by one thread at a time - threads making calls at the same time each use their own
 
-    char *check_result_text = "";
-    struct tm reftm ;
-    memset(&reftm, 0, sizeof(struct tm));     // make sure the struct is initialised otherwise you get crazy numbers
-    //strptime(ref_datetime, "%d-%m-%Y %H:%M", &reftm);  // example 27-12-2021 11:05
-    strptime(ref_datetime, datetime_fmt, &reftm);        // assumes the ref_datetime uses the format datetime_fmt
-    time_t reftime = 0;
-    reftime = mktime(&reftm);
-    
-	if (debug==1)
-    {
-       printf ("\n *** debug from webpage_datetimecheck ...\n");
-       printf ("domain name is: %s\n", domain);
-       printf ("page name is: %s\n", page);
-       printf ("text in front of date is: %s\n", infront_text);
-       printf ("date to be checked is: %s\n", ref_datetime);
-       printf("reference date/time structure details ...\n");
-       printf("tm_hour:  %d\n",reftm.tm_hour);
-       printf("tm_min:  %d\n",reftm.tm_min);
-       printf("tm_sec:  %d\n",reftm.tm_sec);
-       printf("tm_mday:  %d\n",reftm.tm_mday);
-       printf("tm_mon:  %d\n",reftm.tm_mon+1);        // add 1 for display since month is zero based
-       printf("tm_year:  %d\n",reftm.tm_year+1900);   // add 1900 as year is the number of years since 1900
-       printf("tm_wday:  %d\n",reftm.tm_wday);        // days since Sunday - [0-6]
-       printf ("ref_datetime as epoch integer: %ld\n", reftime);
-       printf ("datelen parameter: %d\n", datelen);
+    tiki_session *session = calloc(1, sizeof(tiki_session));
+    if (session == NULL) {
+        TIKI_ERROR("tiki_session_create() failed: not enough memory\n");
+        return NULL;
+    }
+    if (strlen(domain) >= sizeof(session->domain)) {
+        TIKI_ERROR("tiki_session_create() failed: domain text is too long\n");
+        free(session);
+        return NULL;
+    }
+    strcpy(session->domain, domain);
+
+    /* init the one curl session that is re-used for every request */
+    session->curl_handle = share_easy_init();
+    if (session->curl_handle == NULL) {
+        TIKI_ERROR("tiki_session_create() failed: curl_easy_init returned NULL\n");
+        free(session);
+        return NULL;
     }
 
-    // build the full wiki API URL
-    char wiki_api[15] = "/api/wiki/page";
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, wiki_api);
-	strcat(API_URL, page);
-	if (debug==1)
-    {
-       printf ("\n *** debug from webpage_datetimecheck ...\n");
-       printf ("API URL is: %s\n", API_URL);
-	}
+    // build the custom header lists once - they are the same for every request of each type
+    // headers for the web page and other plain GET requests
+    session->jsonchunk = curl_slist_append(session->jsonchunk, "accept: application/json");
+    session->jsonchunk = curl_slist_append(session->jsonchunk, access_token);
+    // headers for the tracker POST requests that send urlencoded field data
+    session->formchunk = curl_slist_append(session->formchunk, "accept: application/json");
+    session->formchunk = curl_slist_append(session->formchunk, "Content-Type: application/x-www-form-urlencoded");
+    session->formchunk = curl_slist_append(session->formchunk, access_token);
+    // headers for the File gallery POST requests that send multipart/form-data
+    session->mimechunk = curl_slist_append(session->mimechunk, "Content-Type: multipart/form-data");
+    session->mimechunk = curl_slist_append(session->mimechunk, access_token);
+    // headers for tracker POST requests whose urlencoded field data is sent gzip compressed
+    session->gzipchunk = curl_slist_append(session->gzipchunk, "accept: application/json");
+    session->gzipchunk = curl_slist_append(session->gzipchunk, "Content-Type: application/x-www-form-urlencoded");
+    session->gzipchunk = curl_slist_append(session->gzipchunk, "Content-Encoding: gzip");
+    session->gzipchunk = curl_slist_append(session->gzipchunk, access_token);
+    session->compress = __atomic_load_n(&compress_accept, __ATOMIC_RELAXED);
+    session->compress_min = __atomic_load_n(&compress_postmin, __ATOMIC_RELAXED);
+    session->connect_ms = __atomic_load_n(&timeout_connect, __ATOMIC_RELAXED);
+    session->deadline_ms = __atomic_load_n(&timeout_deadline, __ATOMIC_RELAXED);
+    session->stall_ms = __atomic_load_n(&timeout_stall, __ATOMIC_RELAXED);
+    session->breaker = breaker_find(session->domain);
+    session->bucket = bucket_find(session->domain);
+    session->priority = TIKI_PRIORITY_BYCALL;
+
+    TIKI_DEBUG(debug, "\n *** debug from tiki_session_create ...\n");
+    TIKI_DEBUG(debug, "session created for domain: %s\n", session->domain);
+    return session;
+}
 
-    // GET the content of the web page
-    CURL *curl_handle;
-    CURLcode res;
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;    /* no data at this point */
- 
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-    /* specify URL to get */
+
+// ***************************************************************************
+// close a persistent session: closes the kept-alive connection, frees the
+//  cached header lists and the session itself
+// ***************************************************************************
+void tiki_session_destroy(tiki_session* session)
+{
+    // session: the session created by tiki_session_create - NULL is ignored
+
+    if (session == NULL) {
+        return;
+    }
+    /* cleanup curl stuff */
+    curl_easy_cleanup(session->curl_handle);
+    curl_slist_free_all(session->jsonchunk);
+    curl_slist_free_all(session->formchunk);
+    curl_slist_free_all(session->mimechunk);
+    curl_slist_free_all(session->gzipchunk);
+    free(session->postgz);
+    free(session->arena);
+    tiki_session_setcache(session, 0, 0, NULL);
+    tiki_session_setdedup(session, NULL);
+    free(session);
+}
+
+
+// ***************************************************************************
+// pre-warm the shared caches at start up: HEAD requests to the Tiki site are
+//  run at the same time, one per connection wanted, so the DNS lookup is
+//  cached and each full TLS handshake leaves a TLS session that the first
+//  connections of the sessions and tiki_multis then resume - the connections
+//  themselves are closed again, as they cannot be handed to other handles
+// ***************************************************************************
+int tiki_prewarm(int debug, const char* domain, int connections)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // connections: how many connections to warm up for, e.g. the max_inflight of a tiki_multi or tiki_batch - at most TIKI_PREWARM_MAX
+    //  (a TLS 1.3 session ticket is used only once, so each connection opened at the same time later needs its own)
+    // returns the number of HEAD requests that succeeded, so the number of TLS sessions that are cached
+
+    char API_URL[104];
+    CURL *handles[TIKI_PREWARM_MAX];
+    int i;
+    int running;
+    int queued;
+    int ready = 0;
+    CURLMsg *msg;
+
+    if (strlen(domain) >= sizeof(API_URL) - 1) {
+        TIKI_ERROR("tiki_prewarm() failed: domain text is too long\n");
+        return 0;
+    }
+    snprintf(API_URL, sizeof(API_URL), "%s/", domain);
+    if (connections < 1) {
+        connections = 1;
+    } else if (connections > TIKI_PREWARM_MAX) {
+        connections = TIKI_PREWARM_MAX;
+    }
+    pthread_once(&library_once, library_init);
+    if (share_handle == NULL) {
+        // the DNS entries and TLS sessions would be dropped again with their handles, so there is nothing to warm
+        return 0;
+    }
+
+    CURLM *multi_handle = curl_multi_init();
+    if (multi_handle == NULL) {
+        TIKI_ERROR("tiki_prewarm() failed: curl_multi_init returned NULL\n");
+        return 0;
+    }
+    // the time limits that new sessions start with - so an unreachable site holds up the start for no longer than a call would
+    long connect_ms = __atomic_load_n(&timeout_connect, __ATOMIC_RELAXED);
+    long deadline_ms = __atomic_load_n(&timeout_deadline, __ATOMIC_RELAXED);
+    long stall_ms = __atomic_load_n(&timeout_stall, __ATOMIC_RELAXED);
+    for (i = 0; i < connections; i++) {
+        handles[i] = share_easy_init();
+        if (handles[i] == NULL) {
+            break;
+        }
+        curl_easy_setopt(handles[i], CURLOPT_URL, API_URL);
+        curl_easy_setopt(handles[i], CURLOPT_USERAGENT, "libcurl-agent/1.0");
+        curl_easy_setopt(handles[i], CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(handles[i], CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(handles[i], CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(handles[i], CURLOPT_CONNECTTIMEOUT_MS, connect_ms);
+        curl_easy_setopt(handles[i], CURLOPT_TIMEOUT_MS, deadline_ms);
+        if (stall_ms > 0) {
+            curl_easy_setopt(handles[i], CURLOPT_LOW_SPEED_LIMIT, 1L);
+            curl_easy_setopt(handles[i], CURLOPT_LOW_SPEED_TIME, (stall_ms + 999) / 1000);
+        }
+        curl_multi_add_handle(multi_handle, handles[i]);
+    }
+    connections = i;
+
+    do {
+        curl_multi_perform(multi_handle, &running);
+        if (running) {
+            curl_multi_poll(multi_handle, NULL, 0, 1000, NULL);
+        }
+    } while (running);
+
+    while ((msg = curl_multi_info_read(multi_handle, &queued)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        if (msg->data.result == CURLE_OK) {
+            ready++;
+        } else {
+            TIKI_DEBUG(debug, "tiki_prewarm: connection to %s failed: %s\n", domain, curl_easy_strerror(msg->data.result));
+        }
+    }
+    for (i = 0; i < connections; i++) {
+        curl_multi_remove_handle(multi_handle, handles[i]);
+        curl_easy_cleanup(handles[i]);
+    }
+    curl_multi_cleanup(multi_handle);
+
+    TIKI_DEBUG(debug, "\n *** debug from tiki_prewarm ...\n");
+    TIKI_DEBUG(debug, "%d of %d TLS sessions with %s are cached\n", ready, connections, domain);
+    return ready;
+}
+
+
+// ***************************************************************************
+// prepare the session's curl handle for the next request: the options left
+//  over from the previous request are cleared, but curl_easy_reset keeps the
+//  handle's kept-alive connection and the shared DNS and TLS session caches
+// ***************************************************************************
+static CURL* session_request(tiki_session* session, const char* API_URL, struct curl_slist *headchunk)
+{
+    CURL *curl_handle = session->curl_handle;
+    curl_easy_reset(curl_handle);
+    /* specify URL to use */
     curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
-    /* send all data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
     /* some servers do not like requests that are made without a user-agent field, so we provide one */
     curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
-
-    // set the custom headers 
-    struct curl_slist *headchunk = NULL;
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the authorization header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
+    /* keep the idle connection alive between the hub's (possibly infrequent) API calls */
+    curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    /* other threads may be making calls too, so curl must not use signals (e.g. for DNS time outs) */
+    curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
+    // set the cached custom headers
     curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
+    /* an empty string offers every encoding this curl was built to decode */
+    if (session->compress) {
+        curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+    }
+    return curl_handle;
+}
 
-    /* get it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-         fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-         check_result_text = copyString("curl access to the Tiki site for web page date-time check failed");
-    } else if (memchunk.size == 0) {
-        printf("the curl request may have been processed BUT there was no response from the server API\n");
-        check_result_text = copyString("no response from the curl request sent to the server API");
-    } else {
-         /*
-         * Now, our memchunk.memory points to a memory block that is memchunk.size
-         * bytes big and contains the web page content.
-         *
-         * the date check code below gets the date from the web page content and checks it against ref_datetime
-         */
-	     if (debug==1)
-         { 
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full wiki page text is: %s\n", memchunk.memory);
-         }
-         char *found;
-         found = strstr(memchunk.memory, infront_text);        // found should now be the whole string from infront_text onwards
-	     if (debug==1)
-         { 
-             printf("the full text from infront_text onwards is: %s\n", found);
-         }
 
-         if ( found != NULL )  {  // infront_text string found!
-             int offset = datelen + strlen(infront_text);
-             removeString(found, offset, strlen(memchunk.memory)); // strip away all the back end text after the datelen + infront_text characters
-	         if (debug==1)
-             {
-                 printf ("1st cropped found text is: %s\n", found);
-             }
-             int infront = strlen(infront_text) + 1;    // add 1 to take away an assumed space in front of the datetime text
-             removeString(found, 0, infront);   // strip away the first infront_text + 1 characters for just the date/time string
-	         if (debug==1)
-             {
-                 printf ("2nd cropped found text is: %s\n", found);
-             }
-             // now convert to epoch time and compare
-
-             struct tm foundtm ;
-             memset(&foundtm, 0, sizeof(struct tm));     // make sure the struct is initialised otherwise you get crazy numbers
-             strptime(found, datetime_fmt, &foundtm);    // datetime_fmt is passed as a parameter, example "%a %b %d, %Y %H:%M:%S %Z"
-             time_t foundtime = 0;
-             foundtime = mktime(&foundtm);
-             if (foundtm.tm_gmtoff!=0)
-             {
-                 foundtime = foundtime - foundtm.tm_gmtoff;
-             }
-	         if (debug==1)
-             {
-                 printf("found date/time structure details ...\n");
-                 printf("tm_hour:  %d\n",foundtm.tm_hour);
-                 printf("tm_min:  %d\n",foundtm.tm_min);
-                 printf("tm_sec:  %d\n",foundtm.tm_sec);
-                 printf("tm_mday:  %d\n",foundtm.tm_mday);
-                 printf("tm_mon:  %d\n",foundtm.tm_mon+1);        // add 1 for display since month is zero based
-                 printf("tm_year:  %d\n",foundtm.tm_year+1900);   // add 1900 as year is the number of years since 1900
-                 printf("tm_wday:  %d\n",foundtm.tm_wday);        // days since Sunday - [0-6]
-                 printf("tm_gmtoff:  %d\n",foundtm.tm_gmtoff);    // %Z offset in seconds
-                 printf ("found date/time as epoch integer: %ld\n", foundtime);
-             }
-             // now compare found vs ref times
-             if (foundtime > reftime) {
-                 check_result_text = copyString("true");
-                 if (debug==1) {
-                    printf("found time is newer, returning: %s\n", check_result_text);
-                 }
-             } else {
-                 check_result_text = copyString("false");
-	             if (debug==1) {
-                    printf("found time is older, returning: %s\n", check_result_text);
-                 }
-             }
-         } else {
-             check_result_text = copyString("not found");
-	         if (debug==1)
-             {
-                 printf ("\n*** infront_text not found!! ***, returning: %s\n", check_result_text);
-                 printf ("\n\n");
-                 printf ("full original web page text is: %s\n", memchunk.memory);
-             }
-         }
+// ***************************************************************************
+// time limits for every call: connect_ms for the DNS lookup, TCP connect and
+//  TLS handshake, deadline_ms for the whole call, and stall_ms for a transfer
+//  that has stopped moving - so a slow Tiki site can delay the hub but never
+//  block it, and a large file that is still moving is not cut off part way
+// ***************************************************************************
+void tiki_settimeouts(long connect_ms, long deadline_ms, long stall_ms)
+{
+    // connect_ms: ms allowed to get connected - 0 uses curl's own limit of 300 seconds (the default is 10 seconds)
+    // deadline_ms: ms allowed for each whole call - 0 (the default) for no limit
+    // stall_ms: a call is given up after this many ms of less than 1 byte/s - 0 never gives up (the default is 30 seconds)
+    //           - curl averages the speed over the last few seconds, so a stall can take a little longer to be noticed
+    // sessions created from now on (including those made by the one-shot functions, tiki_multi, tiki_batch
+    //  and tiki_outbox) use these limits - sessions that already exist keep the ones they were created with
+
+    __atomic_store_n(&timeout_connect, connect_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&timeout_deadline, deadline_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&timeout_stall, stall_ms, __ATOMIC_RELAXED);
+}
+
+void tiki_session_settimeouts(tiki_session* session, long connect_ms, long deadline_ms, long stall_ms)
+{
+    // session: the session created by tiki_session_create, whose limits from tiki_settimeouts are replaced
+    // connect_ms, deadline_ms and stall_ms are used exactly as for tiki_settimeouts - e.g. a hub can give
+    //  each call the time left before its next reading is due
+
+    session->connect_ms = connect_ms;
+    session->deadline_ms = deadline_ms;
+    session->stall_ms = stall_ms;
+}
+
+
+// ***************************************************************************
+// cancel handles: one can be set on any number of sessions (and tiki_multi
+//  engines), and triggering it from another thread - e.g. on a shutdown
+//  signal or when a reading has become too old to be worth sending - stops
+//  all their calls until it is reset
+// ***************************************************************************
+tiki_cancel* tiki_cancel_create(void)
+{
+    // returns a pointer to the new, untriggered, cancel handle or NULL if there is not enough memory
+    return calloc(1, sizeof(tiki_cancel));
+}
+
+void tiki_cancel_trigger(tiki_cancel* cancel)
+{
+    // may be called from any thread - in-flight transfers are aborted within about a second, and the
+    //  calls fail with the same result text as when the Tiki site can not be reached
+    __atomic_store_n(&cancel->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+void tiki_cancel_reset(tiki_cancel* cancel)
+{
+    __atomic_store_n(&cancel->cancelled, 0, __ATOMIC_RELEASE);
+}
+
+void tiki_cancel_destroy(tiki_cancel* cancel)
+{
+    // cancel: must no longer be set on any session or tiki_multi
+    free(cancel);
+}
+
+void tiki_session_setcancel(tiki_session* session, tiki_cancel* cancel)
+{
+    // cancel: the cancel handle the session's calls are stopped by, or NULL for none
+    session->cancel = cancel;
+}
+
+static int RequestProgressCallback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    tiki_session *session = (tiki_session *)clientp;
+    int cancelled = (session->cancel != NULL && __atomic_load_n(&session->cancel->cancelled, __ATOMIC_ACQUIRE));
+    /* a bulk call stands aside - sending and reading nothing, so the site and the hub's uplink are left to
+       the urgent call - while an urgent call to its domain is in flight, and carries on where it left off */
+    int waited = 0;
+    while (session->yielding && !cancelled && waited < TIKI_YIELD_MAXMS && __atomic_load_n(&session->bucket->urgent, __ATOMIC_ACQUIRE) > 0) {
+        struct timespec pause = { 0, TIKI_YIELD_SLICEMS * 1000000L };
+        nanosleep(&pause, NULL);
+        waited += TIKI_YIELD_SLICEMS;
+        cancelled = (session->cancel != NULL && __atomic_load_n(&session->cancel->cancelled, __ATOMIC_ACQUIRE));
     }
- 
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-    free(memchunk.memory);
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
+    /* anything but 0 makes curl abort the transfer with CURLE_ABORTED_BY_CALLBACK */
+    return cancelled;
+}
 
-	return check_result_text;
 
+// ***************************************************************************
+// set the session's time limits and cancel handle on a curl handle - just
+//  before the transfer, as some calls turn the progress callbacks off
+// ***************************************************************************
+static void request_limits(tiki_session* session, CURL* curl_handle)
+{
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT_MS, session->connect_ms);
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, session->deadline_ms);
+    if (session->stall_ms > 0) {
+        curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, (session->stall_ms + 999) / 1000);
+    }
+    if (session->cancel != NULL || session->yielding) {
+        curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION, RequestProgressCallback);
+        curl_easy_setopt(curl_handle, CURLOPT_XFERINFODATA, (void *)session);
+        curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 0L);
+    }
 }
 
-// ***************************************************************************************
-// the function below was taken 'as is' from https://curl.se/libcurl/c/getinmemory.html
-//  for use in various other functions above and below
-// ***************************************************************************************
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
+
+// ***************************************************************************
+// whether a call may go ahead: it fails fast if it has been cancelled or the
+//  circuit breaker of the session's domain is open
+// ***************************************************************************
+static CURLcode request_refused(tiki_session* session)
 {
-  size_t realsize = size * nmemb;
-  struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-  char *ptr = realloc(mem->memory, mem->size + realsize + 1);
-  if(!ptr) {
-    /* out of memory! */
-    printf("not enough memory (realloc returned NULL)\n");
-    return 0;
-  }
-  mem->memory = ptr;
-  memcpy(&(mem->memory[mem->size]), contents, realsize);
-  mem->size += realsize;
-  mem->memory[mem->size] = 0;
-  return realsize;
+    // returns CURLE_OK if the call can be made, or the result code it fails with
+    if (session->cancel != NULL && __atomic_load_n(&session->cancel->cancelled, __ATOMIC_ACQUIRE)) {
+        return CURLE_ABORTED_BY_CALLBACK;
+    }
+    if (session->breaker != NULL && __atomic_load_n(&session->breaker->open, __ATOMIC_ACQUIRE)) {
+        return CURLE_COULDNT_CONNECT;
+    }
+    return CURLE_OK;
 }
 
 
-// ***************************************************************************************
-// the function below was taken 'as is' from https://curl.se/libcurl/c/sepheaders.html
-//  for use in various File gallery functions below
-// ***************************************************************************************
-static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream)
+// ***************************************************************************
+// opt-in compression for metered (e.g. cellular) hubs: responses are asked
+//  for compressed and decompressed by curl as they arrive, before they reach
+//  the write callbacks, and large tracker post data (e.g. TextArea fields or
+//  logs) is sent gzip compressed - which the Tiki site's web server must be
+//  set up to accept, e.g. with Apache's mod_deflate as an input filter
+// ***************************************************************************
+void tiki_setcompression(int accept, size_t post_min)
 {
-  size_t written = fwrite(ptr, size, nmemb, (FILE *)stream);
-  return written;
+    // accept: if set, sessions created from now on (including those made by the one-shot functions,
+    //         tiki_multi, tiki_batch and tiki_outbox) ask for compressed responses
+    // post_min: tracker post data of at least this many bytes is sent gzip compressed - 0 (the default) never compresses it
+    // sessions that already exist keep the settings they were created with
+
+    __atomic_store_n(&compress_accept, accept, __ATOMIC_RELAXED);
+    __atomic_store_n(&compress_postmin, post_min, __ATOMIC_RELAXED);
+}
+
+void tiki_session_setcompression(tiki_session* session, int accept, size_t post_min)
+{
+    // session: the session created by tiki_session_create, whose settings from tiki_setcompression are replaced
+    // accept and post_min are used exactly as for tiki_setcompression
+
+    session->compress = accept;
+    session->compress_min = post_min;
+}
+
+
+// ***************************************************************************
+// the request and response body bytes of every session since the program
+//  started: as they went over the wire, and as they would have been without
+//  compression - so the saving is e.g. *received_plain - *received
+// ***************************************************************************
+void tiki_wirestats(long long* sent, long long* sent_plain, long long* received, long long* received_plain)
+{
+    *sent = __atomic_load_n(&wire_sent, __ATOMIC_RELAXED);
+    *sent_plain = __atomic_load_n(&plain_sent, __ATOMIC_RELAXED);
+    *received = __atomic_load_n(&wire_received, __ATOMIC_RELAXED);
+    *received_plain = __atomic_load_n(&plain_received, __ATOMIC_RELAXED);
+}
+
+
+
+// ***************************************************************************
+// per-call latency histograms: every transfer is timed with curl's own
+//  CURLINFO timings, split into the time spent on the DNS lookup, the TCP
+//  connect, the TLS handshake, the server (from the connection being ready
+//  to the first response byte) and the transfer of the response
+// ***************************************************************************
+static const char *const stats_calls[TIKI_STATS_CALLS] = { "webpage", "itempost", "itemupdate", "itemget", "filedownload", "fileupload", "fileupdate" };
+static const char *const stats_phases[TIKI_STATS_PHASES] = { "dns", "connect", "tls", "server", "transfer", "total" };
+static const char *const stats_priorities[TIKI_PRIORITIES] = { "urgent", "normal", "bulk" };
+
+static struct stats_thread *stats_threads = NULL;      // every block, newest first - blocks are never freed
+static __thread struct stats_thread *stats_mine = NULL;
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static void stats_release(void *block)
+{
+    /* the thread has ended - its counts stay in the block for the next new thread to add to */
+    __atomic_store_n(&((struct stats_thread *)block)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void stats_init(void)
+{
+    pthread_key_create(&stats_key, stats_release);
+}
+
+static struct stats_thread* stats_thread(void)
+{
+    if (stats_mine != NULL) {
+        return stats_mine;
+    }
+    pthread_once(&stats_once, stats_init);
+    struct stats_thread *block;
+    for (block = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        int unowned = 0;
+        if (__atomic_compare_exchange_n(&block->owned, &unowned, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (block == NULL) {
+        block = calloc(1, sizeof(struct stats_thread));
+        if (block == NULL) {
+            return NULL;
+        }
+        block->owned = 1;
+        block->next = __atomic_load_n(&stats_threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_threads, &block->next, block, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    pthread_setspecific(stats_key, block);
+    stats_mine = block;
+    return block;
+}
+
+static int stats_bucket(uint64_t us)
+{
+    if (us < 16) {
+        return (int)us;
+    }
+    int e = 63 - __builtin_clzll(us);     /* us is 2^e up to 2^(e+1) - 1 */
+    if (e > 31) {
+        return TIKI_STATS_BUCKETS - 1;
+    }
+    return 16 + (e - 4) * 8 + (int)((us >> (e - 3)) & 7);
+}
+
+static uint64_t stats_bucketlow(int bucket)
+{
+    /* the smallest value counted in a bucket - the next bucket's is just beyond its largest */
+    if (bucket < 16) {
+        return (uint64_t)bucket;
+    }
+    int e = 4 + (bucket - 16) / 8;
+    return (uint64_t)(8 + (bucket - 16) % 8) << (e - 3);
+}
+
+/* only the owning thread writes its block, so an add is a relaxed load and store rather than a locked add */
+#define STATS_ADD(field, value)  __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+static void stats_record(int call, CURL *curl_handle, curl_off_t sent, curl_off_t received)
+{
+    struct stats_thread *block = stats_thread();
+    if (block == NULL) {
+        return;
+    }
+    curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+    curl_easy_getinfo(curl_handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl_handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(curl_handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total);
+    /* the timings are each from the start of the transfer, and are 0 for the steps a re-used connection skips */
+    curl_off_t ready = (appconnect > connect) ? appconnect : connect;
+    curl_off_t phases[TIKI_STATS_PHASES];
+    phases[0] = namelookup;
+    phases[1] = connect - namelookup;
+    phases[2] = (appconnect > 0) ? appconnect - connect : 0;
+    phases[3] = (starttransfer > 0) ? starttransfer - ready : 0;     /* no response at all leaves starttransfer at 0 */
+    phases[4] = (starttransfer > 0) ? total - starttransfer : 0;
+    phases[5] = total;
+    int i;
+    for (i = 0; i < TIKI_STATS_PHASES; i++) {
+        uint64_t us = (phases[i] > 0) ? (uint64_t)phases[i] : 0;
+        struct stats_histogram *histogram = &block->phases[call][i];
+        STATS_ADD(histogram->counts[stats_bucket(us)], 1);
+        STATS_ADD(histogram->count, 1);
+        STATS_ADD(histogram->sum_us, us);
+    }
+    STATS_ADD(block->sent[call], (uint64_t)sent);
+    STATS_ADD(block->received[call], (uint64_t)received);
+}
+
+static void stats_queued(int priority, long long us)
+{
+    // us: how long a call of the priority class waited for the rate limit (or in a tiki_multi's queue) before it was sent
+    struct stats_thread *block = stats_thread();
+    if (block == NULL) {
+        return;
+    }
+    uint64_t wait = (us > 0) ? (uint64_t)us : 0;
+    struct stats_histogram *histogram = &block->queue[priority];
+    STATS_ADD(histogram->counts[stats_bucket(wait)], 1);
+    STATS_ADD(histogram->count, 1);
+    STATS_ADD(histogram->sum_us, wait);
+}
+
+
+// ***************************************************************************
+// account for a completed transfer: its bytes on the wire (and saved by
+//  compression) and its timings for the latency histograms
+// ***************************************************************************
+static void transfer_account(CURL *curl_handle, int call, long long sentplain, long long receivedplain)
+{
+    // call: which API call the transfer was made for - one of the TIKI_CALL_ values
+    // sentplain, receivedplain: the body sizes before compression, or -1 if they were not compressed
+    curl_off_t sent = 0;
+    curl_off_t received = 0;
+    curl_off_t total = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total);
+    if (total == 0) {
+        /* a call that was refused (see request_refused) never started a transfer */
+        return;
+    }
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD_T, &sent);
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    /* counted with atomics as the outbox sends from its own thread */
+    __atomic_fetch_add(&wire_sent, (long long)sent, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&plain_sent, (sentplain >= 0) ? sentplain : (long long)sent, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&wire_received, (long long)received, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&plain_received, (receivedplain >= 0) ? receivedplain : (long long)received, __ATOMIC_RELAXED);
+    stats_record(call, curl_handle, sent, received);
+}
+
+
+// ***************************************************************************
+// add up the latency histograms of every thread for one call, or all calls
+//  if call is -1 - returns the number of calls counted
+// ***************************************************************************
+static uint64_t stats_collect(int call, int phase, struct stats_histogram *sum, uint64_t *sent, uint64_t *received)
+{
+    memset(sum, 0, sizeof(struct stats_histogram));
+    *sent = 0;
+    *received = 0;
+    struct stats_thread *block;
+    int c, b;
+    for (block = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        for (c = 0; c < TIKI_STATS_CALLS; c++) {
+            if (call >= 0 && c != call) {
+                continue;
+            }
+            struct stats_histogram *histogram = &block->phases[c][phase];
+            for (b = 0; b < TIKI_STATS_BUCKETS; b++) {
+                sum->counts[b] += __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+            }
+            sum->count += __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+            sum->sum_us += __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED);
+            *sent += __atomic_load_n(&block->sent[c], __ATOMIC_RELAXED);
+            *received += __atomic_load_n(&block->received[c], __ATOMIC_RELAXED);
+        }
+    }
+    return sum->count;
+}
+
+static uint64_t stats_collectqueue(int priority, struct stats_histogram *sum)
+{
+    // as stats_collect, for the queue waits of one priority class or all of them if priority is -1
+    memset(sum, 0, sizeof(struct stats_histogram));
+    struct stats_thread *block;
+    int p, b;
+    for (block = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        for (p = 0; p < TIKI_PRIORITIES; p++) {
+            if (priority >= 0 && p != priority) {
+                continue;
+            }
+            struct stats_histogram *histogram = &block->queue[p];
+            for (b = 0; b < TIKI_STATS_BUCKETS; b++) {
+                sum->counts[b] += __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+            }
+            sum->count += __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+            sum->sum_us += __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED);
+        }
+    }
+    return sum->count;
+}
+
+static uint64_t stats_quantile(struct stats_histogram *sum, double quantile, double *seconds)
+{
+    // seconds: set to the time within which the quantile of the histogram's values fell, which is the middle
+    //  of the histogram bucket it falls in
+    // returns the number of values counted
+    /* the histograms are read while other threads may still be adding to them, so count from the buckets themselves */
+    uint64_t total = 0;
+    int b;
+    for (b = 0; b < TIKI_STATS_BUCKETS; b++) {
+        total += sum->counts[b];
+    }
+    uint64_t rank = (quantile <= 0) ? 1 : (quantile >= 1) ? total : (uint64_t)(quantile * total + 0.999999);
+    uint64_t seen = 0;
+    for (b = 0; b < TIKI_STATS_BUCKETS - 1; b++) {
+        seen += sum->counts[b];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    uint64_t low = stats_bucketlow(b);
+    uint64_t high = (b < TIKI_STATS_BUCKETS - 1) ? stats_bucketlow(b + 1) - 1 : low;
+    *seconds = (low + high) / 2.0 / 1000000.0;
+    return total;
+}
+
+static int stats_name(const char *const names[], int nnames, const char *name)
+{
+    // returns the index of name in names, -1 for NULL or "" (meaning all of them) or -2 if it is not known
+    int i;
+    if (name == NULL || name[0] == 0) {
+        return -1;
+    }
+    for (i = 0; i < nnames; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -2;
+}
+
+
+// ***************************************************************************
+// query the latency histograms: the time within which the given fraction of
+//  calls completed a phase, e.g. quantile 0.99 for the 99th percentile
+// ***************************************************************************
+long long tiki_stats_latency(const char* call, const char* phase, double quantile, double* seconds)
+{
+    // call: "webpage", "itempost", "itemupdate", "itemget", "filedownload", "fileupload", "fileupdate" or NULL/"" for all of them
+    // phase: "dns", "connect", "tls", "server" (the connection being ready until the first response byte),
+    //        "transfer" (the rest of the response) or "total"
+    // quantile: 0.0 to 1.0 - 0.5 is the median
+    // seconds: set to the time, which is the middle of the histogram bucket it falls in, or 0 if there are no calls
+    // returns the number of calls counted, or -1 if call or phase is not known
+
+    int c = stats_name(stats_calls, TIKI_STATS_CALLS, call);
+    int p = stats_name(stats_phases, TIKI_STATS_PHASES, phase);
+    *seconds = 0;
+    if (c == -2 || p < 0) {
+        return -1;
+    }
+    struct stats_histogram sum;
+    uint64_t sent, received;
+    if (stats_collect(c, p, &sum, &sent, &received) == 0) {
+        return 0;
+    }
+    return (long long)stats_quantile(&sum, quantile, seconds);
+}
+
+long long tiki_stats_bytes(const char* call, long long* sent, long long* received)
+{
+    // call: as for tiki_stats_latency
+    // sent, received: set to the request and response body bytes of the calls as they went over the wire
+    // returns the number of calls counted, or -1 if call is not known
+
+    int c = stats_name(stats_calls, TIKI_STATS_CALLS, call);
+    *sent = 0;
+    *received = 0;
+    if (c == -2) {
+        return -1;
+    }
+    struct stats_histogram sum;
+    uint64_t bytesout, bytesin;
+    uint64_t count = stats_collect(c, TIKI_STATS_PHASES - 1, &sum, &bytesout, &bytesin);
+    *sent = (long long)bytesout;
+    *received = (long long)bytesin;
+    return (long long)count;
+}
+
+
+// ***************************************************************************
+// query the queue wait histograms: the time within which the given fraction
+//  of calls of a priority class were sent - from the call being made (or the
+//  tiki_multi operation submitted) until its request was started
+// ***************************************************************************
+long long tiki_stats_queuewait(const char* priority, double quantile, double* seconds)
+{
+    // priority: "urgent", "normal", "bulk" or NULL/"" for all of them
+    // quantile: 0.0 to 1.0 - 0.5 is the median
+    // seconds: set to the time, which is the middle of the histogram bucket it falls in, or 0 if there are no calls
+    // returns the number of calls counted, or -1 if priority is not known
+
+    int p = stats_name(stats_priorities, TIKI_PRIORITIES, priority);
+    *seconds = 0;
+    if (p == -2) {
+        return -1;
+    }
+    struct stats_histogram sum;
+    if (stats_collectqueue(p, &sum) == 0) {
+        return 0;
+    }
+    return (long long)stats_quantile(&sum, quantile, seconds);
+}
+
+
+// ***************************************************************************
+// write one histogram's lines in the Prometheus text format - labels are the
+//  histogram's own labels, e.g. call="itempost",phase="total"
+// ***************************************************************************
+static void stats_dumphistogram(FILE *fp, const char *name, const char *labels, struct stats_histogram *sum)
+{
+    /* the histogram buckets are reported at these times (in seconds) rather than all TIKI_STATS_BUCKETS of them */
+    static const double bounds[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60 };
+    int nbounds = sizeof(bounds) / sizeof(bounds[0]);
+    uint64_t cumulative = 0;
+    int i;
+    int b = 0;
+    for (i = 0; i < nbounds; i++) {
+        /* a bucket is counted once every value it holds is within the bound */
+        while (b < TIKI_STATS_BUCKETS - 1 && stats_bucketlow(b + 1) <= (uint64_t)(bounds[i] * 1000000.0) + 1) {
+            cumulative += sum->counts[b++];
+        }
+        fprintf(fp, "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels, bounds[i], (unsigned long long)cumulative);
+    }
+    for (cumulative = 0, b = 0; b < TIKI_STATS_BUCKETS; b++) {
+        cumulative += sum->counts[b];
+    }
+    fprintf(fp, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels, (unsigned long long)cumulative);
+    fprintf(fp, "%s_sum{%s} %.6f\n", name, labels, sum->sum_us / 1000000.0);
+    fprintf(fp, "%s_count{%s} %llu\n", name, labels, (unsigned long long)cumulative);
+}
+
+
+// ***************************************************************************
+// write the latency histograms and byte counts in the Prometheus text format,
+//  e.g. for node_exporter's textfile collector - the file is written under a
+//  temporary name and then renamed, so it is never read half written
+// ***************************************************************************
+int tiki_stats_dump(const char* filepath)
+{
+    // filepath: full path-name of the file to write, which should end .prom for the textfile collector
+    // returns 0 if the file was written or -1 if it could not be
+
+    char tempname[310];
+    snprintf(tempname, sizeof(tempname), "%s.tmp", filepath);
+    FILE *fp = fopen(tempname, "w");
+    if (fp == NULL) {
+        TIKI_ERROR("tiki_stats_dump() failed: %s could not be written\n", tempname);
+        return -1;
+    }
+    struct stats_histogram sum;
+    uint64_t sent[TIKI_STATS_CALLS], received[TIKI_STATS_CALLS];
+    char labels[64];
+    int c, p;
+    fprintf(fp, "# HELP tiki_api_phase_seconds Time Tiki API calls spent in each phase of their transfers.\n");
+    fprintf(fp, "# TYPE tiki_api_phase_seconds histogram\n");
+    for (c = 0; c < TIKI_STATS_CALLS; c++) {
+        for (p = 0; p < TIKI_STATS_PHASES; p++) {
+            if (stats_collect(c, p, &sum, &sent[c], &received[c]) == 0) {
+                continue;
+            }
+            snprintf(labels, sizeof(labels), "call=\"%s\",phase=\"%s\"", stats_calls[c], stats_phases[p]);
+            stats_dumphistogram(fp, "tiki_api_phase_seconds", labels, &sum);
+        }
+    }
+    fprintf(fp, "# HELP tiki_queue_wait_seconds Time Tiki API calls of each priority class waited before they were sent.\n");
+    fprintf(fp, "# TYPE tiki_queue_wait_seconds histogram\n");
+    for (p = 0; p < TIKI_PRIORITIES; p++) {
+        if (stats_collectqueue(p, &sum) == 0) {
+            continue;
+        }
+        snprintf(labels, sizeof(labels), "class=\"%s\"", stats_priorities[p]);
+        stats_dumphistogram(fp, "tiki_queue_wait_seconds", labels, &sum);
+    }
+    fprintf(fp, "# HELP tiki_api_sent_bytes_total Request body bytes sent by Tiki API calls.\n");
+    fprintf(fp, "# TYPE tiki_api_sent_bytes_total counter\n");
+    for (c = 0; c < TIKI_STATS_CALLS; c++) {
+        fprintf(fp, "tiki_api_sent_bytes_total{call=\"%s\"} %llu\n", stats_calls[c], (unsigned long long)sent[c]);
+    }
+    fprintf(fp, "# HELP tiki_api_received_bytes_total Response body bytes received by Tiki API calls.\n");
+    fprintf(fp, "# TYPE tiki_api_received_bytes_total counter\n");
+    for (c = 0; c < TIKI_STATS_CALLS; c++) {
+        fprintf(fp, "tiki_api_received_bytes_total{call=\"%s\"} %llu\n", stats_calls[c], (unsigned long long)received[c]);
+    }
+    if (fclose(fp) != 0 || rename(tempname, filepath) != 0) {
+        TIKI_ERROR("tiki_stats_dump() failed: %s could not be written\n", filepath);
+        remove(tempname);
+        return -1;
+    }
+    return 0;
+}
+
+
+// ***************************************************************************
+// priority classes: urgent calls (e.g. an alarm status update) are let
+//  through a domain's rate limit before normal ones, and normal ones before
+//  bulk File gallery transfers - and while an urgent call is in flight the
+//  bulk transfers to its domain stand aside until it has completed
+// ***************************************************************************
+void tiki_session_setpriority(tiki_session* session, int priority)
+{
+    // session: the session created by tiki_session_create
+    // priority: the class of the session's calls from now on - 0 urgent, 1 normal or 2 bulk, or -1 (the default)
+    //  for its File gallery transfers to be bulk and all its other calls normal
+    // a bulk transfer standing aside sends and reads nothing, so its time limits (see tiki_settimeouts) must
+    //  allow for the urgent calls it may wait for
+
+    session->priority = (priority >= TIKI_PRIORITY_URGENT && priority <= TIKI_PRIORITY_BULK) ? priority : TIKI_PRIORITY_BYCALL;
+}
+
+static int request_priority(int priority, int bulk)
+{
+    // priority: the class set on the session or tiki_multi
+    // bulk: set if the call is a File gallery transfer
+    if (priority != TIKI_PRIORITY_BYCALL) {
+        return priority;
+    }
+    return bulk ? TIKI_PRIORITY_BULK : TIKI_PRIORITY_NORMAL;
+}
+
+
+// ***************************************************************************
+// make the request prepared on the session's curl handle - unless it is
+//  refused, once the domain's rate limit lets its class through, and within
+//  the time limits, with its outcome counted by the breaker
+// ***************************************************************************
+static CURLcode session_perform(tiki_session* session, CURL* curl_handle, int call)
+{
+    // call: which API call the request is for - one of the TIKI_CALL_ values
+    int priority = request_priority(session->priority,
+                                    call == TIKI_CALL_FILEDOWNLOAD || call == TIKI_CALL_FILEUPLOAD || call == TIKI_CALL_FILEUPDATE);
+    CURLcode res = request_refused(session);
+    if (res != CURLE_OK) {
+        /* nothing is sent, and with no transfer times it is left out of the latency histograms */
+        return res;
+    }
+    long long queued_us = bucket_now_us();
+    res = bucket_take(session->bucket, priority, session->cancel);
+    if (res != CURLE_OK) {
+        return res;
+    }
+    stats_queued(priority, bucket_now_us() - queued_us);
+    int urgent = (priority == TIKI_PRIORITY_URGENT && session->bucket != NULL);
+    session->yielding = (priority == TIKI_PRIORITY_BULK && session->bucket != NULL);
+    if (urgent) {
+        __atomic_add_fetch(&session->bucket->urgent, 1, __ATOMIC_RELEASE);
+    }
+    request_limits(session, curl_handle);
+    res = curl_easy_perform(curl_handle);
+    if (urgent) {
+        __atomic_sub_fetch(&session->bucket->urgent, 1, __ATOMIC_RELEASE);
+    }
+    session->yielding = 0;
+    breaker_record(session->breaker, curl_handle, res);
+    return res;
+}
+
+
+// ***************************************************************************
+// gzip compress post data: returns the compressed copy, which the caller
+//  frees, or NULL if compressing it would not make it any smaller
+// ***************************************************************************
+static char* gzip_body(const char *data, size_t len, size_t *gzlen)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    /* 15 + 16 window bits asks for a gzip header and trailer rather than a bare zlib stream */
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t bound = deflateBound(&zs, len);
+    char *gz = malloc(bound);
+    if (gz == NULL) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef *)gz;
+    zs.avail_out = bound;
+    int ret = deflate(&zs, Z_FINISH);
+    *gzlen = zs.total_out;
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END || *gzlen >= len) {
+        free(gz);
+        return NULL;
+    }
+    return gz;
+}
+
+
+// ***************************************************************************
+// set the post data of a tracker request, gzip compressed if the session
+//  compresses post data of its size
+// ***************************************************************************
+static void session_postfields(tiki_session* session, CURL *curl_handle, const char *post_data)
+{
+    size_t len = strlen(post_data);
+    size_t gzlen = 0;
+    char *gz = NULL;
+    free(session->postgz);
+    session->postgz = NULL;
+    if (session->compress_min > 0 && len >= session->compress_min) {
+        gz = gzip_body(post_data, len, &gzlen);
+    }
+    if (gz != NULL) {
+        /* the compressed copy is kept by the session until the next request as curl does not copy it */
+        session->postgz = gz;
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, session->gzipchunk);
+        curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, gz);
+        curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)gzlen);
+    } else {
+        curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, post_data);
+        // if we do not provide POSTFIELDSIZE, libcurl will strlen() by itself
+        curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)len);
+    }
+}
+
+
+// ***************************************************************************
+// keep the response memory of each session request for re-use by the next
+//  one, so that steady-state polling of the same pages does no allocation
+//  while the responses are collected
+// ***************************************************************************
+void tiki_session_setarena(tiki_session* session, size_t maxsize)
+{
+    // session: the session created by tiki_session_create
+    // maxsize: response memory up to this many bytes is kept by the session between requests - 0 frees and keeps none
+
+    session->arenamax = maxsize;
+    if (session->arena != NULL && session->arenasize > maxsize) {
+        free(session->arena);
+        session->arena = NULL;
+        session->arenasize = 0;
+    }
+}
+
+
+// ***************************************************************************
+// response memory functions used by WriteMemoryCallback: the memory starts
+//  as the session's kept memory (if there is any), is pre-sized from the
+//  Content-Length header and is otherwise grown by doubling, so a large page
+//  takes a handful of reallocs rather than one for every chunk curl delivers
+// ***************************************************************************
+static void memchunk_init(struct MemoryStruct *mem, tiki_session *session)
+{
+    // mem: the response memory to set up, which is always left holding an empty string
+    // session: the session whose kept memory is re-used (and then given back to) or NULL for none
+
+    mem->size = 0;
+    mem->scan = NULL;
+    mem->match = NULL;
+    mem->buffered = 1;
+    mem->session = session;
+    if (session != NULL && session->arena != NULL) {
+        /* take the memory kept from the previous request */
+        mem->memory = session->arena;
+        mem->capacity = session->arenasize;
+        session->arena = NULL;
+        session->arenasize = 0;
+    } else {
+        mem->memory = malloc(1);
+        mem->capacity = (mem->memory != NULL) ? 1 : 0;
+    }
+    if (mem->memory != NULL) {
+        mem->memory[0] = 0;
+    }
+}
+
+static int memchunk_reserve(struct MemoryStruct *mem, size_t needed)
+{
+    // needed: the number of bytes that memory must hold, including the string terminator
+    // returns 1 if memory is now big enough or 0 if it could not be grown
+
+    if (needed <= mem->capacity) {
+        return 1;
+    }
+    size_t newsize = (mem->capacity < TIKI_MEMORY_MINSIZE) ? TIKI_MEMORY_MINSIZE : mem->capacity;
+    while (newsize < needed) {
+        if (newsize > ((size_t)-1) / 2) {
+            newsize = needed;
+            break;
+        }
+        newsize *= 2;
+    }
+    char *ptr = realloc(mem->memory, newsize);
+    if (ptr == NULL) {
+        return 0;
+    }
+    mem->memory = ptr;
+    mem->capacity = newsize;
+    return 1;
+}
+
+static void memchunk_free(struct MemoryStruct *mem)
+{
+    // the memory is given back to its session for re-use if the session keeps memory of this size, otherwise it is freed
+
+    tiki_session *session = mem->session;
+    if (session != NULL && session->arena == NULL && mem->memory != NULL && mem->capacity <= session->arenamax) {
+        session->arena = mem->memory;
+        session->arenasize = mem->capacity;
+    } else {
+        free(mem->memory);
+    }
+    mem->memory = NULL;
+    mem->capacity = 0;
+}
+
+
+// ***************************************************************************
+// curl header callback that pre-sizes the response memory from the
+//  Content-Length header, so the whole response then arrives without a realloc
+// ***************************************************************************
+static size_t HeaderSizeCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t realsize = size * nitems;
+    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
+    const size_t namelen = 15;    // strlen("Content-Length:")
+
+    if (mem->buffered && realsize > namelen && strncasecmp(buffer, "Content-Length:", namelen) == 0) {
+        size_t i = namelen;
+        size_t length = 0;
+        while (i < realsize && (buffer[i] == ' ' || buffer[i] == '\t')) {
+            i++;
+        }
+        while (i < realsize && buffer[i] >= '0' && buffer[i] <= '9' && length <= TIKI_MEMORY_PRESIZE_MAX) {
+            length = length * 10 + (size_t)(buffer[i] - '0');
+            i++;
+        }
+        if (length > 0 && length <= TIKI_MEMORY_PRESIZE_MAX) {
+            /* a failure here is not an error as the memory is grown again as the data arrives */
+            memchunk_reserve(mem, mem->size + length + 1);
+        }
+    }
+    return realsize;
+}
+
+
+
+// ***************************************************************************
+// multi-text matcher: an Aho-Corasick automaton built from the texts that are
+//  looked for, so a page is searched for all of them in a single pass that
+//  can be fed the page a chunk at a time as curl delivers it
+// ***************************************************************************
+static int text_match_init(struct text_match *match, const char** texts, int ntexts, long* offsets)
+{
+    // texts: the texts to look for - at most TIKI_MATCH_MAXTEXTS
+    // offsets: if not NULL, set to the byte offset where each text is first seen, or -1 if it is not
+    // returns 1 if the matcher was built or 0 if there was not enough memory
+
+    int maxstates = 1;
+    int nstates = 1;
+    int i;
+    memset(match, 0, sizeof(struct text_match));
+    for (i = 0; i < ntexts; i++) {
+        maxstates += strlen(texts[i]);
+    }
+    match->next = malloc(maxstates * sizeof(*match->next));
+    match->output = calloc(maxstates, sizeof(unsigned long long));
+    match->textlen = malloc(ntexts * sizeof(int));
+    int *fail = malloc(maxstates * sizeof(int));
+    int *queue = malloc(maxstates * sizeof(int));
+    if (match->next == NULL || match->output == NULL || match->textlen == NULL || fail == NULL || queue == NULL) {
+        free(match->next);
+        free(match->output);
+        free(match->textlen);
+        free(fail);
+        free(queue);
+        return 0;
+    }
+    match->ntexts = ntexts;
+    match->offsets = offsets;
+    match->all = (ntexts == 64) ? ~0ULL : (1ULL << ntexts) - 1;
+
+    // the trie of the texts, with -1 for no transition yet
+    memset(match->next[0], -1, sizeof(*match->next));
+    for (i = 0; i < ntexts; i++) {
+        const unsigned char *c;
+        int state = 0;
+        for (c = (const unsigned char *)texts[i]; *c != 0; c++) {
+            if (match->next[state][*c] < 0) {
+                memset(match->next[nstates], -1, sizeof(*match->next));
+                match->next[state][*c] = nstates++;
+            }
+            state = match->next[state][*c];
+        }
+        match->output[state] |= 1ULL << i;
+        match->textlen[i] = strlen(texts[i]);
+        if (offsets != NULL) {
+            offsets[i] = -1;
+        }
+    }
+    // an empty text is found before the page starts
+    match->found = match->output[0];
+    for (i = 0; i < ntexts; i++) {
+        if (offsets != NULL && match->textlen[i] == 0) {
+            offsets[i] = 0;
+        }
+    }
+
+    // breadth first: each missing transition goes where the failure link's would,
+    //  so scanning a byte is then a single table lookup
+    int head = 0;
+    int tail = 0;
+    int b;
+    for (b = 0; b < 256; b++) {
+        if (match->next[0][b] < 0) {
+            match->next[0][b] = 0;
+        } else {
+            fail[match->next[0][b]] = 0;
+            queue[tail++] = match->next[0][b];
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        match->output[state] |= match->output[fail[state]];
+        for (b = 0; b < 256; b++) {
+            int child = match->next[state][b];
+            if (child < 0) {
+                match->next[state][b] = match->next[fail[state]][b];
+            } else {
+                fail[child] = match->next[fail[state]][b];
+                queue[tail++] = child;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return 1;
+}
+
+static int text_match_feed(struct text_match *match, const char *data, size_t len)
+{
+    // data: the next len bytes of the page
+    // returns 1 once every text has been seen
+
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+    int state = match->state;
+    for (i = 0; i < len && match->found != match->all; i++) {
+        state = match->next[state][p[i]];
+        unsigned long long newly = match->output[state] & ~match->found;
+        if (newly != 0) {
+            match->found |= newly;
+            if (match->offsets != NULL) {
+                int t;
+                for (t = 0; t < match->ntexts; t++) {
+                    if (newly & (1ULL << t)) {
+                        match->offsets[t] = (long)(match->pos + i + 1) - match->textlen[t];
+                    }
+                }
+            }
+        }
+    }
+    match->state = state;
+    match->pos += len;
+    return match->found == match->all;
+}
+
+static void text_match_free(struct text_match *match)
+{
+    free(match->next);
+    free(match->output);
+    free(match->textlen);
+}
+
+
+// ***************************************************************************
+// web page response cache: the pages downloaded by a session are kept with
+//  their ETag/Last-Modified values, which are sent back with the next GET of
+//  the same page as If-None-Match/If-Modified-Since - so a page that has not
+//  changed costs only a '304 Not Modified' and is then served from the cache
+// ***************************************************************************
+void tiki_session_setcache(tiki_session* session, int max_entries, size_t max_bytes, const char* cachedir)
+{
+    // session: the session created by tiki_session_create
+    // max_entries: the most web pages kept in memory, least recently used first out - 0 frees and keeps none
+    // max_bytes: the most web page content bytes kept in memory
+    // cachedir: existing directory that every kept page is also written to, so the cache outlives the
+    //           session (and the hub), or NULL to keep the pages in memory only
+
+    struct tiki_cache *cache = session->cache;
+    int i;
+    if (cache != NULL) {
+        for (i = 0; i < cache->nentries; i++) {
+            free(cache->entries[i].url);
+            free(cache->entries[i].body);
+        }
+        free(cache->entries);
+        free(cache->cachedir);
+        free(cache);
+        session->cache = NULL;
+    }
+    if (max_entries <= 0) {
+        return;
+    }
+    cache = calloc(1, sizeof(struct tiki_cache));
+    if (cache != NULL) {
+        cache->entries = calloc(max_entries, sizeof(struct tiki_cache_entry));
+        cache->cachedir = (cachedir != NULL) ? strdup(cachedir) : NULL;
+    }
+    if (cache == NULL || cache->entries == NULL || (cachedir != NULL && cache->cachedir == NULL)) {
+        TIKI_ERROR("tiki_session_setcache() failed: not enough memory\n");
+        if (cache != NULL) {
+            free(cache->entries);
+            free(cache->cachedir);
+            free(cache);
+        }
+        return;
+    }
+    cache->max_entries = max_entries;
+    cache->max_bytes = max_bytes;
+    session->cache = cache;
+}
+
+
+// ***************************************************************************
+// name of the file that a page is kept in within the cache directory: a
+//  64-bit FNV-1a hash of the URL, which is also stored in the file to guard
+//  against two URLs with the same hash
+// ***************************************************************************
+static void cache_filename(struct tiki_cache *cache, const char *url, char *filename, size_t filenamesize)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char *p;
+    for (p = (const unsigned char *)url; *p != 0; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    snprintf(filename, filenamesize, "%s/%016llx.cache", cache->cachedir, (unsigned long long)hash);
+}
+
+
+// ***************************************************************************
+// least recently used eviction: makes room in memory for a page of size bytes
+//  and returns the free entry, or NULL if the page is too big to keep in memory
+// ***************************************************************************
+static struct tiki_cache_entry* cache_makeroom(struct tiki_cache *cache, size_t size)
+{
+    if (size > cache->max_bytes) {
+        return NULL;
+    }
+    while (cache->nentries > 0 && (cache->nentries == cache->max_entries || cache->bytes + size > cache->max_bytes)) {
+        int oldest = 0;
+        int i;
+        for (i = 1; i < cache->nentries; i++) {
+            if (cache->entries[i].used < cache->entries[oldest].used) {
+                oldest = i;
+            }
+        }
+        /* the page stays in the cache directory (if there is one) */
+        cache->bytes -= cache->entries[oldest].size;
+        free(cache->entries[oldest].url);
+        free(cache->entries[oldest].body);
+        cache->entries[oldest] = cache->entries[--cache->nentries];
+    }
+    struct tiki_cache_entry *entry = &cache->entries[cache->nentries];
+    memset(entry, 0, sizeof(struct tiki_cache_entry));
+    return entry;
+}
+
+
+// ***************************************************************************
+// read a page back from the cache directory into memory, e.g. after the hub
+//  has been restarted - the file is a short text header followed by the page
+// ***************************************************************************
+static struct tiki_cache_entry* cache_load(struct tiki_cache *cache, const char *url)
+{
+    char filename[300];
+    char line[TIKI_CACHE_VALIDATORLEN + 200];
+    struct tiki_cache_entry loaded;
+    struct tiki_cache_entry *entry;
+    memset(&loaded, 0, sizeof(loaded));
+
+    cache_filename(cache, url, filename, sizeof(filename));
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    // header lines are: magic, URL, ETag, Last-Modified and the page size
+    int valid = 0;
+    if (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\n")] = 0;
+        valid = (strcmp(line, TIKI_CACHE_MAGIC) == 0);
+    }
+    if (valid && fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\n")] = 0;
+        valid = (strcmp(line, url) == 0);     /* a different URL with the same hash is not this page */
+    } else {
+        valid = 0;
+    }
+    if (valid && fgets(loaded.etag, sizeof(loaded.etag), fp) != NULL && fgets(loaded.lastmod, sizeof(loaded.lastmod), fp) != NULL
+        && fgets(line, sizeof(line), fp) != NULL) {
+        loaded.etag[strcspn(loaded.etag, "\n")] = 0;
+        loaded.lastmod[strcspn(loaded.lastmod, "\n")] = 0;
+        loaded.size = strtoul(line, NULL, 10);
+    } else {
+        valid = 0;
+    }
+    if (!valid) {
+        fclose(fp);
+        return NULL;
+    }
+    loaded.body = malloc(loaded.size + 1);
+    loaded.url = strdup(url);
+    if (loaded.body == NULL || loaded.url == NULL || fread(loaded.body, 1, loaded.size, fp) != loaded.size) {
+        fclose(fp);
+        free(loaded.body);
+        free(loaded.url);
+        return NULL;
+    }
+    fclose(fp);
+    loaded.body[loaded.size] = 0;
+
+    entry = cache_makeroom(cache, loaded.size);
+    if (entry == NULL) {
+        free(loaded.body);
+        free(loaded.url);
+        return NULL;
+    }
+    *entry = loaded;
+    cache->nentries++;
+    cache->bytes += loaded.size;
+    return entry;
+}
+
+
+// ***************************************************************************
+// find the kept copy of a page, from memory or else from the cache directory
+// ***************************************************************************
+static struct tiki_cache_entry* cache_find(struct tiki_cache *cache, const char *url)
+{
+    int i;
+    for (i = 0; i < cache->nentries; i++) {
+        if (strcmp(cache->entries[i].url, url) == 0) {
+            cache->entries[i].used = ++cache->clock;
+            return &cache->entries[i];
+        }
+    }
+    if (cache->cachedir != NULL) {
+        struct tiki_cache_entry *entry = cache_load(cache, url);
+        if (entry != NULL) {
+            entry->used = ++cache->clock;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+// ***************************************************************************
+// keep a newly downloaded page with its ETag/Last-Modified values, replacing
+//  any older copy - the cache directory copy is written to a temporary file
+//  and renamed so a reader never sees half a page
+// ***************************************************************************
+static void cache_store(struct tiki_cache *cache, const char *url, struct cache_response *response)
+{
+    struct MemoryStruct *mem = response->mem;
+    int i;
+    for (i = 0; i < cache->nentries; i++) {
+        if (strcmp(cache->entries[i].url, url) == 0) {
+            cache->bytes -= cache->entries[i].size;
+            free(cache->entries[i].url);
+            free(cache->entries[i].body);
+            cache->entries[i] = cache->entries[--cache->nentries];
+            break;
+        }
+    }
+
+    struct tiki_cache_entry *entry = cache_makeroom(cache, mem->size);
+    if (entry != NULL) {
+        entry->url = strdup(url);
+        entry->body = malloc(mem->size + 1);
+        if (entry->url != NULL && entry->body != NULL) {
+            memcpy(entry->body, mem->memory, mem->size + 1);
+            entry->size = mem->size;
+            strcpy(entry->etag, response->etag);
+            strcpy(entry->lastmod, response->lastmod);
+            entry->used = ++cache->clock;
+            cache->nentries++;
+            cache->bytes += mem->size;
+        } else {
+            free(entry->url);
+            free(entry->body);
+        }
+    }
+
+    if (cache->cachedir != NULL) {
+        char filename[300];
+        char tempname[310];
+        cache_filename(cache, url, filename, sizeof(filename));
+        snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+        FILE *fp = fopen(tempname, "wb");
+        if (fp == NULL) {
+            TIKI_ERROR("web page cache: %s could not be written\n", tempname);
+            return;
+        }
+        fprintf(fp, "%s\n%s\n%s\n%s\n%lu\n", TIKI_CACHE_MAGIC, url, response->etag, response->lastmod, (unsigned long)mem->size);
+        size_t written = fwrite(mem->memory, 1, mem->size, fp);
+        if (fclose(fp) != 0 || written != mem->size || rename(tempname, filename) != 0) {
+            TIKI_ERROR("web page cache: %s could not be written\n", filename);
+            remove(tempname);
+        }
+    }
+}
+
+
+// ***************************************************************************
+// curl header callback for cached web page requests: keeps the ETag and
+//  Last-Modified values of the response as well as pre-sizing its memory
+// ***************************************************************************
+static size_t CacheHeaderCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t realsize = size * nitems;
+    struct cache_response *response = (struct cache_response *)userp;
+    char *value = NULL;
+    size_t namelen = 0;
+
+    if (realsize > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        /* a new response (e.g. after a redirect) - forget the headers of any earlier one */
+        response->etag[0] = 0;
+        response->lastmod[0] = 0;
+    } else if (realsize > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        value = response->etag;
+        namelen = 5;
+    } else if (realsize > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+        value = response->lastmod;
+        namelen = 14;
+    }
+    if (value != NULL) {
+        size_t start = namelen;
+        size_t end = realsize;
+        while (start < end && (buffer[start] == ' ' || buffer[start] == '\t')) {
+            start++;
+        }
+        while (end > start && (buffer[end - 1] == '\r' || buffer[end - 1] == '\n' || buffer[end - 1] == ' ')) {
+            end--;
+        }
+        /* a value too long to keep is dropped, so the page is simply not cached */
+        if (end - start < TIKI_CACHE_VALIDATORLEN) {
+            memcpy(value, buffer + start, end - start);
+            value[end - start] = 0;
+        } else {
+            value[0] = 0;
+        }
+    }
+    return HeaderSizeCallback(buffer, size, nitems, response->mem);
+}
+
+
+// ***************************************************************************
+// GET a web page into memchunk with the session's curl handle: if the session
+//  keeps a cache the request is made conditional on the kept copy, which is
+//  copied into memchunk when the Tiki site answers '304 Not Modified'
+// ***************************************************************************
+static CURLcode webpage_fetch(int debug, tiki_session* session, const char* API_URL, struct MemoryStruct *memchunk)
+{
+    CURL *curl_handle;
+    CURLcode res;
+    struct tiki_cache *cache = session->cache;
+    struct tiki_cache_entry *entry = NULL;
+    struct curl_slist *condchunk = NULL;
+    struct curl_slist *item;
+    struct cache_response response;
+    char condition[TIKI_CACHE_VALIDATORLEN + 32];
+
+    response.mem = memchunk;
+    response.etag[0] = 0;
+    response.lastmod[0] = 0;
+    if (cache != NULL) {
+        entry = cache_find(cache, API_URL);
+    }
+    if (entry != NULL) {
+        // the cached 'accept' and authorization headers plus the conditions on the kept copy
+        for (item = session->jsonchunk; item != NULL; item = item->next) {
+            condchunk = curl_slist_append(condchunk, item->data);
+        }
+        if (entry->etag[0] != 0) {
+            snprintf(condition, sizeof(condition), "If-None-Match: %s", entry->etag);
+            condchunk = curl_slist_append(condchunk, condition);
+        }
+        if (entry->lastmod[0] != 0) {
+            snprintf(condition, sizeof(condition), "If-Modified-Since: %s", entry->lastmod);
+            condchunk = curl_slist_append(condchunk, condition);
+        }
+    }
+
+    /* re-use the session's curl handle with its cached 'accept' and authorization headers */
+    curl_handle = session_request(session, API_URL, (condchunk != NULL) ? condchunk : session->jsonchunk);
+    /* send all data to this function  */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    /* we pass our 'memchunk' struct to the callback function */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)memchunk);
+    /* pre-size the response memory from the Content-Length header and collect the ETag/Last-Modified values */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, CacheHeaderCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&response);
+
+    /* get it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_WEBPAGE);
+    transfer_account(curl_handle, TIKI_CALL_WEBPAGE, -1, (long long)memchunk->size);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(condchunk);
+
+    if (res == CURLE_OK && cache != NULL) {
+        long httpcode = 0;
+        curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpcode);
+        if (httpcode == 304 && entry != NULL) {
+            /* not modified - so the kept copy is the page */
+            if (memchunk->match != NULL) {
+                text_match_feed(memchunk->match, entry->body, entry->size);
+            }
+            memchunk->size = 0;
+            if (memchunk_reserve(memchunk, entry->size + 1)) {
+                memcpy(memchunk->memory, entry->body, entry->size + 1);
+                memchunk->size = entry->size;
+            }
+            TIKI_DEBUG(debug, "page not modified - %lu bytes served from the cache\n", (unsigned long)entry->size);
+        } else if (httpcode == 200 && memchunk->size > 0 && (response.etag[0] != 0 || response.lastmod[0] != 0)) {
+            cache_store(cache, API_URL, &response);
+        }
+    }
+    return res;
+}
+
+
+// ***************************************************************
+//   download full web page function
+// curl code based upon https://curl.se/libcurl/c/getinmemory.html
+// ***************************************************************
+char* webpage_download(int debug, const char* domain, const char* page, char* access_token)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // access_token: the API access token that enables specific permissions for the API usage
+    // web page content is returned as returnstr from the cURL response
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for the web page download function");
+    }
+    returnstr = webpage_download_session(debug, session, page);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// ***************************************************************
+//   download full web page function using a persistent session
+// ***************************************************************
+char* webpage_download_session(int debug, tiki_session* session, const char* page)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // web page content is returned as returnstr from the cURL response
+
+    char *returnstr = "";
+    TIKI_DEBUG(debug, "\n *** debug from webpage_download ...\n");
+    TIKI_DEBUG(debug, "domain name is: %s\n", session->domain);
+    TIKI_DEBUG(debug, "page name is: %s\n", page);
+    // build the full wiki API URL
+    char wiki_api[15] = "/api/wiki/page";
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, wiki_api);
+	strcat(API_URL, page);
+    TIKI_DEBUG(debug, "\n *** debug from webpage_download ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // GET the content of the web page
+    CURLcode res;
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+
+    /* get it! - conditionally on the session's cached copy of the page if there is one */
+    res = webpage_fetch(debug, session, API_URL, &memchunk);
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+        TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        returnstr = copyString("curl access to the Tiki site for the web page download function failed");
+    } else if (memchunk.size == 0) {
+        TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+        returnstr = copyString("no response from the curl request sent to the server API");
+    } else {
+        /*
+        * Now, our memchunk.memory points to a memory block that is memchunk.size
+        * bytes big and contains the web page content.
+        *
+        */
+        TIKI_DEBUG(debug, "%lu bytes retrieved\n", (unsigned long)memchunk.size);
+        TIKI_DEBUG(debug, "the full wiki page text is: %s\n", memchunk.memory);
+        returnstr = copyString(memchunk.memory);
+    }
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+
+	return returnstr;
+}
+
+
+// ***************************************************************
+// web page simple/general content check function: looks for 
+//  specific content on a page and returns 0 if false or 1 if true
+// curl code based upon https://curl.se/libcurl/c/getinmemory.html
+// ***************************************************************
+_Bool webpage_check(int debug, const char* domain, const char* page, char* access_token, const char* check_text)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // access_token: the API access token that enables specific permissions for the API usage
+    // check_text: text string that is 'looked for' on the web page content
+    // check_result is returned as either TRUE or FALSE
+
+    bool check_result = false;
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return check_result;
+    }
+    check_result = webpage_check_session(debug, session, page, check_text);
+    tiki_session_destroy(session);
+	return check_result;
+}
+
+
+// ***************************************************************
+// web page simple/general content check function using a
+//  persistent session
+// ***************************************************************
+_Bool webpage_check_session(int debug, tiki_session* session, const char* page, const char* check_text)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // check_text: text string that is 'looked for' on the web page content
+    // check_result is returned as either TRUE or FALSE
+
+    bool check_result = false;
+    TIKI_DEBUG(debug, "\n *** debug from webpage_check ...\n");
+    TIKI_DEBUG(debug, "domain name is: %s\n", session->domain);
+    TIKI_DEBUG(debug, "page name is: %s\n", page);
+    TIKI_DEBUG(debug, "text to be found is: %s\n", check_text);
+    // build the full wiki API URL
+    char wiki_api[15] = "/api/wiki/page";
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, wiki_api);
+	strcat(API_URL, page);
+    TIKI_DEBUG(debug, "\n *** debug from webpage_check ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // GET the content of the web page
+    CURLcode res;
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+
+    /* get it! - conditionally on the session's cached copy of the page if there is one */
+    res = webpage_fetch(debug, session, API_URL, &memchunk);
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+        TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        // check_result is already set to false - so no need to update it
+    } else if (memchunk.size == 0) {
+        TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+        check_result = false;
+    } else {
+        /*
+        * Now, our memchunk.memory points to a memory block that is memchunk.size
+        * bytes big and contains the web page content.
+        *
+        * content check code below does a string check against the 'check_text' string
+        */
+        TIKI_DEBUG(debug, "%lu bytes retrieved\n", (unsigned long)memchunk.size);
+        //printf("the full wiki page text is: %s\n", memchunk.memory);
+         char *found;
+         // use strstr to check if the check_text is 'in' memchunk.memory
+         //  - returns pointer to start if found, or a null pointer if not
+         found = strstr(memchunk.memory, check_text);  // found is now the whole string from check_text onwards if found
+         if ( found != NULL )  {  // check_text string must have been found!
+		     check_result = true;
+             // now remove all the characters after the check_text characters
+             removeString(found, strlen(check_text), strlen(memchunk.memory));
+             TIKI_DEBUG(debug, "\ntext found - cropped found text is: %s\n", found);
+
+         } else {
+             TIKI_DEBUG(debug, "\ntext not found\n");
+             check_result = false;
+         }
+    }
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "\nmemchunk.memory freed and returning check_result: %s\n", check_result?"true":"false");
+	return check_result;
+}
+
+
+// ***************************************************************
+// web page multi-text content check function: looks for a set of
+//  texts on a page with one download and returns a bit mask with
+//  bit i set if check_texts[i] is on the page
+// ***************************************************************
+unsigned long long webpage_checkall(int debug, const char* domain, const char* page, char* access_token, const char** check_texts, int ntexts, long* offsets)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // access_token: the API access token that enables specific permissions for the API usage
+    // check_texts: array of ntexts text strings that are 'looked for' on the web page content - at most 64
+    // offsets: array of ntexts that is set to the byte offset where each text is first found, or -1 if not found - or NULL
+    // the bit mask of the texts found is returned - 0 if none are found or the page could not be downloaded
+
+    unsigned long long check_result = 0;
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return check_result;
+    }
+    check_result = webpage_checkall_session(debug, session, page, check_texts, ntexts, offsets);
+    tiki_session_destroy(session);
+	return check_result;
+}
+
+
+// ***************************************************************
+// web page multi-text content check function using a persistent
+//  session: the page is searched as it arrives and, once every
+//  text has been seen, the rest of it is not downloaded - unless
+//  the session keeps a cache, which needs the whole page
+// ***************************************************************
+unsigned long long webpage_checkall_session(int debug, tiki_session* session, const char* page, const char** check_texts, int ntexts, long* offsets)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // check_texts: array of ntexts text strings that are 'looked for' on the web page content - at most 64
+    // offsets: array of ntexts that is set to the byte offset where each text is first found, or -1 if not found - or NULL
+    // the bit mask of the texts found is returned - 0 if none are found or the page could not be downloaded
+
+    unsigned long long check_result = 0;
+    int i;
+    if (ntexts < 0 || ntexts > TIKI_MATCH_MAXTEXTS) {
+        TIKI_ERROR("webpage_checkall() failed: %d texts were given but at most %d can be checked\n", ntexts, TIKI_MATCH_MAXTEXTS);
+        return check_result;
+    }
+	if (TIKI_DEBUGGING(debug))
+    {
+       log_write(TIKI_LOG_DEBUG, "\n *** debug from webpage_checkall ...\n");
+       log_write(TIKI_LOG_DEBUG, "domain name is: %s\n", session->domain);
+       log_write(TIKI_LOG_DEBUG, "page name is: %s\n", page);
+       for (i = 0; i < ntexts; i++) {
+           log_write(TIKI_LOG_DEBUG, "text %d to be found is: %s\n", i, check_texts[i]);
+       }
+    }
+    // build the full wiki API URL
+    char wiki_api[15] = "/api/wiki/page";
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, wiki_api);
+	strcat(API_URL, page);
+    TIKI_DEBUG(debug, "\n *** debug from webpage_checkall ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // GET the content of the web page, looking for the texts as it arrives
+    CURLcode res;
+    struct MemoryStruct memchunk;
+    struct text_match match;
+    if (!text_match_init(&match, check_texts, ntexts, offsets)) {
+        TIKI_ERROR("webpage_checkall() failed: not enough memory\n");
+        return check_result;
+    }
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+    memchunk.match = &match;
+    if (session->cache == NULL) {
+        /* the page is not kept, so the download can stop as soon as every text has been seen */
+        memchunk.buffered = 0;
+        match.stop = 1;
+    }
+
+    /* get it! - conditionally on the session's cached copy of the page if there is one */
+    res = webpage_fetch(debug, session, API_URL, &memchunk);
+    if (res == CURLE_WRITE_ERROR && match.stop && match.found == match.all) {
+        /* the download was stopped on purpose */
+        res = CURLE_OK;
+    }
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+        TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        // check_result is already set to 0 - so no need to update it
+    } else if (memchunk.size == 0) {
+        TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+    } else {
+        check_result = match.found;
+	    if (TIKI_DEBUGGING(debug))
+        {
+             log_write(TIKI_LOG_DEBUG, "%lu bytes scanned\n", (unsigned long)match.pos);
+             for (i = 0; i < ntexts; i++) {
+                 log_write(TIKI_LOG_DEBUG, "text %d %s\n", i, (check_result & (1ULL << i)) ? "found" : "not found");
+             }
+        }
+    }
+    text_match_free(&match);
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "\nmemchunk.memory freed and returning check_result: %llx\n", check_result);
+	return check_result;
+}
+
+
+// *********************************************************************
+// web page content date check function: looks for a specific 
+//  date in the content on a page and returns various status text e.g 
+//  'true' if the found date is more recent than the passed check date 
+//  or 'false' if not and various other error status results.
+// this version allows the date character length to be set 
+// curl code based upon https://curl.se/libcurl/c/getinmemory.html
+// *********************************************************************
+char* webpage_datetimecheck(int debug, const char* domain, const char* page, char* access_token, const char* infront_text, int datelen, const char* ref_datetime, const char* datetime_fmt)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // access_token: the API access token that enables specific permissions for the API usage
+    // infront_text: text string that is a marker on the web page that proceeds the date and can be 'looked for' in the web page content
+    // datelen: is the character length of the date text
+    // ref_datetime: is a string of the integer linux time that is being checked against
+    // datetime_fmt: is the expected format of the date text in the web page content e.g. "%a %b %d, %Y %H:%M:%S %Z"
+    // check_result_text is returned as a string to indicate the result
+
+    char *check_result_text = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for the web page date-time check function");
+    }
+    check_result_text = webpage_datetimecheck_session(debug, session, page, infront_text, datelen, ref_datetime, datetime_fmt);
+    tiki_session_destroy(session);
+	return check_result_text;
+}
+
+
+// *********************************************************************
+// compiled date-time parser: datetime_fmt is turned once into a list
+//  of fields, so each date found on a page is then read with a single
+//  pass over its text and turned into epoch time directly - without
+//  strptime's locale look-ups or mktime's time zone look-ups
+// *********************************************************************
+static int datetime_addfields(tiki_datetime* parser, const char* datetime_fmt)
+{
+    // returns 1 if every conversion in datetime_fmt is handled by the fast parser, otherwise 0
+
+    const char *f;
+    for (f = datetime_fmt; *f != 0; f++) {
+        char conv = 0;
+        char literal = *f;
+        if (*f == '%') {
+            f++;
+            switch (*f) {
+                // conversions that are shorthand for others
+                case 'T': if (!datetime_addfields(parser, "%H:%M:%S")) return 0; continue;
+                case 'R': if (!datetime_addfields(parser, "%H:%M")) return 0; continue;
+                case 'F': if (!datetime_addfields(parser, "%Y-%m-%d")) return 0; continue;
+                case 'D': if (!datetime_addfields(parser, "%m/%d/%y")) return 0; continue;
+                case 'n': case 't': conv = ' '; break;
+                case '%': break;
+                case 'Y': case 'y': case 'm': case 'd': case 'e': case 'H': case 'I': case 'M': case 'S':
+                case 'b': case 'h': case 'B': case 'a': case 'A': case 'p': case 'z': case 'Z':
+                    conv = *f;
+                    break;
+                default:
+                    return 0;
+            }
+        } else if (*f == ' ' || *f == '\t' || *f == '\n') {
+            conv = ' ';
+        }
+        if (parser->nfields == TIKI_DATETIME_MAXFIELDS) {
+            return 0;
+        }
+        parser->conv[parser->nfields] = conv;
+        parser->literal[parser->nfields] = literal;
+        parser->nfields++;
+    }
+    return 1;
+}
+
+tiki_datetime* tiki_datetime_compile(const char* datetime_fmt)
+{
+    // datetime_fmt: the strptime format of the date text e.g. "%a %b %d, %Y %H:%M:%S %Z"
+    // returns the compiled parser, to be freed with tiki_datetime_free, or NULL if there was not enough memory
+    //  - a format that uses conversions the fast parser does not handle (e.g. %j or %U) is still accepted
+    //    and those dates are read with strptime instead
+
+    tiki_datetime *parser = calloc(1, sizeof(tiki_datetime));
+    if (parser == NULL) {
+        TIKI_ERROR("tiki_datetime_compile() failed: not enough memory\n");
+        return NULL;
+    }
+    if (!datetime_addfields(parser, datetime_fmt)) {
+        parser->fallback = strdup(datetime_fmt);
+        if (parser->fallback == NULL) {
+            TIKI_ERROR("tiki_datetime_compile() failed: not enough memory\n");
+            free(parser);
+            return NULL;
+        }
+    }
+    return parser;
+}
+
+void tiki_datetime_free(tiki_datetime* parser)
+{
+    // parser: the parser created by tiki_datetime_compile - NULL is ignored
+
+    if (parser != NULL) {
+        free(parser->fallback);
+        free(parser);
+    }
+}
+
+
+// *********************************************************************
+// helpers for tiki_datetime_parse: numbers of up to maxdigits digits
+//  (after optional spaces, as strptime allows), month and day names
+//  in full or abbreviated, and days since 1970-01-01 from a date
+// *********************************************************************
+static int datetime_number(const char **text, int maxdigits, int *value)
+{
+    const char *p = *text;
+    int digits = 0;
+    *value = 0;
+    while (*p == ' ') {
+        p++;
+    }
+    while (digits < maxdigits && *p >= '0' && *p <= '9') {
+        *value = *value * 10 + (*p - '0');
+        p++;
+        digits++;
+    }
+    *text = p;
+    return digits > 0;
+}
+
+static int datetime_name(const char **text, const char *const names[], int nnames, int *value)
+{
+    int i;
+    for (i = 0; i < nnames; i++) {
+        size_t len = strlen(names[i]);
+        if (strncasecmp(*text, names[i], len) == 0) {
+            *text += len;
+            *value = i;
+            return 1;
+        }
+        if (strncasecmp(*text, names[i], 3) == 0) {
+            *text += 3;
+            *value = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static long long datetime_days(int year, int month, int day)
+{
+    // the proleptic Gregorian calendar counted in 400 year eras of 146097 days, each starting on 1 March
+    year -= (month <= 2);
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long yoe = year - era * 400;
+    long long doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+
+// *********************************************************************
+// read a date-time text with a compiled parser: the date and time are
+//  taken as UTC, less any %z offset (e.g. +0100) in the text, so dates
+//  compare the same however the hub's own time zone is set
+// *********************************************************************
+int tiki_datetime_parse(tiki_datetime* parser, const char* text, time_t* epoch)
+{
+    // parser: the parser created by tiki_datetime_compile
+    // text: the date-time text to read
+    // epoch: set to the date-time as an epoch integer
+    // returns 1 if the text matched the format or 0 if it did not
+
+    static const char *const months[] = {"january", "february", "march", "april", "may", "june", "july",
+                                         "august", "september", "october", "november", "december"};
+    static const char *const weekdays[] = {"sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday"};
+
+    if (parser->fallback != NULL) {
+        struct tm datetm;
+        memset(&datetm, 0, sizeof(struct tm));
+        if (strptime(text, parser->fallback, &datetm) == NULL) {
+            return 0;
+        }
+        long gmtoff = datetm.tm_gmtoff;      // only set by %z
+        *epoch = timegm(&datetm) - gmtoff;
+        return 1;
+    }
+
+    const char *p = text;
+    int year = 1900, month = 1, day = 1, hour = 0, minute = 0, second = 0;
+    int hour12 = -1, pm = -1;
+    long gmtoff = 0;
+    int value;
+    int i;
+    for (i = 0; i < parser->nfields; i++) {
+        int ok = 1;
+        switch (parser->conv[i]) {
+            case 0:
+                ok = (*p == parser->literal[i]);
+                p++;
+                break;
+            case ' ':
+                while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+                    p++;
+                }
+                break;
+            case 'Y': ok = datetime_number(&p, 4, &year); break;
+            case 'y':
+                ok = datetime_number(&p, 2, &value);
+                year = (value < 69) ? 2000 + value : 1900 + value;
+                break;
+            case 'm': ok = datetime_number(&p, 2, &month) && month >= 1 && month <= 12; break;
+            case 'd': case 'e': ok = datetime_number(&p, 2, &day) && day >= 1 && day <= 31; break;
+            case 'H': ok = datetime_number(&p, 2, &hour) && hour <= 23; break;
+            case 'I': ok = datetime_number(&p, 2, &hour12) && hour12 >= 1 && hour12 <= 12; break;
+            case 'M': ok = datetime_number(&p, 2, &minute) && minute <= 59; break;
+            case 'S': ok = datetime_number(&p, 2, &second) && second <= 60; break;
+            case 'b': case 'h': case 'B':
+                ok = datetime_name(&p, months, 12, &month);
+                month++;
+                break;
+            case 'a': case 'A': ok = datetime_name(&p, weekdays, 7, &value); break;
+            case 'p':
+                if (strncasecmp(p, "AM", 2) == 0 || strncasecmp(p, "PM", 2) == 0) {
+                    pm = (p[0] == 'P' || p[0] == 'p');
+                    p += 2;
+                } else {
+                    ok = 0;
+                }
+                break;
+            case 'z':
+                while (*p == ' ') {
+                    p++;
+                }
+                if (*p == 'Z') {
+                    p++;
+                } else if (*p == '+' || *p == '-') {
+                    int sign = (*p == '-') ? -1 : 1;
+                    int hh = 0, mm = 0;
+                    p++;
+                    ok = datetime_number(&p, 2, &hh);
+                    if (*p == ':') {
+                        p++;
+                    }
+                    if (*p >= '0' && *p <= '9') {
+                        ok = ok && datetime_number(&p, 2, &mm);
+                    }
+                    gmtoff = sign * (hh * 3600L + mm * 60L);
+                } else {
+                    ok = 0;
+                }
+                break;
+            case 'Z':
+                // a zone name e.g. GMT is skipped, as strptime does
+                while (*p == ' ') {
+                    p++;
+                }
+                while ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')) {
+                    p++;
+                }
+                break;
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    if (hour12 >= 0) {
+        hour = (hour12 % 12) + ((pm == 1) ? 12 : 0);
+    }
+    *epoch = (time_t)(datetime_days(year, month, day) * 86400LL + hour * 3600L + minute * 60L + second - gmtoff);
+    return 1;
+}
+
+
+// *********************************************************************
+// find the date on a page and compare it with the reference time: the
+//  date text is the datelen - 1 characters after the infront_text and
+//  one (assumed) space, as the original removeString cropping gave
+// returns 1 if the page date is newer, 0 if it is not, or -1 if the
+//  infront_text is not on the page
+// *********************************************************************
+static int datetime_pagecheck(int debug, tiki_datetime* parser, const char* content, const char* infront_text, int datelen, time_t reftime)
+{
+    const char *found = strstr(content, infront_text);
+    if (found == NULL) {
+        return -1;
+    }
+    char datetext[128];
+    size_t start = strlen(infront_text) + 1;
+    size_t len = (datelen > 1) ? (size_t)datelen - 1 : 0;
+    if (len >= sizeof(datetext)) {
+        len = sizeof(datetext) - 1;
+    }
+    if (strnlen(found, start) < start) {
+        len = 0;      /* the page ends straight after the infront_text */
+    } else {
+        len = strnlen(found + start, len);
+    }
+    memcpy(datetext, found + start, len);
+    datetext[len] = 0;
+
+    time_t foundtime = 0;
+    int parsed = tiki_datetime_parse(parser, datetext, &foundtime);
+    if (TIKI_DEBUGGING(debug))
+    {
+        log_write(TIKI_LOG_DEBUG, "found date/time text is: %s\n", datetext);
+        if (parsed) {
+            log_write(TIKI_LOG_DEBUG, "found date/time as epoch integer: %ld\n", (long)foundtime);
+        } else {
+            log_write(TIKI_LOG_DEBUG, "found date/time text does not match the date-time format\n");
+        }
+    }
+    return (parsed && foundtime > reftime) ? 1 : 0;
+}
+
+
+// *********************************************************************
+// web page content date check function using a persistent session
+// *********************************************************************
+char* webpage_datetimecheck_session(int debug, tiki_session* session, const char* page, const char* infront_text, int datelen, const char* ref_datetime, const char* datetime_fmt)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // page: text for the specific web page part of the URL that must include the leading / and spaces 'filled' with %20 NOT + or -
+    // infront_text: text string that is a marker on the web page that proceeds the date and can be 'looked for' in the web page content
+    // datelen: is the character length of the date text
+    // ref_datetime: is a string of the integer linux time that is being checked against
+    // datetime_fmt: is the expected format of the date text in the web page content e.g. "%a %b %d, %Y %H:%M:%S %Z"
+    // check_result_text is returned as a string to indicate the result
+
+    char *check_result_text = "";
+    tiki_datetime *parser = tiki_datetime_compile(datetime_fmt);
+    if (parser == NULL) {
+        return copyString("not enough memory for the web page date-time check function");
+    }
+    time_t reftime = 0;
+    tiki_datetime_parse(parser, ref_datetime, &reftime);        // assumes the ref_datetime uses the format datetime_fmt
+
+    TIKI_DEBUG(debug, "\n *** debug from webpage_datetimecheck ...\n");
+    TIKI_DEBUG(debug, "domain name is: %s\n", session->domain);
+    TIKI_DEBUG(debug, "page name is: %s\n", page);
+    TIKI_DEBUG(debug, "text in front of date is: %s\n", infront_text);
+    TIKI_DEBUG(debug, "date to be checked is: %s\n", ref_datetime);
+    TIKI_DEBUG(debug, "ref_datetime as epoch integer: %ld\n", (long)reftime);
+    TIKI_DEBUG(debug, "datelen parameter: %d\n", datelen);
+
+    // build the full wiki API URL
+    char wiki_api[15] = "/api/wiki/page";
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, wiki_api);
+	strcat(API_URL, page);
+    TIKI_DEBUG(debug, "\n *** debug from webpage_datetimecheck ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // GET the content of the web page
+    CURLcode res;
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+
+    /* get it! - conditionally on the session's cached copy of the page if there is one */
+    res = webpage_fetch(debug, session, API_URL, &memchunk);
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+         TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+         check_result_text = copyString("curl access to the Tiki site for web page date-time check failed");
+    } else if (memchunk.size == 0) {
+        TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+        check_result_text = copyString("no response from the curl request sent to the server API");
+    } else {
+         /*
+         * Now, our memchunk.memory points to a memory block that is memchunk.size
+         * bytes big and contains the web page content.
+         *
+         * the date check code below gets the date from the web page content and checks it against ref_datetime
+         */
+         TIKI_DEBUG(debug, "%lu bytes retrieved\n", (unsigned long)memchunk.size);
+         TIKI_DEBUG(debug, "the full wiki page text is: %s\n", memchunk.memory);
+         int check = datetime_pagecheck(debug, parser, memchunk.memory, infront_text, datelen, reftime);
+         if (check == 1) {
+             check_result_text = copyString("true");
+             TIKI_DEBUG(debug, "found time is newer, returning: %s\n", check_result_text);
+         } else if (check == 0) {
+             check_result_text = copyString("false");
+             TIKI_DEBUG(debug, "found time is older, returning: %s\n", check_result_text);
+         } else {
+             check_result_text = copyString("not found");
+             TIKI_DEBUG(debug, "\n*** infront_text not found!! ***, returning: %s\n", check_result_text);
+         }
+    }
+ 
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    tiki_datetime_free(parser);
+
+	return check_result_text;
+
+}
+
+
+// *********************************************************************
+// batch web page content date check function: checks the dates on many
+//  (page, infront_text) pairs against one reference time with a
+//  compiled parser, downloading each different page only once
+// *********************************************************************
+int webpage_datetimecheck_batch(int debug, tiki_session* session, tiki_datetime* parser, int npairs, const char** pages, const char** infront_texts, int datelen, const char* ref_datetime, int* results)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // parser: the date-time parser created by tiki_datetime_compile for the date format used on the pages
+    // npairs: the number of pages and infront_texts
+    // pages: array of page texts, each of which must include the leading / and spaces 'filled' with %20 NOT + or -
+    // infront_texts: array of marker texts on the page that proceed each date
+    // datelen: is the character length of the date text
+    // ref_datetime: is the reference date-time text, in the same format as the page dates
+    // results: array of npairs that is set to 1 if the date is newer than ref_datetime, 0 if it is not,
+    //          -1 if the infront_text is not on the page or -2 if the page could not be downloaded (or its text is too long)
+    // returns the number of dates that are newer than ref_datetime, or -1 if ref_datetime does not match the format
+
+    time_t reftime = 0;
+    int newer = 0;
+    int i, j;
+    if (!tiki_datetime_parse(parser, ref_datetime, &reftime)) {
+        TIKI_ERROR("webpage_datetimecheck_batch() failed: %s does not match the date-time format\n", ref_datetime);
+        return -1;
+    }
+    for (i = 0; i < npairs; i++) {
+        results[i] = -3;     /* not yet checked */
+    }
+    for (i = 0; i < npairs; i++) {
+        if (results[i] != -3) {
+            continue;        /* already checked along with an earlier pair for the same page */
+        }
+        // build the full wiki API URL - room for the longest domain, the API path and a page text of up to 200 characters
+        char API_URL[sizeof(session->domain) + sizeof("/api/wiki/page") + 200];
+        int urllen = snprintf(API_URL, sizeof(API_URL), "%s/api/wiki/page%s", session->domain, pages[i]);
+        TIKI_DEBUG(debug, "\n *** debug from webpage_datetimecheck_batch ...\n");
+        if (urllen < 0 || (size_t)urllen >= sizeof(API_URL)) {
+            // a cut short URL would ask for the wrong page, so none of the pairs for this page are checked
+            TIKI_ERROR("webpage_datetimecheck_batch() failed: page text %s is too long\n", pages[i]);
+            for (j = i; j < npairs; j++) {
+                if (results[j] == -3 && strcmp(pages[j], pages[i]) == 0) {
+                    results[j] = -2;
+                }
+            }
+            continue;
+        }
+        TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+        CURLcode res;
+        struct MemoryStruct memchunk;
+        memchunk_init(&memchunk, session);
+        res = webpage_fetch(debug, session, API_URL, &memchunk);
+        if (res != CURLE_OK) {
+            TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        }
+        for (j = i; j < npairs; j++) {
+            if (results[j] != -3 || strcmp(pages[j], pages[i]) != 0) {
+                continue;
+            }
+            if (res != CURLE_OK || memchunk.size == 0) {
+                results[j] = -2;
+            } else {
+                results[j] = datetime_pagecheck(debug, parser, memchunk.memory, infront_texts[j], datelen, reftime);
+            }
+            if (results[j] == 1) {
+                newer++;
+            }
+        }
+        memchunk_free(&memchunk);
+    }
+    return newer;
+}
+
+// ***************************************************************************************
+// streaming JSON scanner: picks the values of a few wanted keys (e.g. itemId or
+//  "fields") out of an API response as the bytes arrive from curl, so there is no
+//  need to search the whole response afterwards or to rely on fixed character
+//  offsets. The first occurrence of each key, at any depth, is used. It never
+//  allocates memory: only the start of each value is copied, and the byte offsets
+//  let a complete value be taken from the response when that is also being kept.
+// ***************************************************************************************
+static void json_scan_init(struct json_scan *scan, const char *marker)
+{
+    // marker: text (without any repeated leading characters) to be looked for anywhere in the response, or NULL
+    memset(scan, 0, sizeof(struct json_scan));
+    scan->marker = marker;
+    scan->lastkey = -1;
+    scan->capture = -1;
+}
+
+static void json_scan_want(struct json_scan *scan, const char *key)
+{
+    // key: the JSON key whose value is wanted from the response
+    if (scan->nwanted < TIKI_JSON_MAXKEYS) {
+        scan->wanted[scan->nwanted++].key = key;
+    }
+}
+
+static struct json_value* json_scan_value(struct json_scan *scan, const char *key)
+{
+    // returns the complete value that was scanned for key, or NULL if it was not found
+    int i;
+    for (i = 0; i < scan->nwanted; i++) {
+        if (scan->wanted[i].found && strcmp(scan->wanted[i].key, key) == 0) {
+            return &scan->wanted[i];
+        }
+    }
+    return NULL;
+}
+
+static void json_value_start(struct json_scan *scan, char captype, size_t start)
+{
+    scan->capture = scan->lastkey;
+    scan->lastkey = -1;
+    scan->captype = captype;
+    scan->capdepth = scan->depth;
+    scan->wanted[scan->capture].start = start;
+    scan->wanted[scan->capture].len = 0;
+}
+
+static void json_value_append(struct json_scan *scan, char c)
+{
+    if (scan->capture >= 0) {
+        struct json_value *value = &scan->wanted[scan->capture];
+        if (value->len < TIKI_JSON_VALUELEN - 1) {
+            value->text[value->len++] = c;
+        }
+    }
+}
+
+static void json_value_end(struct json_scan *scan, size_t end)
+{
+    struct json_value *value = &scan->wanted[scan->capture];
+    value->end = end;
+    value->text[value->len] = '\0';
+    value->found = 1;
+    scan->capture = -1;
+}
+
+static void json_scan_feed(struct json_scan *scan, const char *data, size_t len)
+{
+    // data, len: the next block of response bytes exactly as delivered by curl
+    size_t i;
+    int k;
+    for (i = 0; i < len; i++) {
+        char c = data[i];
+        size_t p = scan->pos++;
+
+        // look for the marker text anywhere in the response
+        if (scan->marker != NULL && !scan->markerfound) {
+            if (c == scan->marker[scan->markermatch]) {
+                scan->markermatch++;
+            } else {
+                scan->markermatch = (c == scan->marker[0]) ? 1 : 0;
+            }
+            if (scan->marker[scan->markermatch] == '\0') {
+                scan->markerfound = 1;
+            }
+        }
+
+        if (scan->instring) {
+            if (scan->escape) {
+                scan->escape = 0;
+            } else if (c == '\\') {
+                scan->escape = 1;
+            } else if (c == '"') {
+                scan->instring = 0;
+                if (scan->iskey) {
+                    // the key is complete so check if its value is wanted - keys inside a captured value are ignored
+                    scan->key[scan->keylen < TIKI_JSON_KEYLEN ? scan->keylen : 0] = '\0';
+                    scan->lastkey = -1;
+                    if (scan->capture < 0 && scan->keylen < TIKI_JSON_KEYLEN) {
+                        for (k = 0; k < scan->nwanted; k++) {
+                            if (!scan->wanted[k].found && strcmp(scan->wanted[k].key, scan->key) == 0) {
+                                scan->lastkey = k;
+                                break;
+                            }
+                        }
+                    }
+                    continue;
+                }
+                if (scan->capture >= 0 && scan->captype == '"') {
+                    json_value_end(scan, p);
+                    continue;
+                }
+            }
+            if (scan->iskey && scan->keylen < TIKI_JSON_KEYLEN) {
+                scan->key[scan->keylen++] = c;
+            }
+            json_value_append(scan, c);
+            continue;
+        }
+
+        // a number or literal (true, false, null) ends at the next delimiter
+        if (scan->capture >= 0 && scan->captype == 'n' &&
+            (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+            json_value_end(scan, p);
+        }
+
+        switch (c) {
+        case '"':
+            scan->instring = 1;
+            scan->iskey = scan->expectkey;
+            scan->keylen = 0;
+            if (!scan->iskey && scan->lastkey >= 0) {
+                json_value_start(scan, '"', p + 1);
+                continue;    // the opening quote is not part of the value
+            }
+            break;
+        case '{':
+        case '[':
+            if (scan->lastkey >= 0) {
+                json_value_start(scan, '{', p);
+            }
+            if (scan->depth < 64) {
+                if (c == '{') {
+                    scan->objects |= (1ULL << scan->depth);
+                } else {
+                    scan->objects &= ~(1ULL << scan->depth);
+                }
+            }
+            scan->depth++;
+            scan->expectkey = (c == '{');
+            break;
+        case '}':
+        case ']':
+            if (scan->depth > 0) {
+                scan->depth--;
+            }
+            scan->expectkey = 0;
+            if (scan->capture >= 0 && scan->captype == '{' && scan->depth == scan->capdepth) {
+                json_value_append(scan, c);
+                json_value_end(scan, p + 1);
+                continue;
+            }
+            break;
+        case ':':
+            scan->expectkey = 0;
+            break;
+        case ',':
+            scan->expectkey = (scan->depth > 0 && scan->depth <= 64 && (scan->objects & (1ULL << (scan->depth - 1))));
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default:
+            if (scan->lastkey >= 0) {
+                json_value_start(scan, 'n', p);
+            }
+            break;
+        }
+        json_value_append(scan, c);
+    }
+}
+
+
+// ***************************************************************************************
+// return a new copy of a complete scanned value: taken from the kept response when
+//  there is one, otherwise from the (possibly shortened) start of the value
+// ***************************************************************************************
+static char* json_value_copy(struct MemoryStruct *mem, struct json_value *value)
+{
+    if (mem->buffered && value->end <= mem->size && value->start <= value->end) {
+        char *s2 = (char*)malloc(value->end - value->start + 1);
+        if (s2 != NULL) {
+            memcpy(s2, mem->memory + value->start, value->end - value->start);
+            s2[value->end - value->start] = '\0';
+        }
+        return s2;
+    }
+    return copyString(value->text);
+}
+
+
+// ***************************************************************************************
+// the function below was originally taken from https://curl.se/libcurl/c/getinmemory.html
+//  for use in various other functions above and below - it now also feeds the streaming
+//  JSON scanner, can skip keeping the response when only the scanned values are needed
+//  and grows the memory by doubling (see memchunk_reserve above)
+// ***************************************************************************************
+static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+  size_t realsize = size * nmemb;
+  struct MemoryStruct *mem = (struct MemoryStruct *)userp;
+  /* pick out any wanted JSON values as the bytes arrive */
+  if (mem->scan != NULL) {
+    json_scan_feed(mem->scan, (const char *)contents, realsize);
+  }
+  /* look for the wanted texts as the bytes arrive - the rest of the page may not be needed */
+  if (mem->match != NULL && text_match_feed(mem->match, (const char *)contents, realsize) && mem->match->stop) {
+    mem->size += realsize;
+    return 0;
+  }
+  if (!mem->buffered) {
+    /* the response is not being kept, but its size is still counted */
+    mem->size += realsize;
+    return realsize;
+  }
+  /* grow the memory by doubling rather than by exactly this chunk */
+  if(!memchunk_reserve(mem, mem->size + realsize + 1)) {
+    /* out of memory! */
+    TIKI_WARN("not enough memory (realloc returned NULL)\n");
+    return 0;
+  }
+  memcpy(&(mem->memory[mem->size]), contents, realsize);
+  mem->size += realsize;
+  mem->memory[mem->size] = 0;
+  return realsize;
+}
+
+
+// ***************************************************************************************
+// the function below was taken 'as is' from https://curl.se/libcurl/c/sepheaders.html
+//  for use in various File gallery functions below
+// ***************************************************************************************
+static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream)
+{
+  size_t written = fwrite(ptr, size, nmemb, (FILE *)stream);
+  return written;
+}
+
+
+// *********************************************************************
+//  new tracker item post function - uses similar curl code as above and 
+//  borrows from https://curl.se/libcurl/c/simplepost.html
+// *********************************************************************
+char* tracker_itempost(int debug, const char* domain, char* access_token, const char* trackerId, const char* post_data)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // post_data: is a string containing the field data details of the new tracker item e.g
+    // returnstr is returned as a string to indicate the result and is the itemId of the new tracker item or an error message
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for tracker item post");
+    }
+    returnstr = tracker_itempost_session(debug, session, trackerId, post_data);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// *********************************************************************
+//  check the curl result of a new tracker item post and extract the new
+//  itemId# from the API response - shared by the blocking and the
+//  curl_multi (asynchronous) versions of the tracker item post
+// *********************************************************************
+static char* itempost_result(int debug, CURLcode res, struct MemoryStruct *memchunk)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // res: the result code from curl for the new tracker item post request
+    // memchunk: the API response collected by WriteMemoryCallback, with its scanned JSON values
+    char *returnstr = "";
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+         TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+         returnstr = copyString("curl access to the Tiki site for tracker item post failed");
+    } else if (memchunk->size == 0) {
+         TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+         returnstr = copyString("no response from the curl request sent to the server API");
+    } else {
+         /*
+         * the streaming JSON scanner has already picked the value of "itemId" out of the
+         * response as it arrived, so there is nothing to search for or crop here
+         */
+	     if (TIKI_DEBUGGING(debug))
+         { 
+             log_write(TIKI_LOG_DEBUG, "%lu bytes retrieved\n", (unsigned long)memchunk->size);
+             if (memchunk->buffered) {
+                 log_write(TIKI_LOG_DEBUG, "the full text response is: %s\n", memchunk->memory);
+             }
+         }
+         struct json_value *value = json_scan_value(memchunk->scan, "itemId");
+         if ( value != NULL )  {  // itemId value found!
+             returnstr = copyString(value->text);
+             TIKI_DEBUG(debug, "itemId value found is: %s\n", returnstr);
+         } else {
+             returnstr = copyString("itemId text not found");
+             TIKI_DEBUG(debug, "\n*** itemId text not found in response!! ***\n");
+             TIKI_DEBUG(debug, "returnstr set to                          : %s\n", returnstr);
+
+         }
+    }
+
+	return returnstr;
+}
+
+
+// *********************************************************************
+//  new tracker item post function using a persistent session
+// *********************************************************************
+char* tracker_itempost_session(int debug, tiki_session* session, const char* trackerId, const char* post_data)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // post_data: is a string containing the field data details of the new tracker item e.g
+    // returnstr is returned as a string to indicate the result and is the itemId of the new tracker item or an error message
+
+    char *returnstr = "";
+    // build the full tracker API URL
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, "/api/trackers/");
+    strcat(API_URL, trackerId);
+    strcat(API_URL, "/items");
+    TIKI_DEBUG(debug, "\n *** debug from tracker_itempost ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // POST to the tracker
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+    struct json_scan scan;
+    json_scan_init(&scan, NULL);
+    json_scan_want(&scan, "itemId");
+    memchunk.scan = &scan;        /* pick the new itemId out of the response as it arrives */
+    memchunk.buffered = TIKI_DEBUGGING(debug);    /* the full response is only kept if it is going to be logged */
+
+    CURL *curl_handle;
+    CURLcode res;
+    /* re-use the session's curl handle with its cached accept, Content-Type and access token headers */
+    curl_handle = session_request(session, API_URL, session->formchunk);
+    /* send all returned data to this function  */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    /* we pass our 'memchunk' struct to the callback function */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
+    /* pre-size the response memory from the Content-Length header */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&memchunk);
+
+    // set the post data - gzip compressed if the session compresses post data this size
+    session_postfields(session, curl_handle, post_data);
+
+    /* post it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_ITEMPOST);
+    transfer_account(curl_handle, TIKI_CALL_ITEMPOST, (long long)strlen(post_data), (long long)memchunk.size);
+
+    /* check for errors and extract the result */
+    returnstr = itempost_result(debug, res, &memchunk);
+
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "return string is: %s\n", returnstr);
+	return returnstr;
+}	
+
+
+// ****************************************************************************
+//  existing tracker item update function - uses similar curl code as above and 
+//  borrows from https://curl.se/libcurl/c/simplepost.html
+// ****************************************************************************
+char* tracker_itemupdate(int debug, const char* domain, char* access_token, const char* trackerId, const char* itemId, const char* post_data)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // itemId: is a string of the integer Id of the tracker item that is being updated
+    // post_data: is a string containing the updated field data details of the tracker item
+    // returnstr is returned as a string to indicate the result and is all the field data in a dictionary-like format or an error message
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for tracker item update");
+    }
+    returnstr = tracker_itemupdate_session(debug, session, trackerId, itemId, post_data);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// ****************************************************************************
+//  check the curl result of a tracker item update and extract the returned
+//  'mes' text from the API response - shared by the blocking and the
+//  curl_multi (asynchronous) versions of the tracker item update
+// ****************************************************************************
+static char* itemupdate_result(int debug, CURLcode res, struct MemoryStruct *memchunk)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // res: the result code from curl for the tracker item update request
+    // memchunk: the API response collected by WriteMemoryCallback, with its scanned JSON values
+    char *response = "";
+    char *returnstr = "";
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+         TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+         returnstr = copyString("curl access to the Tiki site for tracker item update failed");
+    } else if (memchunk->size == 0) {
+         TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+         returnstr = copyString("no response from the curl request sent to the server API");
+    } else {
+         /*
+         * the streaming JSON scanner has already checked for "Success" and picked out the
+         * "mes" array e.g. ["Item updated"] as the response arrived, so the message text
+         * is just the array without its surrounding brackets and quotes
+         */
+         TIKI_DEBUG(debug, "%lu bytes retrieved\n", (unsigned long)memchunk->size);
+         TIKI_DEBUG(debug, "the full text response is: %s\n", memchunk->memory);
+
+         struct json_value *value = json_scan_value(memchunk->scan, "mes");
+         if ( !memchunk->scan->markerfound )  {
+             returnstr = copyString("Success text not found");
+             TIKI_DEBUG(debug, "\n*** Success text not found in response!! ***\n");
+             TIKI_DEBUG(debug, "returnstr set to                            : %s\n", returnstr);
+
+         } else if ( value != NULL )  {  // "mes" value found!
+             response = json_value_copy(memchunk, value);
+             if (response == NULL) {
+                 returnstr = copyString("out of memory for the tracker item update response");
+             } else {
+                 // strip the [ " front characters and the " ] end characters to leave just the message text
+                 size_t len = strlen(response);
+                 if (len > 0 && response[len-1] == ']') {
+                     response[--len] = '\0';
+                 }
+                 if (len > 0 && response[len-1] == '"') {
+                     response[--len] = '\0';
+                 }
+                 size_t front = 0;
+                 if (front < len && response[front] == '[') {
+                     front++;
+                 }
+                 if (front < len && response[front] == '"') {
+                     front++;
+                 }
+                 returnstr = copyString(response + front);
+                 free(response);
+             }
+             TIKI_DEBUG(debug, "returnstr set to         : %s\n", returnstr);
+
+         } else {
+             returnstr = copyString("mes text not found");
+             TIKI_DEBUG(debug, "\n*** mes text not found in response!! ***\n");
+             TIKI_DEBUG(debug, "returnstr set to                            : %s\n", returnstr);
+
+         }
+    }
+
+	return returnstr;
+}
+
+
+// ****************************************************************************
+//  existing tracker item update function using a persistent session
+// ****************************************************************************
+char* tracker_itemupdate_session(int debug, tiki_session* session, const char* trackerId, const char* itemId, const char* post_data)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // itemId: is a string of the integer Id of the tracker item that is being updated
+    // post_data: is a string containing the updated field data details of the tracker item
+    // returnstr is returned as a string to indicate the result and is all the field data in a dictionary-like format or an error message
+    char *returnstr = "";
+    // build the full tracker API URL
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, "/api/trackers/");
+    strcat(API_URL, trackerId);
+    strcat(API_URL, "/items/");
+    strcat(API_URL, itemId);
+    TIKI_DEBUG(debug, "\n *** debug from tracker_itemupdate ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // POST data to the tracker
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+    struct json_scan scan;
+    json_scan_init(&scan, "Success");
+    json_scan_want(&scan, "mes");
+    memchunk.scan = &scan;        /* check for Success and pick the "mes" message out of the response as it arrives */
+    memchunk.buffered = 1;
+
+    CURL *curl_handle;
+    CURLcode res;
+    /* re-use the session's curl handle with its cached accept, Content-Type and access token headers */
+    curl_handle = session_request(session, API_URL, session->formchunk);
+    /* send all returned data to this function  */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    /* we pass our 'memchunk' struct to the callback function */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
+    /* pre-size the response memory from the Content-Length header */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&memchunk);
+
+    // set the post data - gzip compressed if the session compresses post data this size
+    session_postfields(session, curl_handle, post_data);
+
+    /* post it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_ITEMUPDATE);
+    transfer_account(curl_handle, TIKI_CALL_ITEMUPDATE, (long long)strlen(post_data), (long long)memchunk.size);
+
+    /* check for errors and extract the result */
+    returnstr = itemupdate_result(debug, res, &memchunk);
+
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "memchunk.memory freed, and ...\n");
+    TIKI_DEBUG(debug, "return string is: %s\n", returnstr);
+	return returnstr;
+}	
+
+// ********************************************************************************
+//  existing tracker item download function - much the same as tracker_itemupdate
+//   function, but just has an empty 'body' for the cURL and returns the "fields"
+//   section of the whole response
+// *******************************************************************************
+char* tracker_itemget(int debug, const char* domain, char* access_token, const char* trackerId, const char* itemId)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // itemId: is a string of the integer Id of the tracker item that is being downloaded
+    // returnstr is returned as a string to indicate the result and is all the field data in a dictionary-like format or an error message
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for tracker item download");
+    }
+    returnstr = tracker_itemget_session(debug, session, trackerId, itemId);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// ********************************************************************************
+//  check the curl result of a tracker item download and extract the "fields"
+//  section from the API response - shared by the blocking and the
+//  curl_multi (asynchronous) versions of the tracker item download
+// *******************************************************************************
+static char* itemget_result(int debug, CURLcode res, struct MemoryStruct *memchunk)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // res: the result code from curl for the tracker item download request
+    // memchunk: the API response collected by WriteMemoryCallback, with its scanned JSON values
+    char *returnstr = "";
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+         TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+         returnstr = copyString("curl access to the Tiki site for tracker item download failed");
+    } else if (memchunk->size == 0) {
+         TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+         returnstr = copyString("no response from the curl request sent to the server API");
+    } else {
+         /*
+         * the streaming JSON scanner has already checked for "Success" and found where
+         * the "fields" object starts and ends as the response arrived, so it is simply
+         * copied out of the response
+         */
+         TIKI_DEBUG(debug, "%lu bytes retrieved\n", (unsigned long)memchunk->size);
+         TIKI_DEBUG(debug, "the full text response is: %s\n", memchunk->memory);
+
+         struct json_value *value = json_scan_value(memchunk->scan, "fields");
+         if ( !memchunk->scan->markerfound )  {
+             TIKI_WARN("\n*** Success text not found in response!! ***\n\n");
+             returnstr = copyString("Success text not found");
+
+         } else if ( value != NULL )  {  // "fields" value found!
+             returnstr = json_value_copy(memchunk, value);
+             if (returnstr == NULL) {
+                 returnstr = copyString("out of memory for the tracker item download response");
+             }
+             TIKI_DEBUG(debug, "length of fields text is: %lu\n", (unsigned long)strlen(returnstr));
+             TIKI_DEBUG(debug, "returnstr set to         : %s\n", returnstr);
+
+         } else {
+             TIKI_WARN("\n*** fields text not found in response!! ***\n\n");
+             returnstr = copyString("fields text not found");
+             TIKI_DEBUG(debug, "returnstr set to              : %s\n", returnstr);
+
+         }
+    }
+
+	return returnstr;
+}
+
+
+// ********************************************************************************
+//  existing tracker item download function using a persistent session
+// *******************************************************************************
+char* tracker_itemget_session(int debug, tiki_session* session, const char* trackerId, const char* itemId)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // itemId: is a string of the integer Id of the tracker item that is being downloaded
+    // returnstr is returned as a string to indicate the result and is all the field data in a dictionary-like format or an error message
+    char *returnstr = "";
+    char* post_data = "";   // create an empty body so that POST is used
+    // build the full tracker API URL
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, "/api/trackers/");
+    strcat(API_URL, trackerId);
+    strcat(API_URL, "/items/");
+    strcat(API_URL, itemId);
+    TIKI_DEBUG(debug, "\n *** debug from tracker_itemget ...\n");
+    TIKI_DEBUG(debug, "API URL is: %s\n", API_URL);
+
+    // send data to the tracker API
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+    struct json_scan scan;
+    json_scan_init(&scan, "Success");
+    json_scan_want(&scan, "fields");
+    memchunk.scan = &scan;        /* check for Success and find the "fields" object in the response as it arrives */
+    memchunk.buffered = 1;
+
+    CURL *curl_handle;
+    CURLcode res;
+    /* re-use the session's curl handle with its cached accept, Content-Type and access token headers */
+    curl_handle = session_request(session, API_URL, session->formchunk);
+    /* send all returned data to this function  */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    /* we pass our 'memchunk' struct to the callback function */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
+    /* pre-size the response memory from the Content-Length header */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&memchunk);
+
+    // set the 'empty' post_data
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, post_data);
+
+    /* send it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_ITEMGET);
+    transfer_account(curl_handle, TIKI_CALL_ITEMGET, -1, (long long)memchunk.size);
+
+    /* check for errors and extract the result */
+    returnstr = itemget_result(debug, res, &memchunk);
+
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "memchunk.memory freed, and ...\n");
+    TIKI_DEBUG(debug, "return string is: %s\n", returnstr);
+	return returnstr;
+}	
+	
+
+
+// ********************************************************************************
+//  existing Tiki File gallery file download function 
+// *******************************************************************************
+char* gallery_filedownload(int debug, const char* domain, char* access_token, const char* fileId, const char* filespath, const char* bodyfilename, const char* headerfilename)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // fileId is Id of the file to be downloaded
+    // filespath is the folder path on the calling device where the downloaded file and the response header file are 
+    //    to be stored and should include both the first and last / character
+    /* both bodyfilename and headerfilename are passed parameters for file names in the path defined by filespath and  
+       where headerfilename is typically a temporary file on the calling device used for the response headers that would  
+       be overwritten with each use, and where bodyfilename can either be 'dictated' by the calling program to be a  
+       specific name or if left blank the 'body' i.e. the downloaded file will initially be stored under a temporary name  
+       then the actual file name is extracted from the response header file and the downloaded file is renamed */
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for File gallery file download");
+    }
+    returnstr = gallery_filedownload_session(debug, session, fileId, filespath, bodyfilename, headerfilename);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// ********************************************************************************
+//  existing Tiki File gallery file download function using a persistent session
+// *******************************************************************************
+char* gallery_filedownload_session(int debug, tiki_session* session, const char* fileId, const char* filespath, const char* bodyfilename, const char* headerfilename)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // fileId is Id of the file to be downloaded
+    // filespath is the folder path on the calling device where the downloaded file and the response header file are
+    //    to be stored and should include both the first and last / character
+    // bodyfilename and headerfilename are used exactly as for gallery_filedownload above
+
+    TIKI_DEBUG(debug, "\n\n");
+    TIKI_DEBUG(debug, "***************************************\n");
+    TIKI_DEBUG(debug, "*** debug from gallery_filedownload ...\n");
+    TIKI_DEBUG(debug, "***************************************\n\n");
+
+    char *returnstr = "";
+
+    // build the full file gallery API URL
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, "/api/galleries/");
+    strcat(API_URL, fileId);
+    strcat(API_URL, "/download");
+
+    // build the stored file paths + names
+    char download[100] = "";
+    strcat(download, filespath);
+    if (strlen(bodyfilename) == 0) {
+        strcat(download, "tempdownload");
+        TIKI_DEBUG(debug, "temporary download file name being used before renaming: tempdownload\n");
+    } else {
+        strcat(download, bodyfilename);
+        TIKI_DEBUG(debug, "dictated download file name being used: %s\n", bodyfilename);
+    }
+    char respheaders[100] = "";
+    strcat(respheaders, filespath);
+    strcat(respheaders, headerfilename);
+
+    TIKI_DEBUG(debug, "API URL is       : %s\n", API_URL);
+    TIKI_DEBUG(debug, "download filename: %s\n", download);
+    TIKI_DEBUG(debug, "headers filename : %s\n", respheaders);
+
+    // send data to the file gallery API
+
+    CURL *curl_handle;
+    CURLcode res;
+    /* re-use the session's curl handle with its cached Content-Type, accept and access token headers */
+    curl_handle = session_request(session, API_URL, session->formchunk);
+
+    /* no progress meter ! */
+    curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
+
+    /* send all returned data to this function  */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_data);
+
+    /* open the header file */
+    FILE *headerfile;
+    headerfile = fopen(respheaders, "w");
+    if(!headerfile) {     // if the file cannot be opened abort everything
+        returnstr = copyString("response header file location could not be opened");
+        return returnstr;
+    }
+
+    /* open the body file */
+    FILE *bodyfile;
+    bodyfile = fopen(download, "wb");  // use wb to allow binary
+    if(!bodyfile) {    // if the file cannot be opened so abort everything
+        fclose(headerfile);
+        returnstr = copyString("download file location could not be opened");
+        return returnstr;
+    }
+
+    /* we want the headers be written to this file handle */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, headerfile);
+ 
+    /* we want the body be written to this file handle instead of stdout */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, bodyfile);
+
+    /* get it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_FILEDOWNLOAD);
+    transfer_account(curl_handle, TIKI_CALL_FILEDOWNLOAD, -1, (long long)ftell(bodyfile));
+    /* close the header file */
+    fclose(headerfile);
+    /* close the body file */
+    fclose(bodyfile);
+    TIKI_DEBUG(debug, "header and body files written and closed\n");
+ 
+    /* check for errors */
+    if(res != CURLE_OK) {
+        TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        returnstr = copyString("curl access to the Tiki site for File gallery file download failed");
+    } else {
+        /*
+        * Now, check both the header and body files are OK and 
+        *  extract the Content-Disposition in the response header file 
+        *  if the passed bodyfilename is 'empty' 
+        */
+        long int headersize = 0;
+        headersize = findSize(respheaders);
+        if (headersize == -1) {
+            returnstr = copyString("header file size is zero or some other error");
+            TIKI_DEBUG(debug, "header file size is zero - aborting operation\n");
+            return returnstr;
+        }
+
+        TIKI_DEBUG(debug, "header file size: %ld\n", headersize);
+
+        long int bodysize = 0;
+        bodysize = findSize(download);
+        if (bodysize == -1) {
+            returnstr = copyString("body file size is zero or some other error");
+            TIKI_DEBUG(debug, "body file size is zero or some other error - aborting operation\n");
+            return returnstr;
+        }
+
+        TIKI_DEBUG(debug, "body file size: %ld\n", bodysize);
+
+        // now check if the download file should be renamed
+        if (strlen(bodyfilename) == 0) {    // a temporary file name has been used so it should be renamed
+
+            // now extract the actual file name from the response header file
+
+            // first reopen the header file for read only
+            headerfile = fopen(respheaders, "r");
+            if(!headerfile) {     // if the file cannot be opened abort the renaming
+                TIKI_DEBUG(debug, "couldn't reopen the response header file\n");
+
+                returnstr = concatString(download, " downloaded as header file could not be reopened");
+                return returnstr;
+               
+            } else {
+ 
+                // read the response header file line by line looking for content-disposition
+                char *respline = NULL;
+                char resp[200] = "";
+
+                while ( fgets(resp,180,headerfile) != NULL) {
+                    TIKI_DEBUG(debug, "line read from file is: %s\n", resp);
+                    respline = strstr(resp, "attachment");  // respline would now be the whole string from 'attachment' onwards if it is found
+                    if ( respline != NULL )  {  // not NULL so attachment found in the line so this is the content-disposition line!                    
+                        // now strip away some of the front 
+                        respline = strstr(respline, "=");  // respline now has ="filename"
+                        TIKI_DEBUG(debug, "1st cropped found text is: %s\n", respline);
+
+                        // now remove the first two =" characters
+                        removeString(respline, 0, 2);
+                        TIKI_DEBUG(debug, "2nd cropped found text is: %s\n", respline);
+
+                        // now remove everything from the final " character onwards
+                        char *ptr;
+                        ptr = strstr(respline, "\"");    // ptr is the pointer for " in 'respline'
+                        if (ptr != NULL) {
+                            *ptr = '\0';   // this makes the original " character the 'end of string' character
+                        }
+                        TIKI_DEBUG(debug, "3rd cropped found text is: %s\n", respline);
+                        break;  // as we have found the file name we can break the while loop
+                    } else {
+                        TIKI_DEBUG(debug, "text not found - reading next line\n");
+                    }
+                }  // continue with the while loop reading each line
+                fclose(headerfile);
+                if (respline == NULL) {    // no content-disposition line so keep the temporary file name
+                    respline = "tempdownload";
+                }
+
+                // once here we should now have the actual file name in respline
+                char newdownload[100] = "";
+                strcat(newdownload, filespath);
+                strcat(newdownload, respline);
+                TIKI_DEBUG(debug, "renaming the stored temporary download file\n");
+                TIKI_DEBUG(debug, "new file name is: %s\n", newdownload);
+
+                // now rename the temp file produced from the main download
+                rename(download, newdownload);
+                TIKI_DEBUG(debug, "download file renamed\n");
+                returnstr = concatString(newdownload, " downloaded OK");
+            }
+        } else {
+            returnstr = concatString(download, " downloaded OK");
+        }
+
+    }
+
+    /* the curl handle is kept by the session so there is nothing more to clean up */
+    TIKI_DEBUG(debug, "return string is: %s\n", returnstr);
+	return returnstr;
+}	
+	
+
+// ************************************************************************************
+// fill in the data part of a File gallery upload: from a file, which curl reads
+//  itself, or from memory through read/seek callbacks so that the data is fed
+//  straight from the caller's buffer rather than being copied by curl_mime_data
+// ************************************************************************************
+static size_t UploadReadCallback(char *buffer, size_t size, size_t nitems, void *arg)
+{
+    struct upload_data *data = (struct upload_data *)arg;
+    size_t len = size * nitems;
+    if (len > data->size - data->pos) {
+        len = data->size - data->pos;
+    }
+    memcpy(buffer, data->buffer + data->pos, len);
+    data->pos += len;
+    return len;
+}
+
+static int UploadSeekCallback(void *arg, curl_off_t offset, int origin)
+{
+    /* curl rewinds the data if the request has to be sent again, e.g. after a redirect */
+    struct upload_data *data = (struct upload_data *)arg;
+    if (origin != SEEK_SET || offset < 0 || (size_t)offset > data->size) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    data->pos = (size_t)offset;
+    return CURL_SEEKFUNC_OK;
+}
+
+static void upload_datapart(curl_mimepart *field, struct upload_data *data, const char *filename)
+{
+    // filename: the name sent with data from memory, which would otherwise not be taken as an uploaded file
+    if (data->filepath != NULL) {
+        curl_mime_filedata(field, data->filepath);
+    } else {
+        data->pos = 0;
+        curl_mime_data_cb(field, (curl_off_t)data->size, UploadReadCallback, UploadSeekCallback, NULL, data);
+        curl_mime_filename(field, (filename != NULL && strlen(filename) > 0) ? filename : "data");
+        curl_mime_type(field, "application/octet-stream");
+    }
+}
+
+
+// ************************************************************************************
+//  new file gallery file upload function that uses a multipart/form-data Content-type
+// ************************************************************************************
+char* gallery_fileupload(int debug, const char* domain, char* access_token, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // filepath: text string for the path/name of the file on the hub device to be uploaded
+    // galId: text string for the integer Id of the Tiki File gallery where the file is to be stored
+    // filename: text string of the just the name of the file without its ‘path’ details
+    // filetitle: text string of the short text File gallery title to be assigned to the file
+    // filedesc: text string of the longer text File gallery description to be assigned to the file
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for File gallery file upload");
+    }
+    returnstr = gallery_fileupload_session(debug, session, filepath, galId, filename, filetitle, filedesc);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// ************************************************************************************
+//  check the curl result of a File gallery file upload and extract the new fileId
+//   from the API response - shared by the blocking and the tiki_multi versions
+// ************************************************************************************
+static char* fileupload_result(int debug, CURLcode res, struct MemoryStruct *memchunk)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // res: the result code from curl for the upload request
+    // memchunk: the API response collected by WriteMemoryCallback, with its scanned JSON values
+    char *returnstr = "";
+
+    /* check for errors */
+    if(res != CURLE_OK) {
+         TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+         returnstr = copyString("curl access to the Tiki site for File gallery file upload failed");
+    } else if (memchunk->size == 0) {
+         TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
+         returnstr = copyString("no response from the curl request sent to the server API");
+    } else {
+         /*
+         * the streaming JSON scanner has already picked the value of the new "fileId"
+         * out of the response as it arrived, so there is nothing to search for or crop here
+         */
+	     if (TIKI_DEBUGGING(debug))
+         { 
+             log_write(TIKI_LOG_DEBUG, "%lu bytes retrieved\n", (unsigned long)memchunk->size);
+             if (memchunk->buffered) {
+                 log_write(TIKI_LOG_DEBUG, "the full text response is: %s\n", memchunk->memory);
+             }
+         }
+
+         // check that the upload went OK by looking for the value of "fileId"
+         struct json_value *value = json_scan_value(memchunk->scan, "fileId");
+
+         if ( value != NULL )  {  // "fileId" value found!
+             returnstr = copyString(value->text);
+             TIKI_DEBUG(debug, "returnstr set to         : %s\n", returnstr);
+
+         } else {
+             TIKI_WARN("\n*** fileId text not found in response!! ***\n\n");
+             returnstr = copyString("fileId text not found");
+             TIKI_DEBUG(debug, "returnstr set to              : %s\n", returnstr);
+
+         }
+
+    }
+
+
+	return returnstr;
+}
+
+
+// ************************************************************************************
+//  send a File gallery file upload, with the data part from a file or from memory
+// ************************************************************************************
+static char* fileupload_send(int debug, tiki_session* session, struct upload_data* data, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // data: where the file data comes from
+    // galId: text string for the integer Id of the Tiki File gallery where the file is to be stored
+    // filename: text string of the just the name of the file without its ‘path’ details
+    // filetitle: text string of the short text File gallery title to be assigned to the file
+    // filedesc: text string of the longer text File gallery description to be assigned to the file
+
+    TIKI_DEBUG(debug, "\n\n");
+    TIKI_DEBUG(debug, "***************************************\n");
+    TIKI_DEBUG(debug, "*** debug from gallery_fileupload ...\n");
+    TIKI_DEBUG(debug, "***************************************\n\n");
+
+    char *returnstr = "";
+    // build the full File gallery API URL
+	char API_URL[100] = "";
+    strcat(API_URL, session->domain);
+    strcat(API_URL, "/api/galleries/upload");
+
+	if (TIKI_DEBUGGING(debug))
+    {
+       log_write(TIKI_LOG_DEBUG, "API URL is  : %s\n", API_URL);
+       if (data->filepath != NULL) {
+           log_write(TIKI_LOG_DEBUG, "filepath is : %s\n", data->filepath);
+       } else {
+           log_write(TIKI_LOG_DEBUG, "data is     : %lu bytes in memory\n", (unsigned long)data->size);
+       }
+       log_write(TIKI_LOG_DEBUG, "galleryId is: %s\n", galId);
+       log_write(TIKI_LOG_DEBUG, "filename is : %s\n", filename);
+       log_write(TIKI_LOG_DEBUG, "filetitle is: %s\n", filetitle);
+       log_write(TIKI_LOG_DEBUG, "filedesc is : %s\n", filedesc);
+	}	
+
+    // send data to the galleries file upload API
+
+    // memory used to store the response text
+    struct MemoryStruct memchunk;
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+    struct json_scan scan;
+    json_scan_init(&scan, NULL);
+    json_scan_want(&scan, "fileId");
+    memchunk.scan = &scan;        /* pick the new fileId out of the response as it arrives */
+    memchunk.buffered = TIKI_DEBUGGING(debug);    /* the full response is only kept if it is going to be logged */
+
+    CURL *curl_handle;
+    CURLcode res;
+    curl_mime *form = NULL;
+    curl_mimepart *field = NULL;
+
+    /* re-use the session's curl handle with its cached Content-Type and access token headers */
+    curl_handle = session_request(session, API_URL, session->mimechunk);
+
+    /* Create the virtual multi part form */
+    form = curl_mime_init(curl_handle);
+
+    /* Fill in the file upload field */
+    field = curl_mime_addpart(form);
+    curl_mime_name(field, "data");
+    upload_datapart(field, data, filename);
+
+    field = curl_mime_addpart(form);
+    curl_mime_name(field, "galleryId");
+    curl_mime_data(field, galId, CURL_ZERO_TERMINATED);
+
+    field = curl_mime_addpart(form);
+    curl_mime_name(field, "name");
+    curl_mime_data(field, filename, CURL_ZERO_TERMINATED);
+
+    field = curl_mime_addpart(form);
+    curl_mime_name(field, "title");
+    curl_mime_data(field, filetitle, CURL_ZERO_TERMINATED);
+
+    field = curl_mime_addpart(form);
+    curl_mime_name(field, "description");
+    curl_mime_data(field, filedesc, CURL_ZERO_TERMINATED);
+
+    /* send all returned data to this function  */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+
+    /* we pass our 'memchunk' struct to the callback function */
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
+    /* pre-size the response memory from the Content-Length header */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&memchunk);
+
+    curl_easy_setopt(curl_handle, CURLOPT_MIMEPOST, form);
+
+    /* POST it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_FILEUPLOAD);
+    transfer_account(curl_handle, TIKI_CALL_FILEUPLOAD, -1, (long long)memchunk.size);
+    /* the form is specific to this request so free it now the handle is being kept */
+    curl_mime_free(form);
+
+    returnstr = fileupload_result(debug, res, &memchunk);
+
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "memchunk.memory freed, and ...\n");
+    TIKI_DEBUG(debug, "return string is: %s\n", returnstr);
+	return returnstr;
+}	
+	
+
+// ************************************************************************************
+//  new file gallery file upload function using a persistent session
+// ************************************************************************************
+char* gallery_fileupload_session(int debug, tiki_session* session, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // filepath: text string for the path/name of the file on the hub device to be uploaded
+    // galId: text string for the integer Id of the Tiki File gallery where the file is to be stored
+    // filename: text string of the just the name of the file without its ‘path’ details
+    // filetitle: text string of the short text File gallery title to be assigned to the file
+    // filedesc: text string of the longer text File gallery description to be assigned to the file
+
+    struct upload_data data;
+    memset(&data, 0, sizeof(data));
+    data.filepath = filepath;
+    return fileupload_send(debug, session, &data, galId, filename, filetitle, filedesc);
+}
+
+
+// ************************************************************************************
+//  File gallery file upload functions that take the file data from memory rather
+//   than from a file, so data already held in RAM (e.g. a camera frame, or a file
+//   mmap'd by the caller) is sent without being written to the SD card and read back
+// ************************************************************************************
+char* gallery_fileupload_buffer(int debug, const char* domain, char* access_token, const char* buffer, size_t size, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // buffer: the file data to be uploaded, which must stay unchanged until the function returns
+    // size: the number of bytes of file data in buffer
+    // galId, filename, filetitle and filedesc are used exactly as for gallery_fileupload - filename is also
+    //    sent as the name of the uploaded data
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for File gallery file upload");
+    }
+    returnstr = gallery_fileupload_buffer_session(debug, session, buffer, size, galId, filename, filetitle, filedesc);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+char* gallery_fileupload_buffer_session(int debug, tiki_session* session, const char* buffer, size_t size, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // the other parameters are used exactly as for gallery_fileupload_buffer
+
+    struct upload_data data;
+    memset(&data, 0, sizeof(data));
+    data.buffer = buffer;
+    data.size = size;
+    return fileupload_send(debug, session, &data, galId, filename, filetitle, filedesc);
+}
+
+
+// ************************************************************************************
+//  function to update an existing file gallery file upload function that uses 
+//  a multipart/form-data Content-type and can optionally update the file contents 
+//  or just update the parameters associated with the file
+// ************************************************************************************
+char* gallery_fileupdate(int debug, const char* domain, char* access_token, const char* fileId, const char* filepath, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // fileId: string text for the fileID# integer that is being updated
+    // filepath: string text for the full path-name of a file to replace the existing file - if left blank no change is made
+    // filename: string text to rename the file that is in Tiki - if left blank no change is made
+    // filetitle: string text to change the title of the file that is in Tiki - if left blank no change is made
+    // filedesc: string text to change the description of the file that is in Tiki - if left blank no change is made
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for File gallery file update");
+    }
+    returnstr = gallery_fileupdate_session(debug, session, fileId, filepath, filename, filetitle, filedesc);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+
+// ***************************************************************************
+// File gallery update deduplication: keeps the content hash of the last
+//  successful update of each file, so an update that would upload exactly the
+//  same contents (and name, title and description) again is skipped and the
+//  response to that earlier update is returned without anything being sent
+// ***************************************************************************
+void tiki_session_setdedup(tiki_session* session, const char* indexpath)
+{
+    // session: the session created by tiki_session_create
+    // indexpath: full path-name of the index file, which is read now (if it exists) and re-written after
+    //            every update that changes it - NULL frees the index and stops the deduplication
+
+    struct tiki_dedup *dedup = session->dedup;
+    int i;
+    if (dedup != NULL) {
+        for (i = 0; i < dedup->nentries; i++) {
+            free(dedup->entries[i].result);
+        }
+        free(dedup->entries);
+        free(dedup->indexpath);
+        free(dedup);
+        session->dedup = NULL;
+    }
+    if (indexpath == NULL) {
+        return;
+    }
+    dedup = calloc(1, sizeof(struct tiki_dedup));
+    if (dedup == NULL || (dedup->indexpath = strdup(indexpath)) == NULL) {
+        TIKI_ERROR("tiki_session_setdedup() failed: not enough memory\n");
+        free(dedup);
+        return;
+    }
+    session->dedup = dedup;
+
+    /* read the entries kept by earlier sessions - a damaged index just loses the entries from the damage on */
+    FILE *fp = fopen(indexpath, "rb");
+    if (fp == NULL) {
+        return;
+    }
+    char magic[16] = "";
+    char fileId[24];
+    unsigned long long hash;
+    unsigned long len;
+    if (fscanf(fp, "%15s", magic) != 1 || strcmp(magic, TIKI_DEDUP_MAGIC) != 0) {
+        TIKI_ERROR("File gallery update index %s is not a valid index and is ignored\n", indexpath);
+        fclose(fp);
+        return;
+    }
+    while (fscanf(fp, "%23s %llx %lu", fileId, &hash, &len) == 3 && fgetc(fp) == '\n') {
+        if (dedup->nentries == dedup->capacity) {
+            int capacity = (dedup->capacity == 0) ? 16 : dedup->capacity * 2;
+            struct dedup_entry *entries = realloc(dedup->entries, capacity * sizeof(struct dedup_entry));
+            if (entries == NULL) {
+                break;
+            }
+            dedup->entries = entries;
+            dedup->capacity = capacity;
+        }
+        char *result = malloc(len + 1);
+        if (result == NULL || fread(result, 1, len, fp) != len) {
+            free(result);
+            break;
+        }
+        result[len] = 0;
+        struct dedup_entry *entry = &dedup->entries[dedup->nentries++];
+        strcpy(entry->fileId, fileId);
+        entry->hash = hash;
+        entry->result = result;
+    }
+    fclose(fp);
+}
+
+
+// ***************************************************************************
+// 64-bit FNV-1a hash of everything an update would send, with the file
+//  contents read a chunk at a time rather than all at once - returns 0 if the
+//  file cannot be read, in which case the update is just sent as usual
+// ***************************************************************************
+static uint64_t dedup_hashbytes(uint64_t hash, const unsigned char *p, size_t len)
+{
+    const unsigned char *end = p + len;
+    for (; p < end; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int dedup_hash(struct upload_data *data, const char *filename, const char *filetitle, const char *filedesc, uint64_t *hash)
+{
+    uint64_t h = 14695981039346656037ULL;
+    unsigned char marker = (data != NULL);
+    h = dedup_hashbytes(h, &marker, 1);    /* a metadata-only update never matches one with contents */
+    if (data != NULL && data->filepath != NULL) {
+        FILE *fp = fopen(data->filepath, "rb");
+        if (fp == NULL) {
+            return 0;
+        }
+        unsigned char *chunk = malloc(TIKI_DEDUP_CHUNK);
+        size_t len;
+        if (chunk == NULL) {
+            fclose(fp);
+            return 0;
+        }
+        while ((len = fread(chunk, 1, TIKI_DEDUP_CHUNK, fp)) > 0) {
+            h = dedup_hashbytes(h, chunk, len);
+        }
+        int failed = ferror(fp);
+        free(chunk);
+        fclose(fp);
+        if (failed) {
+            return 0;
+        }
+    } else if (data != NULL) {
+        h = dedup_hashbytes(h, (const unsigned char *)data->buffer, data->size);
+    }
+    /* each text is hashed with its terminating 0 so that moving text between them changes the hash */
+    h = dedup_hashbytes(h, (const unsigned char *)filename, strlen(filename) + 1);
+    h = dedup_hashbytes(h, (const unsigned char *)filetitle, strlen(filetitle) + 1);
+    h = dedup_hashbytes(h, (const unsigned char *)filedesc, strlen(filedesc) + 1);
+    *hash = h;
+    return 1;
+}
+
+static struct dedup_entry* dedup_find(struct tiki_dedup *dedup, const char *fileId)
+{
+    int i;
+    for (i = 0; i < dedup->nentries; i++) {
+        if (strcmp(dedup->entries[i].fileId, fileId) == 0) {
+            return &dedup->entries[i];
+        }
+    }
+    return NULL;
+}
+
+
+// ***************************************************************************
+// re-write the whole index (it is small: one entry per file) to a temporary
+//  file that then replaces the old index, so a crash never leaves it torn
+// ***************************************************************************
+static void dedup_save(struct tiki_dedup *dedup)
+{
+    char tempname[310];
+    snprintf(tempname, sizeof(tempname), "%s.tmp", dedup->indexpath);
+    FILE *fp = fopen(tempname, "wb");
+    if (fp == NULL) {
+        TIKI_ERROR("File gallery update index: %s could not be written\n", tempname);
+        return;
+    }
+    int i;
+    fprintf(fp, "%s\n", TIKI_DEDUP_MAGIC);
+    for (i = 0; i < dedup->nentries; i++) {
+        struct dedup_entry *entry = &dedup->entries[i];
+        fprintf(fp, "%s %016llx %lu\n%s\n", entry->fileId, (unsigned long long)entry->hash,
+                (unsigned long)strlen(entry->result), entry->result);
+    }
+    if (fclose(fp) != 0 || rename(tempname, dedup->indexpath) != 0) {
+        TIKI_ERROR("File gallery update index: %s could not be written\n", dedup->indexpath);
+        remove(tempname);
+    }
+}
+
+static void dedup_store(struct tiki_dedup *dedup, const char *fileId, uint64_t hash, const char *result)
+{
+    // result: the response to a successful update, or NULL to forget the file after a failed update,
+    //         which may or may not have changed it
+    struct dedup_entry *entry = dedup_find(dedup, fileId);
+    if (entry == NULL && (result == NULL || strlen(fileId) >= sizeof(entry->fileId))) {
+        return;
+    }
+    if (result == NULL) {
+        free(entry->result);
+        *entry = dedup->entries[--dedup->nentries];
+        dedup_save(dedup);
+        return;
+    }
+    char *copy = strdup(result);
+    if (copy == NULL) {
+        return;
+    }
+    if (entry == NULL) {
+        if (dedup->nentries == dedup->capacity) {
+            int capacity = (dedup->capacity == 0) ? 16 : dedup->capacity * 2;
+            struct dedup_entry *entries = realloc(dedup->entries, capacity * sizeof(struct dedup_entry));
+            if (entries == NULL) {
+                free(copy);
+                return;
+            }
+            dedup->entries = entries;
+            dedup->capacity = capacity;
+        }
+        entry = &dedup->entries[dedup->nentries++];
+        strcpy(entry->fileId, fileId);
+    } else {
+        free(entry->result);
+    }
+    entry->hash = hash;
+    entry->result = copy;
+    dedup_save(dedup);
 }
 
 
-// *********************************************************************
-//  new tracker item post function - uses similar curl code as above and 
-//  borrows from https://curl.se/libcurl/c/simplepost.html
-// *********************************************************************
-char* tracker_itempost(int debug, const char* domain, char* access_token, const char* trackerId, const char* post_data)
+// ************************************************************************************
+//  send a File gallery file update, with new file contents from a file or from memory
+// ************************************************************************************
+static char* fileupdate_send(int debug, tiki_session* session, const char* fileId, struct upload_data* data, const char* filename, const char* filetitle, const char* filedesc)
 {
-    // debug: if set to 1 this produces (lots!!) of additional output
-    // domain: string used for the main URL text that must include https:// but no trailing /
-    // access_token: the API access token that enables specific permissions for the API usage
-    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
-    // post_data: is a string containing the field data details of the new tracker item e.g
-    // returnstr is returned as a string to indicate the result and is the itemId of the new tracker item or an error message
+    // data: where the new file contents come from, or NULL if they are not being changed
+
+    TIKI_DEBUG(debug, "\n\n");
+    TIKI_DEBUG(debug, "***************************************\n");
+    TIKI_DEBUG(debug, "*** debug from gallery_fileupdate ...\n");
+    TIKI_DEBUG(debug, "***************************************\n\n");
 
-    char *itemId = "";
     char *returnstr = "";
-    // build the full tracker API URL
+    // build the full File gallery API URL
 	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, "/api/trackers/");
-    strcat(API_URL, trackerId);
-    strcat(API_URL, "/items");
-	if (debug==1)
+    strcat(API_URL, session->domain);
+    strcat(API_URL, "/api/galleries/files/");
+    strcat(API_URL, fileId);
+    strcat(API_URL, "/update");
+
+	if (TIKI_DEBUGGING(debug))
     {
-       printf ("\n *** debug from tracker_itempost ...\n");
-       printf ("API URL is: %s\n", API_URL);
+       log_write(TIKI_LOG_DEBUG, "API URL is  : %s\n", API_URL);
+       log_write(TIKI_LOG_DEBUG, "fileId is: %s\n", fileId);
+       if (data == NULL) {
+           log_write(TIKI_LOG_DEBUG, "file contents are not being changed\n");
+       } else if (data->filepath != NULL) {
+           log_write(TIKI_LOG_DEBUG, "filepath is : %s\n", data->filepath);
+       } else {
+           log_write(TIKI_LOG_DEBUG, "data is     : %lu bytes in memory\n", (unsigned long)data->size);
+       }
+       log_write(TIKI_LOG_DEBUG, "filename is : %s\n", filename);
+       log_write(TIKI_LOG_DEBUG, "filetitle is: %s\n", filetitle);
+       log_write(TIKI_LOG_DEBUG, "filedesc is : %s\n", filedesc);
 	}	
 
-    // POST to the tracker
+    // skip the update if it would send exactly what the last successful update of this file sent
+    uint64_t hash = 0;
+    int hashed = 0;
+    if (session->dedup != NULL) {
+        hashed = dedup_hash(data, filename, filetitle, filedesc, &hash);
+        struct dedup_entry *entry = hashed ? dedup_find(session->dedup, fileId) : NULL;
+        if (entry != NULL && entry->hash == hash) {
+            TIKI_DEBUG(debug, "file is unchanged since its last update (hash %016llx) so nothing is sent\n", (unsigned long long)hash);
+            return copyString(entry->result);
+        }
+    }
+
+    // send data to the galleries file update API
+    int updated = 0;
+
+    // memory used to store the response text
     struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;            /* no data at this point */
+    memchunk_init(&memchunk, session);   /* re-uses the session's kept response memory if there is any */
+    struct json_scan scan;
+    json_scan_init(&scan, NULL);
+    json_scan_want(&scan, "fileId");
+    memchunk.scan = &scan;        /* check for a "fileId" key in the response as it arrives */
+    memchunk.buffered = 1;        /* the whole response is returned */
 
     CURL *curl_handle;
     CURLcode res;
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-    /* specify URL to get */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
+    curl_mime *form = NULL;
+    curl_mimepart *field = NULL;
+
+    /* re-use the session's curl handle with its cached Content-Type and access token headers */
+    curl_handle = session_request(session, API_URL, session->mimechunk);
+
+    /* Create the virtual multi part form */
+    form = curl_mime_init(curl_handle);
+
+    /* Fill in the file upload field but only if it has been set*/
+    if (data != NULL) {
+        TIKI_DEBUG(debug, "file contents is being updated\n");
+        field = curl_mime_addpart(form);
+        curl_mime_name(field, "data");
+        upload_datapart(field, data, filename);
+    } else {
+        TIKI_DEBUG(debug, "file contents are NOT being updated\n");
+    }
+
+    /* Fill in the file name field but only if it has been set*/
+    //  it should be noted that if the file name is changed but
+    //  the file title is not explcitly set below, the title will 
+    //  still be changed to text similar to the new name
+    if (strlen(filename) > 0) {
+        TIKI_DEBUG(debug, "file name is being updated\n");
+        field = curl_mime_addpart(form);
+        curl_mime_name(field, "name");
+        curl_mime_data(field, filename, CURL_ZERO_TERMINATED);
+    } else {
+        TIKI_DEBUG(debug, "file name is NOT being updated\n");
+    }
+    /* Fill in the file title field but only if it has been set*/
+    if (strlen(filetitle) > 0) {
+        TIKI_DEBUG(debug, "file title is being updated\n");
+        field = curl_mime_addpart(form);
+        curl_mime_name(field, "title");
+        curl_mime_data(field, filetitle, CURL_ZERO_TERMINATED);
+    } else {
+        TIKI_DEBUG(debug, "file title is NOT being updated\n");
+    }
+
+    /* Fill in the file description field but only if it has been set*/
+    if (strlen(filedesc) > 0) {
+        TIKI_DEBUG(debug, "file description is being updated\n");
+        field = curl_mime_addpart(form);
+        curl_mime_name(field, "description");
+        curl_mime_data(field, filedesc, CURL_ZERO_TERMINATED);
+    } else {
+        TIKI_DEBUG(debug, "file description is NOT being updated\n");
+    }
+
     /* send all returned data to this function  */
     curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+
     /* we pass our 'memchunk' struct to the callback function */
     curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    /* pre-size the response memory from the Content-Length header */
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&memchunk);
 
-    // set the custom headers 
-    struct curl_slist *headchunk = NULL;
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the Content-Type header */
-    headchunk = curl_slist_append(headchunk, "Content-Type: application/x-www-form-urlencoded");
-    // Add the authorization access token header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
+    curl_easy_setopt(curl_handle, CURLOPT_MIMEPOST, form);
 
-    // set the post data
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, post_data);
-    // if we do not provide POSTFIELDSIZE, libcurl will strlen() by itself 
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)strlen(post_data));
+    /* POST it! */
+    res = session_perform(session, curl_handle, TIKI_CALL_FILEUPDATE);
+    transfer_account(curl_handle, TIKI_CALL_FILEUPDATE, -1, (long long)memchunk.size);
+    /* the form is specific to this request so free it now the handle is being kept */
+    curl_mime_free(form);
 
-    /* post it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
     /* check for errors */
     if(res != CURLE_OK) {
-         fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-         returnstr = copyString("curl access to the Tiki site for tracker item post failed");
+         TIKI_ERROR("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+         returnstr = copyString("curl access to the Tiki site for File gallery file update failed");
     } else if (memchunk.size == 0) {
-         printf("the curl request may have been processed BUT there was no response from the server API\n");
+         TIKI_WARN("the curl request may have been processed BUT there was no response from the server API\n");
          returnstr = copyString("no response from the curl request sent to the server API");
     } else {
          /*
          * Now, our memchunk.memory points to a memory block that is memchunk.size
-         * bytes big and contains the response text from the API.
-         *
-         * the code below extracts the new tracker itemId# from the memory block so it can be returned
+         * bytes big and contains the returned text from the API, which what is returned
          */
-	     if (debug==1)
-         { 
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full text response is: %s\n", memchunk.memory);
-         }
-         itemId = strstr(memchunk.memory, "itemId");        // itemId should now be the whole string from the 'itemId' text onwards
-         if ( itemId != NULL )  {  // itemId string found!
-             // now strip away everything from a comma to the end of the string
-             char *ptr;
-             ptr = strchr(itemId, ',');
-             if (ptr != NULL) {
-                 *ptr = '\0';
-             }
-	         if (debug==1)
-             {
-                 printf ("1st cropped found text is: %s\n", itemId);
-             }
+         TIKI_DEBUG(debug, "%lu bytes retrieved\n", (unsigned long)memchunk.size);
+         TIKI_DEBUG(debug, "the full text response is: %s\n", memchunk.memory);
+
+         // first of all check that the update went OK by looking for a "fileId" key in the response
+         if ( json_scan_value(&scan, "fileId") != NULL )  {  // "fileId" value found! so we did a successful update
+             TIKI_DEBUG(debug, "fileId found! So update was successful\n");
+
+             returnstr = copyString(memchunk.memory);
+             TIKI_DEBUG(debug, "returnstr set to memchunk.memory\n");
+             updated = 1;
 
-             // the line of code below now removes the first 8 characters i.e. 'itemId":' leaving just the integer value
-             //  only 8 cahracters are removed because an itemId is always an integer so is never surrounded in quote characters
-             removeString(itemId, 0, 8);
-	         if (debug==1)
-             {
-                 printf ("2nd cropped found text is: %s\n", itemId);
-             }
-             returnstr = copyString(itemId);
          } else {
-             returnstr = copyString("itemId text not found");
-	         if (debug==1)
-             {
-                 printf ("\n*** itemId text not found in response!! ***\n");
-                 printf ("full original tracker post API response is: %s\n", memchunk.memory);
-                 printf ("returnstr set to                          : %s\n", returnstr);
-             }
+             TIKI_WARN("\n*** fileId text not found in response!! ***\n\n");
+             returnstr = copyString("fileId text not found - so update was not successful");
+             TIKI_DEBUG(debug, "full response text is: %s\n", memchunk.memory);
+             TIKI_DEBUG(debug, "returnstr set to     : %s\n", returnstr);
 
          }
+
     }
 
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-    free(memchunk.memory);
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-	if (debug==1)
-    {
-        printf ("return string is: %s\n", returnstr);
+    /* a failed update may still have changed the file, so it is only skipped again after another successful update */
+    if (hashed) {
+        dedup_store(session->dedup, fileId, hash, updated ? memchunk.memory : NULL);
     }
+
+    /* the curl handle is kept by the session, so just free (or give back to the session) the response memory */
+    memchunk_free(&memchunk);
+    TIKI_DEBUG(debug, "memchunk.memory freed, and ...\n");
 	return returnstr;
-}	
+}
 
 
-// ****************************************************************************
-//  existing tracker item update function - uses similar curl code as above and 
-//  borrows from https://curl.se/libcurl/c/simplepost.html
-// ****************************************************************************
-char* tracker_itemupdate(int debug, const char* domain, char* access_token, const char* trackerId, const char* itemId, const char* post_data)
+// ************************************************************************************
+//  function to update an existing file gallery file using a persistent session
+// ************************************************************************************
+char* gallery_fileupdate_session(int debug, tiki_session* session, const char* fileId, const char* filepath, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // fileId: string text for the fileID# integer that is being updated
+    // filepath: string text for the full path-name of a file to replace the existing file - if left blank no change is made
+    // filename: string text to rename the file that is in Tiki - if left blank no change is made
+    // filetitle: string text to change the title of the file that is in Tiki - if left blank no change is made
+    // filedesc: string text to change the description of the file that is in Tiki - if left blank no change is made
+
+    struct upload_data data;
+    memset(&data, 0, sizeof(data));
+    data.filepath = filepath;
+    return fileupdate_send(debug, session, fileId, (strlen(filepath) > 0) ? &data : NULL, filename, filetitle, filedesc);
+}
+
+
+// ************************************************************************************
+//  File gallery file update functions that replace the file contents with data
+//   from memory rather than from a file
+// ************************************************************************************
+char* gallery_fileupdate_buffer(int debug, const char* domain, char* access_token, const char* fileId, const char* buffer, size_t size, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // fileId: string text for the fileID# integer that is being updated
+    // buffer: the new file data, which must stay unchanged until the function returns
+    // size: the number of bytes of file data in buffer
+    // filename, filetitle and filedesc are used exactly as for gallery_fileupdate
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for File gallery file update");
+    }
+    returnstr = gallery_fileupdate_buffer_session(debug, session, fileId, buffer, size, filename, filetitle, filedesc);
+    tiki_session_destroy(session);
+	return returnstr;
+}
+
+char* gallery_fileupdate_buffer_session(int debug, tiki_session* session, const char* fileId, const char* buffer, size_t size, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // the other parameters are used exactly as for gallery_fileupdate_buffer
+
+    struct upload_data data;
+    memset(&data, 0, sizeof(data));
+    data.buffer = buffer;
+    data.size = size;
+    return fileupdate_send(debug, session, fileId, &data, filename, filetitle, filedesc);
+}
+
+
+// ***************************************************************************
+// asynchronous multi-request engine: tracker item post/update/get operations
+//  are queued on a tiki_multi and run concurrently through one curl_multi
+//  handle, so a hub cycle of many posts takes about as long as the slowest
+//  request rather than the sum of all of them
+// curl code based upon https://curl.se/libcurl/c/multi-app.html
+// ***************************************************************************
+tiki_multi* tiki_multi_create(int debug, const char* domain, char* access_token, int max_inflight)
 {
     // debug: if set to 1 this produces (lots!!) of additional output
     // domain: string used for the main URL text that must include https:// but no trailing /
     // access_token: the API access token that enables specific permissions for the API usage
+    // max_inflight: the most requests that are sent at the same time - if less than 1 then 1 is used
+    // returns a pointer to the new multi-request engine or NULL if it could not be created
+
+    if (max_inflight < 1) {
+        max_inflight = 1;
+    }
+    tiki_multi *multi = calloc(1, sizeof(tiki_multi));
+    if (multi == NULL) {
+        TIKI_ERROR("tiki_multi_create() failed: not enough memory\n");
+        return NULL;
+    }
+    /* urgent requests can take the number in flight to twice max_inflight */
+    multi->idle = calloc(2 * max_inflight, sizeof(CURL *));
+    multi->session = tiki_session_create(debug, domain, access_token);
+    if (multi->idle == NULL || multi->session == NULL) {
+        TIKI_ERROR("tiki_multi_create() failed: session could not be created\n");
+        tiki_session_destroy(multi->session);
+        free(multi->idle);
+        free(multi);
+        return NULL;
+    }
+    multi->debug = debug;
+    multi->max_inflight = max_inflight;
+    multi->nextId = 1;
+    multi->priority = TIKI_PRIORITY_BYCALL;
+
+    multi->multi_handle = curl_multi_init();
+    /* multiplex the requests over one HTTP/2 connection when the server supports it */
+    curl_multi_setopt(multi->multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    /* otherwise allow up to one HTTP/1.1 keep-alive connection per request in flight, urgent ones included */
+    curl_multi_setopt(multi->multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long)(2 * max_inflight));
+
+    TIKI_DEBUG(debug, "\n *** debug from tiki_multi_create ...\n");
+    TIKI_DEBUG(debug, "multi-request engine created with up to %d requests in flight\n", max_inflight);
+    return multi;
+}
+
+
+// ***************************************************************************
+// set the function called as each queued operation completes: if no callback
+//  is set the results are kept until they are collected with tiki_multi_poll
+// ***************************************************************************
+void tiki_multi_setcallback(tiki_multi* multi, tiki_multi_callback callback, void* userdata)
+{
+    // callback: called with the opId and the result text - the result is only valid during the call
+    // userdata: passed unchanged to each call of the callback
+    multi->callback = callback;
+    multi->userdata = userdata;
+}
+
+
+// ***************************************************************************
+// set a cancel handle on the engine: when it is triggered the queued
+//  operations fail as they are started and those in flight are aborted
+// ***************************************************************************
+void tiki_multi_setcancel(tiki_multi* multi, tiki_cancel* cancel)
+{
+    // cancel: the cancel handle made by tiki_cancel_create, or NULL for none
+    // a tiki_multi_perform that is waiting for network activity notices within about a second - or at
+    //  once if tiki_multi_wakeup is called after tiki_cancel_trigger
+    tiki_session_setcancel(multi->session, cancel);
+}
+
+
+// ***************************************************************************
+// set the priority class of the operations submitted from now on: queued
+//  operations are started highest class first, urgent ones are started even
+//  beyond max_inflight, and the bulk transfers in flight are paused while any
+//  urgent operation is
+// ***************************************************************************
+void tiki_multi_setpriority(tiki_multi* multi, int priority)
+{
+    // priority: 0 urgent, 1 normal or 2 bulk, or -1 (the default) for File gallery transfers to be bulk and
+    //  the tracker operations normal - e.g. set 0, queue an alarm status update and set -1 again
+    multi->priority = (priority >= TIKI_PRIORITY_URGENT && priority <= TIKI_PRIORITY_BULK) ? priority : TIKI_PRIORITY_BYCALL;
+}
+
+
+// ***************************************************************************
+// add an operation to the end of its class's queue - it is started by
+//  tiki_multi_perform. Returns the operation or NULL if it could not be queued
+// ***************************************************************************
+static struct tiki_multi_op* multi_submit(tiki_multi* multi, int optype, const char* API_URL, const char* post_data)
+{
+    struct tiki_multi_op *op = calloc(1, sizeof(struct tiki_multi_op));
+    if (op == NULL) {
+        return NULL;
+    }
+    if (strlen(API_URL) >= sizeof(op->API_URL)) {
+        free(op);
+        return NULL;
+    }
+    strcpy(op->API_URL, API_URL);
+    op->post_data = copyString((char *)post_data);
+    op->optype = optype;
+    op->opId = multi->nextId++;
+    op->priority = request_priority(multi->priority, optype == TIKI_MULTI_FILEDOWNLOAD || optype == TIKI_MULTI_FILEUPLOAD);
+    op->queued_us = bucket_now_us();
+
+    int p = op->priority;
+    if (multi->queue_tail[p] == NULL) {
+        multi->queue_head[p] = op;
+    } else {
+        multi->queue_tail[p]->next = op;
+    }
+    multi->queue_tail[p] = op;
+    multi->queued++;
+    TIKI_DEBUG(multi->debug, "\n *** debug from tiki_multi ...\n");
+    TIKI_DEBUG(multi->debug, "operation %d queued as %s for API URL: %s\n", op->opId, stats_priorities[p], op->API_URL);
+    return op;
+}
+
+
+// ***************************************************************************
+// queue a new tracker item post - returns the opId of the operation or -1
+// ***************************************************************************
+int tiki_multi_itempost(tiki_multi* multi, const char* trackerId, const char* post_data)
+{
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // post_data: is a string containing the field data details of the new tracker item
+    // the result passed to the callback or tiki_multi_poll is the same as for tracker_itempost
+    char API_URL[200] = "";
+    snprintf(API_URL, sizeof(API_URL), "%s/api/trackers/%s/items", multi->session->domain, trackerId);
+    struct tiki_multi_op *op = multi_submit(multi, TIKI_MULTI_ITEMPOST, API_URL, post_data);
+    return (op != NULL) ? op->opId : -1;
+}
+
+
+// ***************************************************************************
+// queue an existing tracker item update - returns the opId of the operation or -1
+// ***************************************************************************
+int tiki_multi_itemupdate(tiki_multi* multi, const char* trackerId, const char* itemId, const char* post_data)
+{
     // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
     // itemId: is a string of the integer Id of the tracker item that is being updated
     // post_data: is a string containing the updated field data details of the tracker item
-    // returnstr is returned as a string to indicate the result and is all the field data in a dictionary-like format or an error message
-    char *response = "";
-    char *returnstr = "";
-    // build the full tracker API URL
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, "/api/trackers/");
-    strcat(API_URL, trackerId);
-    strcat(API_URL, "/items/");
-    strcat(API_URL, itemId);
-	if (debug==1)
-    {
-       printf ("\n *** debug from tracker_itemupdate ...\n");
-       printf ("API URL is: %s\n", API_URL);
-	}	
+    // the result passed to the callback or tiki_multi_poll is the same as for tracker_itemupdate
+    char API_URL[200] = "";
+    snprintf(API_URL, sizeof(API_URL), "%s/api/trackers/%s/items/%s", multi->session->domain, trackerId, itemId);
+    struct tiki_multi_op *op = multi_submit(multi, TIKI_MULTI_ITEMUPDATE, API_URL, post_data);
+    return (op != NULL) ? op->opId : -1;
+}
 
-    // POST data to the tracker
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;            /* no data at this point */
 
-    CURL *curl_handle;
-    CURLcode res;
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-    /* specify URL to get */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
-    /* send all returned data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+// ***************************************************************************
+// queue an existing tracker item download - returns the opId of the operation or -1
+// ***************************************************************************
+int tiki_multi_itemget(tiki_multi* multi, const char* trackerId, const char* itemId)
+{
+    // trackerId: is a string of the integer Id of the tracker
+    // itemId: is a string of the integer Id of the tracker item that is being downloaded
+    // the result passed to the callback or tiki_multi_poll is the same as for tracker_itemget
+    char API_URL[200] = "";
+    snprintf(API_URL, sizeof(API_URL), "%s/api/trackers/%s/items/%s", multi->session->domain, trackerId, itemId);
+    struct tiki_multi_op *op = multi_submit(multi, TIKI_MULTI_ITEMGET, API_URL, "");
+    return (op != NULL) ? op->opId : -1;
+}
 
-    // set the custom headers 
-    struct curl_slist *headchunk = NULL;
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the Content-Type header */
-    headchunk = curl_slist_append(headchunk, "Content-Type: application/x-www-form-urlencoded");
-    // Add the authorization access token header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
 
-    // set the post data
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, post_data);
-    // if we do not provide POSTFIELDSIZE, libcurl will strlen() by itself 
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)strlen(post_data));
+// ***************************************************************************
+// queue a File gallery file download - returns the opId of the operation or -1
+// ***************************************************************************
+int tiki_multi_filedownload(tiki_multi* multi, const char* fileId, const char* filespath, const char* bodyfilename)
+{
+    // fileId is Id of the file to be downloaded
+    // filespath is the folder path on the calling device where the downloaded file is to be stored and should
+    //    include both the first and last / character
+    // bodyfilename dictates the stored file name, or if left blank the file name is taken from the Content-Disposition
+    //    response header (or is tempdownload followed by the fileId if there is none) - either way the file is
+    //    written straight to its final name as it arrives
+    // the result passed to the callback or tiki_multi_poll is the same as for gallery_filedownload
+    char API_URL[200] = "";
+    if (strlen(fileId) >= sizeof(((struct file_download *)0)->fileId) || strlen(filespath) >= sizeof(((struct file_download *)0)->filespath)
+        || strlen(bodyfilename) >= sizeof(((struct file_download *)0)->filename)) {
+        TIKI_ERROR("tiki_multi_filedownload() failed: fileId, filespath or bodyfilename is too long\n");
+        return -1;
+    }
+    snprintf(API_URL, sizeof(API_URL), "%s/api/galleries/%s/download", multi->session->domain, fileId);
+    struct tiki_multi_op *op = multi_submit(multi, TIKI_MULTI_FILEDOWNLOAD, API_URL, "");
+    if (op == NULL) {
+        return -1;
+    }
+    struct file_download *download = &op->download;
+    strcpy(download->fileId, fileId);
+    strcpy(download->filespath, filespath);
+    strcpy(download->filename, bodyfilename);
+    download->dictated = (strlen(bodyfilename) > 0);
+    return op->opId;
+}
 
-    /* post it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-         fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-         returnstr = copyString("curl access to the Tiki site for tracker item update failed");
-    } else if (memchunk.size == 0) {
-         printf("the curl request may have been processed BUT there was no response from the server API\n");
-         returnstr = copyString("no response from the curl request sent to the server API");
+
+// ***************************************************************************
+// queue a File gallery file upload - returns the opId of the operation or -1
+// ***************************************************************************
+int tiki_multi_fileupload(tiki_multi* multi, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+{
+    // filepath: text string for the path/name of the file on the hub device to be uploaded
+    // galId: text string for the integer Id of the Tiki File gallery where the file is to be stored
+    // filename: text string of the just the name of the file without its ‘path’ details
+    // filetitle: text string of the short text File gallery title to be assigned to the file
+    // filedesc: text string of the longer text File gallery description to be assigned to the file
+    // the file is read as it is sent, so it must be left in place until the operation completes
+    // the result passed to the callback or tiki_multi_poll is the same as for gallery_fileupload
+    char API_URL[200] = "";
+    if (strlen(filepath) >= sizeof(((struct file_upload *)0)->filepath) || strlen(galId) >= sizeof(((struct file_upload *)0)->galId)
+        || strlen(filename) >= sizeof(((struct file_upload *)0)->filename)) {
+        TIKI_ERROR("tiki_multi_fileupload() failed: filepath, galId or filename is too long\n");
+        return -1;
+    }
+    snprintf(API_URL, sizeof(API_URL), "%s/api/galleries/upload", multi->session->domain);
+    struct tiki_multi_op *op = multi_submit(multi, TIKI_MULTI_FILEUPLOAD, API_URL, "");
+    if (op == NULL) {
+        return -1;
+    }
+    struct file_upload *upload = &op->upload;
+    strcpy(upload->filepath, filepath);
+    strcpy(upload->galId, galId);
+    strcpy(upload->filename, filename);
+    upload->filetitle = copyString((char *)filetitle);
+    upload->filedesc = copyString((char *)filedesc);
+    return op->opId;
+}
+
+
+// ***************************************************************************
+// take the file name from a Content-Disposition response header held in
+//  memory - any folder part of the name is dropped so the file can only be
+//  stored in filespath. Returns 1 if buffer was such a header with a name
+// ***************************************************************************
+static int header_filename(const char *buffer, size_t realsize, char *filename, size_t filenamesize)
+{
+    const size_t namelen = 20;    // strlen("Content-Disposition:")
+    int found = 0;
+    if (realsize > namelen && strncasecmp(buffer, "Content-Disposition:", namelen) == 0) {
+        char line[300];
+        size_t len = (realsize < sizeof(line)) ? realsize : sizeof(line) - 1;
+        memcpy(line, buffer, len);
+        line[len] = 0;
+        char *name = strcasestr(line, "filename=");
+        if (name != NULL) {
+            name += 9;
+            char *end;
+            if (*name == '"') {
+                name++;
+                end = strchr(name, '"');
+            } else {
+                end = name + strcspn(name, "; \r\n");
+            }
+            if (end != NULL) {
+                *end = 0;
+                char *slash = strrchr(name, '/');
+                if (slash != NULL) {
+                    name = slash + 1;
+                }
+                slash = strrchr(name, '\\');
+                if (slash != NULL) {
+                    name = slash + 1;
+                }
+                if (strlen(name) > 0 && strlen(name) < filenamesize && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+                    strcpy(filename, name);
+                    found = 1;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+
+// ***************************************************************************
+// curl header callback for File gallery downloads: takes the file name from
+//  the Content-Disposition header in memory, rather than writing the headers
+//  to a file and reading them back
+// ***************************************************************************
+static size_t DownloadHeaderCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t realsize = size * nitems;
+    struct file_download *download = (struct file_download *)userp;
+
+    if (download->dictated) {
+        return realsize;
+    }
+    if (realsize > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        /* a new response (e.g. after a redirect) - forget any earlier file name */
+        download->filename[0] = 0;
     } else {
-         /*
-         * Now, our memchunk.memory points to a memory block that is memchunk.size
-         * bytes big and contains the returned text from the API.
-         *
-         * multiple steps in the code below extract the returned text after: "mes":[" from the memory block so it can be returned
-         */
-	     if (debug==1)
-         { 
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full text response is: %s\n", memchunk.memory);
-         }
+        header_filename(buffer, realsize, download->filename, sizeof(download->filename));
+    }
+    return realsize;
+}
 
-         // first of all check that the update went OK by looking for "Success" in memchunk
-         response = strstr(memchunk.memory, "Success");        // response should now be the whole string from "Success" onwards
-	     if (debug==1) {
-             printf ("length of Success response string is: %d\n", strlen(response) );
-         }
 
-         if ( response != NULL )  {  // "Success" string found!
-             // now look for the start of the 'mes' text
-             response = strstr(memchunk.memory, "mes");        // response should now be the whole string from "mes" onwards
-	         if (debug==1) {
-                 printf ("length of mes response string is: %d\n", strlen(response) );
-             }
+// ***************************************************************************
+// open the file that a download is written to, once its name is known -
+//  an HTTP error response is not stored at all
+// ***************************************************************************
+static int download_open(struct file_download *download)
+{
+    // returns 1 if the download can carry on or 0 if the file could not be opened
+    long httpcode = 0;
+    curl_easy_getinfo(download->curl_handle, CURLINFO_RESPONSE_CODE, &httpcode);
+    if (httpcode >= 400) {
+        download->skipping = 1;
+        return 1;
+    }
+    if (download->filename[0] != 0) {
+        snprintf(download->target, sizeof(download->target), "%s%s", download->filespath, download->filename);
+    } else {
+        /* no name from the headers, so a temporary name that is different for each fileId */
+        snprintf(download->target, sizeof(download->target), "%stempdownload%s", download->filespath, download->fileId);
+    }
+    download->fp = fopen(download->target, "wb");  // use wb to allow binary
+    if (download->fp == NULL) {
+        TIKI_ERROR("File gallery download: %s could not be opened\n", download->target);
+        return 0;
+    }
+    return 1;
+}
 
-             if ( response != NULL )  {  // "mes" string found!
+static size_t DownloadWriteCallback(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    struct file_download *download = (struct file_download *)userp;
+    if (download->fp == NULL && !download->skipping && !download_open(download)) {
+        return 0;
+    }
+    if (download->skipping) {
+        return realsize;
+    }
+    download->written += realsize;
+    return fwrite(ptr, 1, realsize, download->fp);
+}
 
-                 removeString(response, 0, 7);     // strip away the first 7 front end characters for just the text and everything after
-	             if (debug==1)
-                 {
-                     printf ("1st cropped found text is: %s\n", response);
-                     printf ("length of new mes response string is: %d\n", strlen(response) );
-                 }
-                 // now strip away everything from the first ] character found
-                 char *ptr;
-                 ptr = strchr(response, ']');    // ptr is the pointer for the ] in 'response'
-                 if (ptr != NULL) {
-                     *ptr = '\0';   // this makes the original ] character the 'end of string' character
-                 }
-	             if (debug==1)
-                 {
-                     printf ("2nd cropped found text is: %s\n", response);
-                     printf ("length of next new mes response string is: %d\n", strlen(response) );
-                 }
-                 // now remove the final " character to leave just the message text 
-                 removeString(response, strlen(response)-1, 1);    
-                 returnstr = copyString(response);
-	             if (debug==1)
-                 {
-                     printf ("3rd cropped found text is: %s\n", response);
-                     printf ("length of final new mes response string is: %d\n", strlen(response) );
-                     printf ("returnstr set to         : %s\n", returnstr);
-                 }
 
-             } else {
-                 returnstr = copyString("mes text not found");
-	             if (debug==1)
-                 {
-                     printf ("\n*** mes text not found in response!! ***\n");
-                     printf ("full original tracker update API response is: %s\n", memchunk.memory);
-                     printf ("returnstr set to                            : %s\n", returnstr);
-                 }
+// ***************************************************************************
+// finish a File gallery download: the file is closed, or removed again if
+//  the transfer failed part way, and the result text is built
+// ***************************************************************************
+static char* filedownload_result(int debug, CURLcode res, long httpcode, struct file_download *download)
+{
+    char *returnstr = "";
+    if (res == CURLE_OK && download->fp == NULL && !download->skipping) {
+        /* an empty file still gets stored */
+        if (!download_open(download)) {
+            res = CURLE_WRITE_ERROR;
+        }
+    }
+    if (download->fp != NULL) {
+        if (fclose(download->fp) != 0 && res == CURLE_OK) {
+            res = CURLE_WRITE_ERROR;
+        }
+        download->fp = NULL;
+        if (res != CURLE_OK) {
+            remove(download->target);
+        }
+    }
+    if (res != CURLE_OK) {
+        TIKI_ERROR("File gallery download of fileId %s failed: %s\n", download->fileId, curl_easy_strerror(res));
+        returnstr = copyString("curl access to the Tiki site for File gallery file download failed");
+    } else if (download->skipping) {
+        char text[100];
+        snprintf(text, sizeof(text), "File gallery file download of fileId %s failed with HTTP %ld", download->fileId, httpcode);
+        returnstr = copyString(text);
+    } else {
+        returnstr = concatString(download->target, " downloaded OK");
+    }
+    TIKI_DEBUG(debug, "\n *** debug from File gallery download ...\n");
+    TIKI_DEBUG(debug, "fileId %s: %s\n", download->fileId, returnstr);
+    return returnstr;
+}
 
-             }
 
-         } else {
-             returnstr = copyString("Success text not found");
-	         if (debug==1)
-             {
-                 printf ("\n*** Success text not found in response!! ***\n");
-                 printf ("full original tracker update API response is: %s\n", memchunk.memory);
-                 printf ("returnstr set to                            : %s\n", returnstr);
-             }
+// ***************************************************************************
+// finish a completed transfer: extract the result exactly as the blocking
+//  functions do, then pass it to the callback or keep it for tiki_multi_poll
+// ***************************************************************************
+static void multi_complete(tiki_multi* multi, CURL* curl_handle, CURLcode res)
+{
+    struct tiki_multi_op *op = NULL;
+    curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char **)&op);
+    op->res = res;
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &op->httpcode);
+    curl_off_t total_us = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &op->bytes);
+    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total_us);
+    op->seconds = total_us / 1000000.0;
+    if (total_us > 0) {
+        breaker_record(multi->session->breaker, curl_handle, res);
+    }
+    if (op->optype == TIKI_MULTI_FILEDOWNLOAD) {
+        transfer_account(curl_handle, TIKI_CALL_FILEDOWNLOAD, -1, (long long)op->download.written);
+    } else if (op->optype == TIKI_MULTI_FILEUPLOAD) {
+        transfer_account(curl_handle, TIKI_CALL_FILEUPLOAD, -1, (long long)op->memchunk.size);
+    } else {
+        /* the tracker operations are counted with the blocking calls of the same kind */
+        int call = (op->optype == TIKI_MULTI_ITEMPOST) ? TIKI_CALL_ITEMPOST : (op->optype == TIKI_MULTI_ITEMUPDATE) ? TIKI_CALL_ITEMUPDATE : TIKI_CALL_ITEMGET;
+        transfer_account(curl_handle, call, (long long)strlen(op->post_data), (long long)op->memchunk.size);
+    }
 
-         }
+    if (op->optype == TIKI_MULTI_FILEDOWNLOAD) {
+        op->result = filedownload_result(multi->debug, res, op->httpcode, &op->download);
+    } else if (op->optype == TIKI_MULTI_FILEUPLOAD) {
+        op->result = fileupload_result(multi->debug, res, &op->memchunk);
+    } else if (op->optype == TIKI_MULTI_ITEMPOST) {
+        op->result = itempost_result(multi->debug, res, &op->memchunk);
+    } else if (op->optype == TIKI_MULTI_ITEMUPDATE) {
+        op->result = itemupdate_result(multi->debug, res, &op->memchunk);
+    } else {
+        op->result = itemget_result(multi->debug, res, &op->memchunk);
     }
+    TIKI_DEBUG(multi->debug, "\n *** debug from tiki_multi ...\n");
+    TIKI_DEBUG(multi->debug, "operation %d complete with result: %s\n", op->opId, op->result);
 
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-	if (debug==1)
-    {
-        printf ("curl_handle cleaned up\n");
+    // take the operation out of the active list and keep its easy handle for re-use
+    struct tiki_multi_op **link = &multi->active;
+    while (*link != op) {
+        link = &(*link)->next;
     }
-    free(memchunk.memory);
-	if (debug==1)
-    {
-        printf ("memchunk.memory freed\n");
+    *link = op->next;
+    op->next = NULL;
+    multi->inflight--;
+    if (op->priority == TIKI_PRIORITY_URGENT) {
+        multi->urgent--;
+        if (multi->session->bucket != NULL) {
+            __atomic_sub_fetch(&multi->session->bucket->urgent, 1, __ATOMIC_RELEASE);
+        }
     }
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-	if (debug==1)
-    {
-        printf ("curl_global cleaned up, and ...\n");
-        printf ("return string is: %s\n", returnstr);
+    curl_multi_remove_handle(multi->multi_handle, curl_handle);
+    multi->idle[multi->nidle++] = curl_handle;
+    op->curl_handle = NULL;
+    memchunk_free(&op->memchunk);
+    free(op->post_data);
+    free(op->postgz);
+    curl_mime_free(op->upload.form);
+    free(op->upload.filetitle);
+    free(op->upload.filedesc);
+
+    if (multi->callback != NULL) {
+        multi->callback(op->opId, op->result, multi->userdata);
+        free(op->result);
+        free(op);
+    } else {
+        if (multi->done_tail == NULL) {
+            multi->done_head = op;
+        } else {
+            multi->done_tail->next = op;
+        }
+        multi->done_tail = op;
     }
-	return returnstr;
-}	
+}
 
-// ********************************************************************************
-//  existing tracker item download function - much the same as tracker_itemupdate
-//   function, but just has an empty 'body' for the cURL and returns the "fields"
-//   section of the whole response
-// *******************************************************************************
-char* tracker_itemget(int debug, const char* domain, char* access_token, const char* trackerId, const char* itemId)
+
+// ***************************************************************************
+// pause the bulk transfers in flight while any urgent operation is, so the
+//  urgent ones have the site and the hub's uplink to themselves, and carry on
+//  with them, from where they stopped, once the last urgent one completes
+// ***************************************************************************
+static void multi_preempt(tiki_multi* multi)
 {
-    // debug: if set to 1 this produces (lots!!) of additional output
-    // domain: string used for the main URL text that must include https:// but no trailing /
-    // access_token: the API access token that enables specific permissions for the API usage
-    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
-    // itemId: is a string of the integer Id of the tracker item that is being downloaded
-    // returnstr is returned as a string to indicate the result and is all the field data in a dictionary-like format or an error message
-    char *response = "";
-    char *returnstr = "";
-    char* post_data = "";   // create an empty body so that POST is used
-    // build the full tracker API URL
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, "/api/trackers/");
-    strcat(API_URL, trackerId);
-    strcat(API_URL, "/items/");
-    strcat(API_URL, itemId);
-	if (debug==1)
-    {
-       printf ("\n *** debug from tracker_itemget ...\n");
-       printf ("API URL is: %s\n", API_URL);
-	}	
+    struct tiki_multi_op *op;
+    int pause = (multi->urgent > 0);
+    for (op = multi->active; op != NULL; op = op->next) {
+        if (op->priority == TIKI_PRIORITY_BULK && op->paused != pause) {
+            curl_easy_pause(op->curl_handle, pause ? CURLPAUSE_ALL : CURLPAUSE_CONT);
+            op->paused = pause;
+            TIKI_DEBUG(multi->debug, "operation %d %s\n", op->opId, pause ? "paused for urgent operations" : "carried on");
+        }
+    }
+}
 
-    // send data to the tracker API
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;            /* no data at this point */
 
-    CURL *curl_handle;
-    CURLcode res;
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-    /* specify URL to get */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
-    /* send all returned data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+// ***************************************************************************
+// start queued operations, highest class first, until the in-flight limit is
+//  reached or the domain's rate limit holds them up - urgent operations may
+//  take the number in flight up to twice the limit, so they never wait for
+//  a slot behind bulk transfers
+// ***************************************************************************
+static void multi_start(tiki_multi* multi)
+{
+    multi->token_ms = 0;
+    while (multi->queued > 0) {
+        int p = TIKI_PRIORITY_URGENT;
+        while (multi->queue_head[p] == NULL) {
+            p++;
+        }
+        if (multi->inflight >= ((p == TIKI_PRIORITY_URGENT) ? 2 * multi->max_inflight : multi->max_inflight)) {
+            break;
+        }
+        CURLcode refused = request_refused(multi->session);
+        if (refused == CURLE_OK) {
+            long wait_ms = bucket_trytake(multi->session->bucket, p);
+            if (wait_ms > 0) {
+                /* everything queued behind the operation waits too, as it is of the same or a lower class */
+                multi->token_ms = wait_ms;
+                break;
+            }
+        }
+        struct tiki_multi_op *op = multi->queue_head[p];
+        multi->queue_head[p] = op->next;
+        if (multi->queue_head[p] == NULL) {
+            multi->queue_tail[p] = NULL;
+        }
+        multi->queued--;
+        if (refused == CURLE_OK) {
+            stats_queued(p, bucket_now_us() - op->queued_us);
+        }
 
-    // set the custom headers - just needs the 'accept' and the access token
-    struct curl_slist *headchunk = NULL;
-    // Add the Content-Type header */
-    headchunk = curl_slist_append(headchunk, "Content-Type: application/x-www-form-urlencoded");
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the authorization access token header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
+        // re-use an idle easy handle if there is one
+        CURL *curl_handle;
+        if (multi->nidle > 0) {
+            curl_handle = multi->idle[--multi->nidle];
+            curl_easy_reset(curl_handle);
+        } else {
+            curl_handle = share_easy_init();
+        }
+        op->curl_handle = curl_handle;
+        memchunk_init(&op->memchunk, NULL);   /* operations run concurrently so each has its own response memory */
+        /* pick the wanted values out of the response as it arrives, as in the blocking versions */
+        if (op->optype == TIKI_MULTI_FILEDOWNLOAD) {
+            op->download.curl_handle = curl_handle;
+        } else if (op->optype == TIKI_MULTI_FILEUPLOAD) {
+            json_scan_init(&op->scan, NULL);
+            json_scan_want(&op->scan, "fileId");
+        } else if (op->optype == TIKI_MULTI_ITEMPOST) {
+            json_scan_init(&op->scan, NULL);
+            json_scan_want(&op->scan, "itemId");
+        } else if (op->optype == TIKI_MULTI_ITEMUPDATE) {
+            json_scan_init(&op->scan, "Success");
+            json_scan_want(&op->scan, "mes");
+        } else {
+            json_scan_init(&op->scan, "Success");
+            json_scan_want(&op->scan, "fields");
+        }
+        op->memchunk.scan = &op->scan;
+        op->memchunk.buffered = ((op->optype != TIKI_MULTI_ITEMPOST && op->optype != TIKI_MULTI_FILEUPLOAD) || TIKI_DEBUGGING(multi->debug));
+
+        curl_easy_setopt(curl_handle, CURLOPT_URL, op->API_URL);
+        curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+        curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, multi->session->formchunk);
+        if (op->optype == TIKI_MULTI_FILEDOWNLOAD) {
+            /* a GET whose body goes straight to the file, named from the headers as they arrive */
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, DownloadWriteCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&op->download);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, DownloadHeaderCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&op->download);
+        } else if (op->optype == TIKI_MULTI_FILEUPLOAD) {
+            /* the same multipart/form-data POST as gallery_fileupload, with the file read by curl as it is sent */
+            struct file_upload *upload = &op->upload;
+            curl_mimepart *field;
+            upload->form = curl_mime_init(curl_handle);
+            field = curl_mime_addpart(upload->form);
+            curl_mime_name(field, "data");
+            curl_mime_filedata(field, upload->filepath);
+            field = curl_mime_addpart(upload->form);
+            curl_mime_name(field, "galleryId");
+            curl_mime_data(field, upload->galId, CURL_ZERO_TERMINATED);
+            field = curl_mime_addpart(upload->form);
+            curl_mime_name(field, "name");
+            curl_mime_data(field, upload->filename, CURL_ZERO_TERMINATED);
+            field = curl_mime_addpart(upload->form);
+            curl_mime_name(field, "title");
+            curl_mime_data(field, upload->filetitle, CURL_ZERO_TERMINATED);
+            field = curl_mime_addpart(upload->form);
+            curl_mime_name(field, "description");
+            curl_mime_data(field, upload->filedesc, CURL_ZERO_TERMINATED);
+            curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, multi->session->mimechunk);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&op->memchunk);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&op->memchunk);
+            curl_easy_setopt(curl_handle, CURLOPT_MIMEPOST, upload->form);
+        } else {
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&op->memchunk);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderSizeCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&op->memchunk);
+            size_t len = strlen(op->post_data);
+            size_t gzlen = 0;
+            if (multi->session->compress_min > 0 && len >= multi->session->compress_min) {
+                op->postgz = gzip_body(op->post_data, len, &gzlen);
+            }
+            if (op->postgz != NULL) {
+                curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, multi->session->gzipchunk);
+                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, op->postgz);
+                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)gzlen);
+            } else {
+                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, op->post_data);
+                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)len);
+            }
+        }
+        if (multi->session->compress) {
+            curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+        }
+        /* ask for HTTP/2 over TLS and wait for an existing connection to multiplex on rather than opening a new one -
+           only for https:// as without TLS (and ALPN) the wait lasts until the first whole request has completed */
+        curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        if (strncmp(multi->session->domain, "https://", 8) == 0) {
+            curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, 1L);
+        }
+        /* so the operation can be found again when the transfer completes */
+        curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, (void *)op);
+
+        op->next = multi->active;
+        multi->active = op;
+        multi->inflight++;
+        if (op->priority == TIKI_PRIORITY_URGENT) {
+            /* counted on the domain too, so the blocking bulk calls to it stand aside as well */
+            multi->urgent++;
+            if (multi->session->bucket != NULL) {
+                __atomic_add_fetch(&multi->session->bucket->urgent, 1, __ATOMIC_RELEASE);
+            }
+        }
+        if (refused != CURLE_OK) {
+            /* cancelled, or the domain's breaker is open - so the operation fails without being sent */
+            multi_complete(multi, curl_handle, refused);
+            continue;
+        }
+        request_limits(multi->session, curl_handle);
+        curl_multi_add_handle(multi->multi_handle, curl_handle);
+    }
+    multi_preempt(multi);
+}
 
-    // set the 'empty' post_data
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, post_data);
 
-    /* send it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-         fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-         returnstr = copyString("curl access to the Tiki site for tracker item download failed");
-    } else if (memchunk.size == 0) {
-         printf("the curl request may have been processed BUT there was no response from the server API\n");
-         returnstr = copyString("no response from the curl request sent to the server API");
-    } else {
-         /*
-         * Now, our memchunk.memory points to a memory block that is memchunk.size
-         * bytes big and contains the returned text from the API.
-         *
-         * multiple steps in the code below extract the returned text after: "fields": from the memory block so it can be returned
-         */
-	     if (debug==1)
-         { 
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full text response is: %s\n", memchunk.memory);
-         }
+// ***************************************************************************
+// drive the queued and in-flight operations: waits up to timeout_ms for any
+//  network activity and then completes whatever has finished - returns the
+//  number of operations still queued or in flight
+// ***************************************************************************
+int tiki_multi_perform(tiki_multi* multi, int timeout_ms)
+{
+    // timeout_ms: the longest time in milliseconds to wait for network activity - 0 does not wait
+    int running = 0;
+    int msgs_left = 0;
+    CURLMsg *msg;
+
+    multi_start(multi);
+    curl_multi_perform(multi->multi_handle, &running);
+    /* operations held up by the rate limit are started as soon as the next token is due */
+    int wait_ms = (multi->token_ms > 0 && multi->token_ms < timeout_ms) ? (int)multi->token_ms : timeout_ms;
+    if ((running > 0 || multi->token_ms > 0) && wait_ms > 0) {
+        /* curl_multi_poll rather than curl_multi_wait, as only it can be interrupted by tiki_multi_wakeup */
+        curl_multi_poll(multi->multi_handle, NULL, 0, wait_ms, NULL);
+        curl_multi_perform(multi->multi_handle, &running);
+    }
+    while ((msg = curl_multi_info_read(multi->multi_handle, &msgs_left)) != NULL) {
+        if (msg->msg == CURLMSG_DONE) {
+            // read both values before the handle is removed as that invalidates msg
+            CURL *curl_handle = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            multi_complete(multi, curl_handle, res);
+        }
+    }
+    multi_start(multi);
+    return multi->queued + multi->inflight;
+}
 
-         // first of all check that the update went OK by looking for "Success" in memchunk
-         response = strstr(memchunk.memory, "Success");        // response should now be the whole string from "Success" onwards
-	     if (debug==1) {
-             printf ("length of Success response string is: %d\n", strlen(response) );
-         }
 
-         if ( response != NULL )  {  // "Success" string found!
-             // now look for the start of the 'fields' text
-             response = strstr(memchunk.memory, "fields");        // response should now be the whole string from "fields" onwards
-	         if (debug==1) {
-                 printf ("Success! Length of fields response string is now: %d\n", strlen(response) );
-             }
+// ***************************************************************************
+// interrupt a tiki_multi_perform that is waiting for network activity, so it
+//  returns early and e.g. operations queued meanwhile are started at once -
+//  this is the one tiki_multi function that may be called from any thread
+// ***************************************************************************
+void tiki_multi_wakeup(tiki_multi* multi)
+{
+    curl_multi_wakeup(multi->multi_handle);
+}
 
-             if ( response != NULL )  {  // "fields" string found!
 
-                 removeString(response, 0, 8);     // strip away the first 8 front end characters for just the fields text and everything after
-	             if (debug==1)
-                 {
-                     printf ("1st cropped found text is: %s\n", response);
-                     printf ("length of new fields response string is: %d\n", strlen(response) );
-                 }
-                 // now strip away everything at the end from 'nextTicket' onwards
-                 char *ptr;
-                 ptr = strstr(response, "nextTicket");    // ptr is the pointer for nextTicket in 'response'
-                 if (ptr != NULL) {
-                     *ptr = '\0';   // this makes the original ] character the 'end of string' character
-                 }
-	             if (debug==1)
-                 {
-                     printf ("2nd cropped fields text is: %s\n", response);
-                     printf ("length of next new fields response string is: %d\n", strlen(response) );
-                 }
-                 // now remove the final " character to leave just the fields text 
-                 removeString(response, strlen(response)-2,2);    
-                 returnstr = copyString(response);
-	             if (debug==1)
-                 {
-                     printf ("3rd cropped found text is: %s\n", response);
-                     printf ("length of final new fields response string is: %d\n", strlen(response) );
-                     printf ("returnstr set to         : %s\n", returnstr);
-                 }
+// ***************************************************************************
+// run all the queued operations to completion
+// ***************************************************************************
+void tiki_multi_run(tiki_multi* multi)
+{
+    while (tiki_multi_perform(multi, 1000) > 0) {
+        // keep going until everything has completed
+    }
+}
 
-             } else {
-                 printf ("\n*** fields text not found in response!! ***");
-                 printf ("\n\n");
-                 returnstr = copyString("fields text not found");
-	             if (debug==1)
-                 {
-                     printf ("full original web page text is: %s\n", memchunk.memory);
-                     printf ("returnstr set to              : %s\n", returnstr);
-                 }
 
-             }
+// ***************************************************************************
+// collect the next completed operation when no callback is set: returns its
+//  result text (to be released with tiki_free) and sets *opId, or returns
+//  NULL if there is nothing waiting to be collected
+// ***************************************************************************
+static char* multi_poll_status(tiki_multi* multi, int* opId, CURLcode* res, long* httpcode, curl_off_t* bytes, double* seconds)
+{
+    // as tiki_multi_poll, and res, httpcode, bytes and seconds (if not NULL) are set to how the request went
+    struct tiki_multi_op *op = multi->done_head;
+    if (op == NULL) {
+        return NULL;
+    }
+    multi->done_head = op->next;
+    if (multi->done_head == NULL) {
+        multi->done_tail = NULL;
+    }
+    char *returnstr = op->result;
+    if (opId != NULL) {
+        *opId = op->opId;
+    }
+    if (res != NULL) {
+        *res = op->res;
+    }
+    if (httpcode != NULL) {
+        *httpcode = op->httpcode;
+    }
+    if (bytes != NULL) {
+        *bytes = op->bytes;
+    }
+    if (seconds != NULL) {
+        *seconds = op->seconds;
+    }
+    free(op);
+    return returnstr;
+}
 
-         } else {
-             printf ("\n*** Success text not found in response!! ***");
-             printf ("\n\n");
-	         if (debug==1)
-             returnstr = copyString("Success text not found");
-             {
-                 printf ("full original web page text is: %s\n", memchunk.memory);
-                 printf ("returnstr set to              : %s\n", returnstr);
-             }
+char* tiki_multi_poll(tiki_multi* multi, int* opId)
+{
+    // opId: set to the Id returned when the completed operation was submitted
+    return multi_poll_status(multi, opId, NULL, NULL, NULL, NULL);
+}
 
-         }
-    }
 
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-	if (debug==1)
-    {
-        printf ("curl_handle cleaned up\n");
+// ***************************************************************************
+// close the multi-request engine: anything still queued or in flight is
+//  abandoned and any uncollected results are freed
+// ***************************************************************************
+void tiki_multi_destroy(tiki_multi* multi)
+{
+    // multi: the engine created by tiki_multi_create - NULL is ignored
+    if (multi == NULL) {
+        return;
     }
-    free(memchunk.memory);
-	if (debug==1)
-    {
-        printf ("memchunk.memory freed\n");
+    struct tiki_multi_op *op;
+    int p;
+    while ((op = multi->active) != NULL) {
+        multi->active = op->next;
+        if (op->priority == TIKI_PRIORITY_URGENT && multi->session->bucket != NULL) {
+            __atomic_sub_fetch(&multi->session->bucket->urgent, 1, __ATOMIC_RELEASE);
+        }
+        curl_multi_remove_handle(multi->multi_handle, op->curl_handle);
+        curl_easy_cleanup(op->curl_handle);
+        if (op->download.fp != NULL) {
+            /* an abandoned download leaves no partial file behind */
+            fclose(op->download.fp);
+            remove(op->download.target);
+        }
+        memchunk_free(&op->memchunk);
+        free(op->post_data);
+        free(op->postgz);
+        curl_mime_free(op->upload.form);
+        free(op->upload.filetitle);
+        free(op->upload.filedesc);
+        free(op);
     }
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-	if (debug==1)
-    {
-        printf ("curl_global cleaned up, and ...\n");
-        printf ("return string is: %s\n", returnstr);
+    for (p = 0; p < TIKI_PRIORITIES; p++) {
+        while ((op = multi->queue_head[p]) != NULL) {
+            multi->queue_head[p] = op->next;
+            free(op->post_data);
+            free(op->upload.filetitle);
+            free(op->upload.filedesc);
+            free(op);
+        }
     }
-	return returnstr;
-}	
-	
+    char *result;
+    while ((result = tiki_multi_poll(multi, NULL)) != NULL) {
+        free(result);
+    }
+    while (multi->nidle > 0) {
+        curl_easy_cleanup(multi->idle[--multi->nidle]);
+    }
+    curl_multi_cleanup(multi->multi_handle);
+    free(multi->idle);
+    tiki_session_destroy(multi->session);
+    free(multi);
+}
 
 
 // ********************************************************************************
-//  existing Tiki File gallery file download function 
+//  File gallery multi-file download function: downloads many files concurrently
+//   through a tiki_multi, each written straight to its final file name
 // *******************************************************************************
-char* gallery_filedownload(int debug, const char* domain, char* access_token, const char* fileId, const char* filespath, const char* bodyfilename, const char* headerfilename)
+int gallery_filedownload_batch(int debug, const char* domain, char* access_token, int nfiles, const char** fileIds, const char* filespath, int max_inflight, char** results, long long* bytes, double* seconds)
 {
     // debug: if set to 1 this produces (lots!!) of additional output
     // domain: string used for the main URL text that must include https:// but no trailing /
     // access_token: the API access token that enables specific permissions for the API usage
-    // fileId is Id of the file to be downloaded
-    // filespath is the folder path on the calling device where the downloaded file and the response header file are 
-    //    to be stored and should include both the first and last / character
-    /* both bodyfilename and headerfilename are passed parameters for file names in the path defined by filespath and  
-       where headerfilename is typically a temporary file on the calling device used for the response headers that would  
-       be overwritten with each use, and where bodyfilename can either be 'dictated' by the calling program to be a  
-       specific name or if left blank the 'body' i.e. the downloaded file will initially be stored under a temporary name  
-       then the actual file name is extracted from the response header file and the downloaded file is renamed */
-
-	if (debug==1)
-    {
-        printf ("\n\n");
-        printf ("***************************************\n");
-        printf ("*** debug from gallery_filedownload ...\n");
-        printf ("***************************************\n\n");
+    // nfiles: the number of files to be downloaded
+    // fileIds: array of the Ids of the files to be downloaded
+    // filespath is the folder path on the calling device where the downloaded files are to be stored and should
+    //    include both the first and last / character - each file is stored under the name in its Content-Disposition
+    //    response header, or as tempdownload followed by its fileId if there is none
+    // max_inflight: the most files that are downloaded at the same time
+    // results: array of nfiles that is set to the result text of each download, the same as for gallery_filedownload,
+    //    and each of which should be released with tiki_free
+    // bytes: array of nfiles that is set to the number of bytes received for each file, or NULL
+    // seconds: array of nfiles that is set to how long each download took, or NULL
+    // returns the number of files downloaded OK
+
+    int downloaded = 0;
+    int i;
+    for (i = 0; i < nfiles; i++) {
+        results[i] = NULL;
+        if (bytes != NULL) {
+            bytes[i] = 0;
+        }
+        if (seconds != NULL) {
+            seconds[i] = 0;
+        }
     }
-
-    char *response = "";
-    char *returnstr = "";
-
-    // build the full file gallery API URL
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, "/api/galleries/");
-    strcat(API_URL, fileId);
-    strcat(API_URL, "/download");
-
-    // build the stored file paths + names
-    char download[100] = "";
-    strcat(download, filespath);
-    if (strlen(bodyfilename) == 0) {
-        strcat(download, "tempdownload");
-        if (debug==1) { 
-            printf ("temporary download file name being used before renaming: tempdownload\n");
+    tiki_multi *multi = tiki_multi_create(debug, domain, access_token, max_inflight);
+    int *index = malloc((nfiles > 0 ? nfiles : 1) * sizeof(int));   // position in fileIds of each opId - 1
+    if (multi == NULL || index == NULL) {
+        tiki_multi_destroy(multi);
+        free(index);
+        for (i = 0; i < nfiles; i++) {
+            results[i] = copyString("curl session could not be created for File gallery file download");
         }
-    } else {
-        strcat(download, bodyfilename);
-        if (debug==1) { 
-            printf ("dictated download file name being used: %s\n", bodyfilename);
+        return downloaded;
+    }
+    for (i = 0; i < nfiles; i++) {
+        int opId = tiki_multi_filedownload(multi, fileIds[i], filespath, "");
+        if (opId < 0) {
+            results[i] = copyString("File gallery file download could not be queued");
+        } else {
+            index[opId - 1] = i;
         }
     }
-    char respheaders[100] = "";
-    strcat(respheaders, filespath);
-    strcat(respheaders, headerfilename);
-
-	if (debug==1)
-    {
-        printf ("API URL is       : %s\n", API_URL);
-        printf ("download filename: %s\n", download);
-        printf ("headers filename : %s\n", respheaders);
-	}	
 
-    // send data to the file gallery API
+    tiki_multi_run(multi);
 
-    CURL *curl_handle;
+    char *result;
+    int opId;
     CURLcode res;
-    curl_global_init(CURL_GLOBAL_ALL);
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-
-    /* specify URL to get */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
-
-    /* no progress meter ! */
-    curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
+    long httpcode;
+    curl_off_t received;
+    double taken;
+    long long totalbytes = 0;
+    while ((result = multi_poll_status(multi, &opId, &res, &httpcode, &received, &taken)) != NULL) {
+        i = index[opId - 1];
+        results[i] = result;
+        if (bytes != NULL) {
+            bytes[i] = received;
+        }
+        if (seconds != NULL) {
+            seconds[i] = taken;
+        }
+        totalbytes += received;
+        if (res == CURLE_OK && httpcode < 400) {
+            downloaded++;
+        }
+        TIKI_DEBUG(debug, "fileId %s: %lld bytes in %.3f s (%.1f KB/s)\n", fileIds[i], (long long)received, taken, (taken > 0) ? received / taken / 1024.0 : 0.0);
+    }
+    TIKI_DEBUG(debug, "\n *** debug from gallery_filedownload_batch ...\n");
+    TIKI_DEBUG(debug, "%d of %d files downloaded OK, %lld bytes in total\n", downloaded, nfiles, totalbytes);
+    free(index);
+    tiki_multi_destroy(multi);
+    return downloaded;
+}
 
-    /* send all returned data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_data);
 
-    /* open the header file */
-    FILE *headerfile;
-    headerfile = fopen(respheaders, "w");
-    if(!headerfile) {     // if the file cannot be opened abort everything
-        curl_easy_cleanup(curl_handle);
-        curl_global_cleanup();
-        returnstr = copyString("response header file location could not be opened");
-        return returnstr;
+// ***************************************************************************
+// bulk tracker item ingestion: sensor readings are added to a bounded queue
+//  per trackerId and each tracker's readings are flushed together, as
+//  concurrent item posts over the tiki_multi's kept-alive connections, once
+//  enough have built up or the oldest has waited long enough. The Tiki
+//  tracker API has no bulk item endpoint so each reading is still one POST,
+//  but a burst of readings takes a few round trips rather than one each
+// ***************************************************************************
+tiki_batch* tiki_batch_create(int debug, const char* domain, char* access_token, int max_inflight, int max_pending, int max_count, size_t max_bytes, int max_age_ms)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // max_inflight: the most item posts that are sent at the same time
+    // max_pending: the most readings that can be waiting, in flight or not yet collected - tiki_batch_add fails when it is reached
+    // max_count: a tracker's readings are flushed when this many are waiting - 0 for no count limit
+    // max_bytes: a tracker's readings are flushed when their post data adds up to this many bytes - 0 for no size limit
+    // max_age_ms: a tracker's readings are flushed when the oldest has waited this many milliseconds - 0 for no age limit
+    // returns a pointer to the new batch or NULL if it could not be created
+    if (max_pending < 1) {
+        max_pending = 1;
     }
- 
-    /* open the body file */
-    FILE *bodyfile;
-    bodyfile = fopen(download, "wb");  // use wb to allow binary
-    if(!bodyfile) {    // if the file cannot be opened so abort everything
-        curl_easy_cleanup(curl_handle);
-        curl_global_cleanup();
-        fclose(headerfile);
-        returnstr = copyString("download file location could not be opened");
-        return returnstr;
+    tiki_batch *batch = calloc(1, sizeof(tiki_batch));
+    if (batch == NULL) {
+        TIKI_ERROR("tiki_batch_create() failed: not enough memory\n");
+        return NULL;
+    }
+    batch->slots = calloc(max_pending, sizeof(struct tiki_batch_slot));
+    batch->multi = tiki_multi_create(debug, domain, access_token, max_inflight);
+    if (batch->slots == NULL || batch->multi == NULL) {
+        TIKI_ERROR("tiki_batch_create() failed: multi-request engine could not be created\n");
+        tiki_multi_destroy(batch->multi);
+        free(batch->slots);
+        free(batch);
+        return NULL;
+    }
+    batch->debug = debug;
+    batch->max_pending = max_pending;
+    batch->max_count = max_count;
+    batch->max_bytes = max_bytes;
+    batch->max_age_ms = max_age_ms;
+    batch->nextId = 1;
+    TIKI_DEBUG(debug, "\n *** debug from tiki_batch_create ...\n");
+    TIKI_DEBUG(debug, "batch created for up to %d readings, flushed at %d readings, %lu bytes or %d ms\n", max_pending, max_count, (unsigned long)max_bytes, max_age_ms);
+    return batch;
+}
+
+
+// ***************************************************************************
+// find the slot of a reading that was sent as operation opId - with opId 0 a
+//  free slot is found instead. Operations are numbered in order so the slot
+//  is almost always the first one looked at
+// ***************************************************************************
+static struct tiki_batch_slot* batch_slot(tiki_batch* batch, int opId)
+{
+    int i;
+    int start = (opId > 0) ? opId % batch->max_pending : 0;
+    for (i = 0; i < batch->max_pending; i++) {
+        struct tiki_batch_slot *slot = &batch->slots[(start + i) % batch->max_pending];
+        if (slot->opId == opId) {
+            return slot;
+        }
     }
+    return NULL;
+}
 
-    /* we want the headers be written to this file handle */
-    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, headerfile);
- 
-    /* we want the body be written to this file handle instead of stdout */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, bodyfile);
 
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+static long long batch_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-    // set the custom request headers - just needs the 'accept' and the access token
-    struct curl_slist *headchunk = NULL;
-    // Add the Content-Type header */
-    headchunk = curl_slist_append(headchunk, "Content-Type: application/x-www-form-urlencoded");
-    // Add the accept header */
-    headchunk = curl_slist_append(headchunk, "accept: application/json");
-    // Add the authorization access token header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
 
-    /* get it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
-    /* close the header file */
-    fclose(headerfile);
-    /* close the body file */
-    fclose(bodyfile);
-	if (debug==1)
+// ***************************************************************************
+// send all the waiting readings of one tracker as concurrent item posts
+// ***************************************************************************
+static void batch_flush_tracker(tiki_batch* batch, int index)
+{
+    struct tiki_batch_tracker *tracker = &batch->trackers[index];
+    struct tiki_batch_reading *reading;
+
+    if (TIKI_DEBUGGING(batch->debug) && tracker->count > 0)
     {
-        printf ("header and body files written and closed\n");
+        log_write(TIKI_LOG_DEBUG, "\n *** debug from tiki_batch ...\n");
+        log_write(TIKI_LOG_DEBUG, "flushing %d readings (%lu bytes) for trackerId %s\n", tracker->count, (unsigned long)tracker->bytes, tracker->trackerId);
     }
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        returnstr = copyString("curl access to the Tiki site for File gallery file download failed");
-    } else {
-        /*
-        * Now, check both the header and body files are OK and 
-        *  extract the Content-Disposition in the response header file 
-        *  if the passed bodyfilename is 'empty' 
-        */
-        long int headersize = 0;
-        headersize = findSize(respheaders);
-        if (headersize == -1) {
-            returnstr = copyString("header file size is zero or some other error");
-	        if (debug==1) { 
-                printf("header file size is zero - aborting operation\n");
+    while ((reading = tracker->head) != NULL) {
+        tracker->head = reading->next;
+        int opId = tiki_multi_itempost(batch->multi, tracker->trackerId, reading->post_data);
+        if (opId > 0) {
+            /* there is always a free slot as no more than max_pending readings are ever pending */
+            struct tiki_batch_slot *slot = &batch->slots[opId % batch->max_pending];
+            if (slot->opId != 0) {
+                slot = batch_slot(batch, 0);
             }
-            curl_easy_cleanup(curl_handle);
-            curl_global_cleanup();
-            return returnstr;
+            slot->opId = opId;
+            slot->readingId = reading->readingId;
+            slot->tracker = index;
+        } else {
+            /* the reading could not be queued so it is dropped and no longer pending */
+            TIKI_ERROR("tiki_batch: reading %d for trackerId %s could not be sent\n", reading->readingId, tracker->trackerId);
+            batch->pending--;
         }
+        free(reading->post_data);
+        free(reading);
+    }
+    tracker->tail = NULL;
+    tracker->count = 0;
+    tracker->bytes = 0;
+}
 
-	    if (debug==1) { 
-            printf("header file size: %d\n", headersize);
-        }
 
-        long int bodysize = 0;
-        bodysize = findSize(download);
-        if (bodysize == -1) {
-            returnstr = copyString("body file size is zero or some other error");
-	        if (debug==1) { 
-                printf("body file size is zero or some other error - aborting operation\n");
+// ***************************************************************************
+// add a reading to its tracker's queue: the tracker's readings are flushed
+//  straight away if this takes them to the count or byte size limit
+// ***************************************************************************
+int tiki_batch_add(tiki_batch* batch, const char* trackerId, const char* post_data)
+{
+    // trackerId: is a string of the integer Id of the tracker that the reading is to be 'posted' to
+    // post_data: is a string containing the field data details of the new tracker item
+    // returns the readingId that its itemId is reported with, or -1 if the batch is full or the reading could not be added
+    int i;
+
+    if (batch->pending >= batch->max_pending || strlen(trackerId) >= sizeof(batch->trackers[0].trackerId)) {
+        return -1;
+    }
+    // find the tracker's queue, adding a new one for a trackerId not seen before
+    for (i = 0; i < batch->ntrackers; i++) {
+        if (strcmp(batch->trackers[i].trackerId, trackerId) == 0) {
+            break;
+        }
+    }
+    if (i == batch->ntrackers) {
+        if (batch->ntrackers == batch->maxtrackers) {
+            int newmax = (batch->maxtrackers == 0) ? 4 : batch->maxtrackers * 2;
+            struct tiki_batch_tracker *ptr = realloc(batch->trackers, newmax * sizeof(struct tiki_batch_tracker));
+            if (ptr == NULL) {
+                return -1;
             }
-            curl_easy_cleanup(curl_handle);
-            curl_global_cleanup();
-            return returnstr;
+            batch->trackers = ptr;
+            batch->maxtrackers = newmax;
         }
+        memset(&batch->trackers[i], 0, sizeof(struct tiki_batch_tracker));
+        strcpy(batch->trackers[i].trackerId, trackerId);
+        batch->ntrackers++;
+    }
+    struct tiki_batch_tracker *tracker = &batch->trackers[i];
 
-	    if (debug==1) { 
-            printf("body file size: %d\n", bodysize);
-        }
+    struct tiki_batch_reading *reading = calloc(1, sizeof(struct tiki_batch_reading));
+    if (reading == NULL) {
+        return -1;
+    }
+    reading->post_data = copyString((char *)post_data);
+    if (reading->post_data == NULL) {
+        free(reading);
+        return -1;
+    }
+    reading->readingId = batch->nextId++;
+    if (tracker->tail == NULL) {
+        tracker->head = reading;
+        tracker->oldest_ms = batch_now_ms();
+    } else {
+        tracker->tail->next = reading;
+    }
+    tracker->tail = reading;
+    tracker->count++;
+    tracker->bytes += strlen(post_data);
+    batch->pending++;
+
+    int readingId = reading->readingId;    // the reading is freed if it is flushed now
+    if ((batch->max_count > 0 && tracker->count >= batch->max_count) ||
+        (batch->max_bytes > 0 && tracker->bytes >= batch->max_bytes)) {
+        batch_flush_tracker(batch, i);
+    }
+    return readingId;
+}
 
-        // now check if the download file should be renamed
-        if (strlen(bodyfilename) == 0) {    // a temporary file name has been used so it should be renamed
 
-            // now extract the actual file name from the response header file
+// ***************************************************************************
+// send every waiting reading now, whatever the limits
+// ***************************************************************************
+void tiki_batch_flush(tiki_batch* batch)
+{
+    int i;
+    for (i = 0; i < batch->ntrackers; i++) {
+        batch_flush_tracker(batch, i);
+    }
+}
 
-            // first reopen the header file for read only
-            headerfile = fopen(respheaders, "r");
-            if(!headerfile) {     // if the file cannot be opened abort the renaming
-	            if (debug==1)
-                {
-                    printf ("couldn't reopen the response header file\n");
-                }
 
-                returnstr = copyString(download);
-                strcat(returnstr, " downloaded as header file could not be reopened");
-                curl_easy_cleanup(curl_handle);
-                curl_global_cleanup();
-                return returnstr;
-               
-            } else {
- 
-                // read the response header file line by line looking for content-disposition
-                char *respline = "";
-                char resp[200] = "";
+// ***************************************************************************
+// the tiki_multi callback used when the batch has a callback: reports each
+//  item post's result against the reading that it was sent for
+// ***************************************************************************
+static void batch_multi_callback(int opId, const char* result, void* userdata)
+{
+    tiki_batch *batch = (tiki_batch *)userdata;
+    struct tiki_batch_slot *slot = batch_slot(batch, opId);
 
-                while ( fgets(resp,180,headerfile) != NULL) {
-	                if (debug==1)
-                    {
-                        printf ("line read from file is: %s\n", resp);
-                    }                            
-                    respline = copyString(resp);
-                    respline = strstr(respline, "attachment");  // respline would now be the whole string from 'attachment' onwards if it is found
-                    if ( respline != NULL )  {  // not NULL so attachment found in the line so this is the content-disposition line!                    
-                        // now strip away some of the front 
-                        respline = strstr(respline, "=");  // respline now has ="filename"
-	                    if (debug==1)
-                        {
-                            printf ("1st cropped found text is: %s\n", respline);
-                        }
+    batch->pending--;
+    batch->callback(slot->readingId, batch->trackers[slot->tracker].trackerId, result, batch->userdata);
+    slot->opId = 0;
+}
 
-                        // now remove the first two =" characters
-                        removeString(respline, 0, 2);
-	                    if (debug==1)
-                        {
-                            printf ("2nd cropped found text is: %s\n", respline);
-                        }
 
-                        // now remove everything from the final " character onwards
-                        char *ptr;
-                        ptr = strstr(respline, "\"");    // ptr is the pointer for " in 'respline'
-                        if (ptr != NULL) {
-                            *ptr = '\0';   // this makes the original " character the 'end of string' character
-                        }
-                        if (debug==1)
-                        {
-                            printf ("3rd cropped found text is: %s\n", respline);
-                        }
-                        break;  // as we have found the file name we can break the while loop
-                    } else {
-	                    if (debug==1)
-                        {
-                            printf ("text not found - reading next line\n");
-                        }
-                    }
-                }  // continue with the while loop reading each line
-                fclose(headerfile);
+// ***************************************************************************
+// set the function called with the itemId (or error message) of each
+//  reading as its item post completes: if no callback is set the results are
+//  kept until they are collected with tiki_batch_poll
+// ***************************************************************************
+void tiki_batch_setcallback(tiki_batch* batch, tiki_batch_callback callback, void* userdata)
+{
+    // callback: called with the readingId, trackerId and itemId or error text - these are only valid during the call
+    // userdata: passed unchanged to each call of the callback
+    batch->callback = callback;
+    batch->userdata = userdata;
+    tiki_multi_setcallback(batch->multi, (callback != NULL) ? batch_multi_callback : NULL, batch);
+}
 
-                // once here we should now have the actual file name in respline
-                char newdownload[100] = "";
-                strcat(newdownload, filespath);
-                strcat(newdownload, respline);
-	            if (debug==1)
-                {
-                    printf ("renaming the stored temporary download file\n");
-                    printf ("new file name is: %s\n", newdownload);
-                }
 
-                // now rename the temp file produced from the main download
-                rename(download, newdownload);
-	            if (debug==1)
-                {
-                    printf ("download file renamed\n");
-                }
-                returnstr = copyString(newdownload);
-                strcat(returnstr, " downloaded OK");
+// ***************************************************************************
+// flush the trackers whose oldest reading has waited long enough and move the
+//  item posts on, waiting up to timeout_ms for network activity - call this
+//  regularly (e.g. from the hub's main loop) or tiki_batch_run to finish off
+// ***************************************************************************
+int tiki_batch_perform(tiki_batch* batch, int timeout_ms)
+{
+    // timeout_ms: the longest time in milliseconds to wait for network activity - 0 does not wait
+    // returns the number of readings still waiting or in flight
+    int i;
+
+    if (batch->max_age_ms > 0) {
+        long long now_ms = batch_now_ms();
+        for (i = 0; i < batch->ntrackers; i++) {
+            if (batch->trackers[i].count > 0 && now_ms - batch->trackers[i].oldest_ms >= batch->max_age_ms) {
+                batch_flush_tracker(batch, i);
             }
-        } else {
-            returnstr = copyString(download);
-            strcat(returnstr, " downloaded OK");
         }
-
     }
-
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-	if (debug==1)
-    {
-        printf ("curl_handle cleaned up\n");
+    int inflight = tiki_multi_perform(batch->multi, timeout_ms);
+    for (i = 0; i < batch->ntrackers; i++) {
+        inflight += batch->trackers[i].count;
     }
+    return inflight;
+}
 
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-	if (debug==1)
-    {
-        printf ("curl_global cleaned up, and ...\n");
-        printf ("return string is: %s\n", returnstr);
-    }
-	return returnstr;
-}	
-	
 
-// ************************************************************************************
-//  new file gallery file upload function that uses a multipart/form-data Content-type
-// ************************************************************************************
-char* gallery_fileupload(int debug, const char* domain, char* access_token, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc)
+// ***************************************************************************
+// flush everything and wait for all the item posts to complete
+// ***************************************************************************
+void tiki_batch_run(tiki_batch* batch)
 {
-    // debug: if set to 1 this produces (lots!!) of additional output
-    // domain: string used for the main URL text that must include https:// but no trailing /
-    // access_token: the API access token that enables specific permissions for the API usage
-    // filepath: text string for the path/name of the file on the hub device to be uploaded
-    // galId: text string for the integer Id of the Tiki File gallery where the file is to be stored
-    // filename: text string of the just the name of the file without its ‘path’ details
-    // filetitle: text string of the short text File gallery title to be assigned to the file
-    // filedesc: text string of the longer text File gallery description to be assigned to the file
-
-	if (debug==1)
-    {
-        printf ("\n\n");
-        printf ("***************************************\n");
-        printf ("*** debug from gallery_fileupload ...\n");
-        printf ("***************************************\n\n");
+    tiki_batch_flush(batch);
+    while (tiki_batch_perform(batch, 1000) > 0) {
+        // keep going until everything has completed
     }
+}
 
-    char *response = "";
-    char *returnstr = "";
-    // build the full File gallery API URL
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, "/api/galleries/upload");
-
-	if (debug==1)
-    {
-       printf ("API URL is  : %s\n", API_URL);
-       printf ("filepath is : %s\n", filepath);
-       printf ("galleryId is: %s\n", galId);
-       printf ("filename is : %s\n", filename);
-       printf ("filetitle is: %s\n", filetitle);
-       printf ("filedesc is : %s\n", filedesc);
-	}	
-
-    // send data to the galleries file upload API
-
-    // memory used to store the response text
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;            /* no data at this point */
-
-    CURL *curl_handle;
-    CURLcode res;
-    curl_mime *form = NULL;
-    curl_mimepart *field = NULL;
 
-    curl_global_init(CURL_GLOBAL_ALL);
+// ***************************************************************************
+// collect the result of one completed reading when no callback is set: the
+//  returned itemId (or error message) must be released with tiki_free
+// ***************************************************************************
+char* tiki_batch_poll(tiki_batch* batch, int* readingId)
+{
+    // readingId: set to the Id returned when the completed reading was added
+    // returns the new itemId or an error message, or NULL if no more readings have completed
+    int opId = 0;
+    char *returnstr = tiki_multi_poll(batch->multi, &opId);
+    if (returnstr == NULL) {
+        return NULL;
+    }
+    struct tiki_batch_slot *slot = batch_slot(batch, opId);
+    if (readingId != NULL) {
+        *readingId = slot->readingId;
+    }
+    slot->opId = 0;
+    batch->pending--;
+    return returnstr;
+}
 
-    /* init the curl session */
-    curl_handle = curl_easy_init();
 
-    /* Create the virtual multi part form */
-    form = curl_mime_init(curl_handle);
+// ***************************************************************************
+// free a batch: readings that are still waiting or in flight are dropped
+// ***************************************************************************
+void tiki_batch_destroy(tiki_batch* batch)
+{
+    // batch: the batch created by tiki_batch_create - NULL is ignored
+    int i;
+    if (batch == NULL) {
+        return;
+    }
+    for (i = 0; i < batch->ntrackers; i++) {
+        struct tiki_batch_reading *reading;
+        while ((reading = batch->trackers[i].head) != NULL) {
+            batch->trackers[i].head = reading->next;
+            free(reading->post_data);
+            free(reading);
+        }
+    }
+    tiki_multi_destroy(batch->multi);
+    free(batch->trackers);
+    free(batch->slots);
+    free(batch);
+}
 
-    /* Fill in the file upload field */
-    field = curl_mime_addpart(form);
-    curl_mime_name(field, "data");
-    curl_mime_filedata(field, filepath);
 
-    field = curl_mime_addpart(form);
-    curl_mime_name(field, "galleryId");
-    curl_mime_data(field, galId, CURL_ZERO_TERMINATED);
+// ***************************************************************************
+// store-and-forward outbox: tracker item posts and updates are appended to a
+//  memory-mapped file, so they are kept through Tiki site outages and hub
+//  restarts, and a background thread replays them through a tiki_multi with
+//  exponential backoff while the site cannot be reached. Appends are fsync'ed
+//  in batches, and a record is only marked done once the site has answered,
+//  so after a crash a record may be sent twice but is never lost
+// ***************************************************************************
+static uint32_t outbox_checksum(const struct outbox_record *record)
+{
+    // FNV-1a over everything after the checksum field
+    const unsigned char *ptr = (const unsigned char *)&record->optype;
+    const unsigned char *end = (const unsigned char *)record + record->length;
+    uint32_t hash = 2166136261u;
+    while (ptr < end) {
+        hash = (hash ^ *ptr++) * 16777619u;
+    }
+    return hash;
+}
 
-    field = curl_mime_addpart(form);
-    curl_mime_name(field, "name");
-    curl_mime_data(field, filename, CURL_ZERO_TERMINATED);
+static struct outbox_header* outbox_header(tiki_outbox* outbox)
+{
+    return (struct outbox_header *)outbox->map;
+}
 
-    field = curl_mime_addpart(form);
-    curl_mime_name(field, "title");
-    curl_mime_data(field, filetitle, CURL_ZERO_TERMINATED);
+static struct outbox_record* outbox_record(tiki_outbox* outbox, uint64_t offset)
+{
+    return (struct outbox_record *)(outbox->map + offset);
+}
 
-    field = curl_mime_addpart(form);
-    curl_mime_name(field, "description");
-    curl_mime_data(field, filedesc, CURL_ZERO_TERMINATED);
 
-    /* specify URL to POST to */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
+// ***************************************************************************
+// make the outbox file (at least) needed bytes long and map it all
+// ***************************************************************************
+static int outbox_map(tiki_outbox* outbox, size_t needed)
+{
+    size_t newsize = (outbox->mapsize > 0) ? outbox->mapsize : TIKI_OUTBOX_MINSIZE;
+    while (newsize < needed) {
+        newsize *= 2;
+    }
+    if (newsize == outbox->mapsize) {
+        return 1;
+    }
+    if (ftruncate(outbox->fd, (off_t)newsize) != 0) {
+        TIKI_ERROR("tiki_outbox: the outbox file could not be grown to %lu bytes\n", (unsigned long)newsize);
+        return 0;
+    }
+    char *map = mmap(NULL, newsize, PROT_READ | PROT_WRITE, MAP_SHARED, outbox->fd, 0);
+    if (map == MAP_FAILED) {
+        TIKI_ERROR("tiki_outbox: the outbox file could not be mapped\n");
+        return 0;
+    }
+    if (outbox->map != NULL) {
+        munmap(outbox->map, outbox->mapsize);
+    }
+    outbox->map = map;
+    outbox->mapsize = newsize;
+    return 1;
+}
 
-    /* send all returned data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
+// ***************************************************************************
+// move the head past the records at the front that are done - once they all
+//  are, the file is used again from the start rather than growing forever
+// ***************************************************************************
+static void outbox_advance(tiki_outbox* outbox)
+{
+    struct outbox_header *header = outbox_header(outbox);
+    while (header->head < header->tail && outbox_record(outbox, header->head)->state == TIKI_OUTBOX_DONE) {
+        header->head += outbox_record(outbox, header->head)->length;
+    }
+    if (header->head == header->tail && outbox->ninflight == 0) {
+        header->head = TIKI_OUTBOX_HEADSIZE;
+        header->tail = TIKI_OUTBOX_HEADSIZE;
+        outbox->cursor = TIKI_OUTBOX_HEADSIZE;
+    }
+}
 
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
 
-    // set the custom headers - just needs the 'accept' and the access token
-    struct curl_slist *headchunk = NULL;
-    // Add the Content-Type header */
-    headchunk = curl_slist_append(headchunk, "Content-Type: multipart/form-data");
-    // Add the authorization access token header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
+// ***************************************************************************
+// flush the appended records (and the records marked done) to the storage
+// ***************************************************************************
+static void outbox_sync(tiki_outbox* outbox)
+{
+    // called with the lock held: the lock stays held so the mapping cannot be moved by an append meanwhile
+    if (msync(outbox->map, outbox->mapsize, MS_SYNC) != 0) {
+        TIKI_ERROR("tiki_outbox: msync of the outbox file failed\n");
+    }
+    outbox->unsynced = 0;
+}
 
-    curl_easy_setopt(curl_handle, CURLOPT_MIMEPOST, form);
 
-    /* POST it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-         fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-         returnstr = copyString("curl access to the Tiki site for File gallery file upload failed");
-    } else if (memchunk.size == 0) {
-         printf("the curl request may have been processed BUT there was no response from the server API\n");
-         returnstr = copyString("no response from the curl request sent to the server API");
-    } else {
-         /*
-         * Now, our memchunk.memory points to a memory block that is memchunk.size
-         * bytes big and contains the returned text from the API.
-         *
-         * multiple steps in the code below extract the returned new fileId from the memory block so it can be returned
-         */
-	     if (debug==1)
-         { 
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full text response is: %s\n", memchunk.memory);
-         }
+// ***************************************************************************
+// the outcome of one replayed record: it is done once the Tiki site has
+//  answered, unless the site could not be reached or is busy, in which case
+//  it is sent again - and after a few such failures in a row sending stops
+//  for a while, which doubles each time the site is found to be still down
+// ***************************************************************************
+static void outbox_complete(tiki_outbox* outbox, int opId, CURLcode res, long httpcode, const char* result)
+{
+    int i;
+    for (i = 0; i < outbox->ninflight; i++) {
+        if (outbox->inflight[i].opId == opId) {
+            break;
+        }
+    }
+    if (i == outbox->ninflight) {
+        return;
+    }
+    uint64_t offset = outbox->inflight[i].offset;
+    struct outbox_record *record = outbox_record(outbox, offset);
+    outbox->inflight[i] = outbox->inflight[--outbox->ninflight];
+
+    if (res != CURLE_OK || httpcode == 0 || httpcode == 408 || httpcode == 429 || httpcode >= 500) {
+        // the site could not be reached or cannot cope just now, so the record is sent again
+        if (offset < outbox->cursor) {
+            outbox->cursor = offset;
+        }
+        outbox->failures++;
+        // only a record sent once the last wait was over shows the site is still down - the others failing
+        //  now were already on their way when it went down, and must not double the wait again
+        if (outbox->failures >= outbox->down_after && batch_now_ms() >= outbox->retry_ms) {
+            long long wait_ms = (outbox->retry_wait_ms > 0) ? outbox->retry_wait_ms * 2 : TIKI_OUTBOX_RETRYMS;
+            if (wait_ms > TIKI_OUTBOX_MAXRETRYMS) {
+                wait_ms = TIKI_OUTBOX_MAXRETRYMS;
+            }
+            outbox->retry_wait_ms = wait_ms;
+            outbox->retry_ms = batch_now_ms() + wait_ms;
+            TIKI_DEBUG(outbox->debug, "tiki_outbox: %s (HTTP %ld) - trying again in %lld ms\n", result, httpcode, wait_ms);
+        }
+        return;
+    }
+    if (httpcode >= 400) {
+        // the site has refused the record itself, so sending it again would not help
+        TIKI_ERROR("tiki_outbox: record for trackerId %s refused with HTTP %ld: %s\n", record->trackerId, httpcode, result);
+    } else if (TIKI_DEBUGGING(outbox->debug)) {
+        log_write(TIKI_LOG_DEBUG, "tiki_outbox: record for trackerId %s sent: %s\n", record->trackerId, result);
+    }
+    outbox->failures = 0;
+    outbox->retry_wait_ms = 0;
+    record->state = TIKI_OUTBOX_DONE;
+    outbox->pending--;
+    if (outbox->unsynced++ == 0) {
+        outbox->unsynced_ms = batch_now_ms();
+    }
+    outbox_advance(outbox);
+}
 
-         // first of all check that the upload went OK by looking for "fileId" in memchunk
-         response = strstr(memchunk.memory, "fileId");        // response should now be the whole string from "fileId" onwards
 
-         if ( response != NULL )  {  // "fileId" string found!
-	         if (debug==1) {
-                 printf ("fileId found! Length of response string is now: %d\n", strlen(response) );
-             }
+static int outbox_isinflight(tiki_outbox* outbox, uint64_t offset)
+{
+    int i;
+    for (i = 0; i < outbox->ninflight; i++) {
+        if (outbox->inflight[i].offset == offset) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-             removeString(response, 0, 9);     // strip away the first 9 front end characters for just the fileId number and everything after
-	         if (debug==1)
-             {
-                 printf ("1st cropped found text is: %s\n", response);
-                 printf ("length of new response string is: %d\n", strlen(response) );
-             }
 
-             // now strip away everything at the end from 'galleryId' onwards
-             char *ptr;
-             ptr = strstr(response, "galleryId");    // ptr is the pointer for galleryId in 'response'
-             if (ptr != NULL) {
-                 *ptr = '\0';   // this makes the original ] character the 'end of string' character
-             }
-	         if (debug==1)
-             {
-                 printf ("2nd cropped response text is: %s\n", response);
-                 printf ("length of next new response string is: %d\n", strlen(response) );
-             }
+// ***************************************************************************
+// the background drain thread: sends the records through the tiki_multi,
+//  collects the results and fsyncs the outbox file in batches
+// ***************************************************************************
+static void* outbox_drain(void* arg)
+{
+    tiki_outbox *outbox = (tiki_outbox *)arg;
+
+    pthread_mutex_lock(&outbox->lock);
+    while (!outbox->stop) {
+        long long now_ms = batch_now_ms();
+        struct outbox_header *header = outbox_header(outbox);
+
+        if (now_ms >= outbox->retry_ms) {
+            while (outbox->ninflight < outbox->max_inflight && outbox->cursor < header->tail) {
+                uint64_t offset = outbox->cursor;
+                struct outbox_record *record = outbox_record(outbox, offset);
+                outbox->cursor += record->length;
+                if (record->state == TIKI_OUTBOX_DONE || outbox_isinflight(outbox, offset)) {
+                    continue;
+                }
+                int opId;
+                if (record->optype == TIKI_MULTI_ITEMUPDATE) {
+                    opId = tiki_multi_itemupdate(outbox->multi, record->trackerId, record->itemId, record->post_data);
+                } else {
+                    opId = tiki_multi_itempost(outbox->multi, record->trackerId, record->post_data);
+                }
+                if (opId < 0) {
+                    TIKI_ERROR("tiki_outbox: record for trackerId %s could not be queued\n", record->trackerId);
+                    continue;
+                }
+                outbox->inflight[outbox->ninflight].opId = opId;
+                outbox->inflight[outbox->ninflight].offset = offset;
+                outbox->ninflight++;
+                // one record at a time while the site is down, to find out when it is back
+                if (outbox->failures >= outbox->down_after) {
+                    break;
+                }
+            }
+        }
+        if (outbox->unsynced > 0 && (outbox->unsynced >= TIKI_OUTBOX_SYNCCOUNT || now_ms - outbox->unsynced_ms >= TIKI_OUTBOX_SYNCMS)) {
+            outbox_sync(outbox);
+        }
 
-             // now remove the final "," characters to leave just the fileId number 
-             removeString(response, strlen(response)-3,3);    
-             returnstr = copyString(response);
-	         if (debug==1)
-             {
-                 printf ("3rd cropped response is: %s\n", response);
-                 printf ("length of final response string is: %d\n", strlen(response) );
-                 printf ("returnstr set to         : %s\n", returnstr);
-             }
+        if (outbox->ninflight > 0) {
+            // the tiki_multi has its own copies of the post data, so the file can be appended to meanwhile
+            pthread_mutex_unlock(&outbox->lock);
+            tiki_multi_perform(outbox->multi, 50);
+            pthread_mutex_lock(&outbox->lock);
+            int opId;
+            CURLcode res;
+            long httpcode;
+            char *result;
+            while ((result = multi_poll_status(outbox->multi, &opId, &res, &httpcode, NULL, NULL)) != NULL) {
+                outbox_complete(outbox, opId, res, httpcode, result);
+                free(result);
+            }
+        } else {
+            // wait for an append, the next fsync or the end of the retry wait
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += TIKI_OUTBOX_SYNCMS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&outbox->wake, &outbox->lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&outbox->lock);
+    return NULL;
+}
 
-         } else {
-             printf ("\n*** fileId text not found in response!! ***");
-             printf ("\n\n");
-             returnstr = copyString("fileId text not found");
-	         if (debug==1)
-             {
-                 printf ("full response text is: %s\n", memchunk.memory);
-                 printf ("returnstr set to              : %s\n", returnstr);
-             }
 
-         }
+// ***************************************************************************
+// open (or create) an outbox file and start draining it to the Tiki site -
+//  any records left from before, e.g. by a power cut, are sent first
+// ***************************************************************************
+tiki_outbox* tiki_outbox_open(int debug, const char* filepath, const char* domain, char* access_token, int max_inflight)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // filepath: full path and name of the outbox file, which is created if it does not exist
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // max_inflight: the most records that are replayed at the same time
+    // returns a pointer to the open outbox or NULL if it could not be opened
+    if (max_inflight < 1) {
+        max_inflight = 1;
+    }
+    tiki_outbox *outbox = calloc(1, sizeof(tiki_outbox));
+    if (outbox == NULL) {
+        TIKI_ERROR("tiki_outbox_open() failed: not enough memory\n");
+        return NULL;
+    }
+    outbox->debug = debug;
+    outbox->max_inflight = max_inflight;
+    // with several records in flight a few unlucky ones can fail together while the site is up
+    outbox->down_after = max_inflight > TIKI_OUTBOX_FAILURES ? max_inflight : TIKI_OUTBOX_FAILURES;
+    outbox->inflight = calloc(max_inflight, sizeof(struct outbox_inflight));
+    outbox->fd = open(filepath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (outbox->inflight == NULL || outbox->fd < 0 || fstat(outbox->fd, &st) != 0) {
+        TIKI_ERROR("tiki_outbox_open() failed: %s could not be opened\n", filepath);
+        goto failed;
+    }
+    if (!outbox_map(outbox, (size_t)st.st_size)) {
+        goto failed;
+    }
 
+    struct outbox_header *header = outbox_header(outbox);
+    if (memcmp(header->magic, TIKI_OUTBOX_MAGIC, 8) != 0 || header->head < TIKI_OUTBOX_HEADSIZE ||
+        header->head > header->tail || header->tail > outbox->mapsize) {
+        // a new (or unreadable) outbox file so start it empty
+        memcpy(header->magic, TIKI_OUTBOX_MAGIC, 8);
+        header->head = TIKI_OUTBOX_HEADSIZE;
+        header->tail = TIKI_OUTBOX_HEADSIZE;
+    }
+    // check the records that are left, which end at the first one that was not completely written
+    uint64_t offset = header->head;
+    while (offset < header->tail) {
+        struct outbox_record *record = outbox_record(outbox, offset);
+        if (header->tail - offset < sizeof(struct outbox_record) || record->length < sizeof(struct outbox_record) ||
+            record->length % 8 != 0 || record->length > header->tail - offset || record->checksum != outbox_checksum(record)) {
+            TIKI_ERROR("tiki_outbox: %lu bytes of incomplete records at the end of %s dropped\n",
+                    (unsigned long)(header->tail - offset), filepath);
+            header->tail = offset;
+            break;
+        }
+        if (record->state != TIKI_OUTBOX_DONE) {
+            outbox->pending++;
+        }
+        offset += record->length;
     }
+    outbox->cursor = header->head;
+    outbox_advance(outbox);
 
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-	if (debug==1)
-    {
-        printf ("curl_handle cleaned up\n");
+    outbox->multi = tiki_multi_create(debug, domain, access_token, max_inflight);
+    if (outbox->multi == NULL) {
+        goto failed;
     }
-    free(memchunk.memory);
-	if (debug==1)
-    {
-        printf ("memchunk.memory freed\n");
+    pthread_mutex_init(&outbox->lock, NULL);
+    pthread_cond_init(&outbox->wake, NULL);
+    if (pthread_create(&outbox->thread, NULL, outbox_drain, outbox) != 0) {
+        TIKI_ERROR("tiki_outbox_open() failed: the drain thread could not be started\n");
+        pthread_mutex_destroy(&outbox->lock);
+        pthread_cond_destroy(&outbox->wake);
+        goto failed;
     }
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-	if (debug==1)
-    {
-        printf ("curl_global cleaned up, and ...\n");
-        printf ("return string is: %s\n", returnstr);
+    TIKI_DEBUG(debug, "\n *** debug from tiki_outbox_open ...\n");
+    TIKI_DEBUG(debug, "outbox %s opened with %d records to send\n", filepath, outbox->pending);
+    return outbox;
+
+failed:
+    tiki_multi_destroy(outbox->multi);
+    if (outbox->map != NULL) {
+        munmap(outbox->map, outbox->mapsize);
     }
-	return returnstr;
-}	
-	
+    if (outbox->fd >= 0) {
+        close(outbox->fd);
+    }
+    free(outbox->inflight);
+    free(outbox);
+    return NULL;
+}
 
-// ************************************************************************************
-//  function to update an existing file gallery file upload function that uses 
-//  a multipart/form-data Content-type and can optionally update the file contents 
-//  or just update the parameters associated with the file
-// ************************************************************************************
-char* gallery_fileupdate(int debug, const char* domain, char* access_token, const char* fileId, const char* filepath, const char* filename, const char* filetitle, const char* filedesc)
+
+// ***************************************************************************
+// append a tracker item post or update to the outbox file
+// ***************************************************************************
+static int outbox_append(tiki_outbox* outbox, int optype, const char* trackerId, const char* itemId, const char* post_data)
 {
-    // debug: if set to 1 this produces (lots!!) of additional output
-    // domain: string used for the main URL text that must include https:// but no trailing /
-    // access_token: the API access token that enables specific permissions for the API usage
-    // fileId: string text for the fileID# integer that is being updated
-    // filepath: string text for the full path-name of a file to replace the existing file - if left blank no change is made
-    // filename: string text to rename the file that is in Tiki - if left blank no change is made
-    // filetitle: string text to change the title of the file that is in Tiki - if left blank no change is made
-    // filedesc: string text to change the description of the file that is in Tiki - if left blank no change is made
+    size_t datalen = strlen(post_data) + 1;
+    size_t length = (sizeof(struct outbox_record) + datalen + 7) & ~(size_t)7;
 
-	if (debug==1)
-    {
-        printf ("\n\n");
-        printf ("***************************************\n");
-        printf ("*** debug from gallery_fileupdate ...\n");
-        printf ("***************************************\n\n");
+    if (strlen(trackerId) >= sizeof(((struct outbox_record *)0)->trackerId) ||
+        strlen(itemId) >= sizeof(((struct outbox_record *)0)->itemId)) {
+        return -1;
+    }
+    pthread_mutex_lock(&outbox->lock);
+    if (!outbox_map(outbox, outbox_header(outbox)->tail + length)) {
+        pthread_mutex_unlock(&outbox->lock);
+        return -1;
+    }
+    struct outbox_header *header = outbox_header(outbox);
+    struct outbox_record *record = outbox_record(outbox, header->tail);
+    memset(record, 0, length);
+    record->length = (uint32_t)length;
+    record->state = TIKI_OUTBOX_PENDING;
+    record->optype = (uint32_t)optype;
+    strcpy(record->trackerId, trackerId);
+    strcpy(record->itemId, itemId);
+    memcpy(record->post_data, post_data, datalen);
+    record->checksum = outbox_checksum(record);
+    // the record is only part of the outbox once the tail has moved past it
+    header->tail += length;
+    outbox->pending++;
+    if (outbox->unsynced++ == 0) {
+        outbox->unsynced_ms = batch_now_ms();
     }
+    pthread_cond_signal(&outbox->wake);
+    pthread_mutex_unlock(&outbox->lock);
+    return 0;
+}
 
-    char *response = "";
-    char *returnstr = "";
-    // build the full File gallery API URL
-	char API_URL[100] = "";
-    strcat(API_URL, domain);
-    strcat(API_URL, "/api/galleries/files/");
-    strcat(API_URL, fileId);
-    strcat(API_URL, "/update");
+int tiki_outbox_itempost(tiki_outbox* outbox, const char* trackerId, const char* post_data)
+{
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // post_data: is a string containing the field data details of the new tracker item
+    // returns 0 once the post is in the outbox, or -1 if it could not be added
+    return outbox_append(outbox, TIKI_MULTI_ITEMPOST, trackerId, "", post_data);
+}
 
-	if (debug==1)
-    {
-       printf ("API URL is  : %s\n", API_URL);
-       printf ("fileId is: %s\n", fileId);
-       printf ("filepath is : %s\n", filepath);
-       printf ("filename is : %s\n", filename);
-       printf ("filetitle is: %s\n", filetitle);
-       printf ("filedesc is : %s\n", filedesc);
-	}	
+int tiki_outbox_itemupdate(tiki_outbox* outbox, const char* trackerId, const char* itemId, const char* post_data)
+{
+    // trackerId: is a string of the integer Id of the tracker that is being 'posted' to
+    // itemId: is a string of the integer Id of the tracker item that is being updated
+    // post_data: is a string containing the updated field data details of the tracker item
+    // returns 0 once the update is in the outbox, or -1 if it could not be added
+    return outbox_append(outbox, TIKI_MULTI_ITEMUPDATE, trackerId, itemId, post_data);
+}
 
-    // send data to the galleries file update API
 
-    // memory used to store the response text
-    struct MemoryStruct memchunk;
-    memchunk.memory = malloc(1);  /* will be grown as needed by the realloc above */
-    memchunk.size = 0;            /* no data at this point */
+// ***************************************************************************
+// fsync the outbox file now rather than waiting for the next batch, e.g.
+//  before a planned shutdown - returns the number of records still to send
+// ***************************************************************************
+int tiki_outbox_sync(tiki_outbox* outbox)
+{
+    pthread_mutex_lock(&outbox->lock);
+    outbox_sync(outbox);
+    int pending = outbox->pending;
+    pthread_mutex_unlock(&outbox->lock);
+    return pending;
+}
 
-    CURL *curl_handle;
-    CURLcode res;
-    curl_mime *form = NULL;
-    curl_mimepart *field = NULL;
 
-    curl_global_init(CURL_GLOBAL_ALL);
+int tiki_outbox_pending(tiki_outbox* outbox)
+{
+    // returns the number of records that the Tiki site has not yet answered
+    pthread_mutex_lock(&outbox->lock);
+    int pending = outbox->pending;
+    pthread_mutex_unlock(&outbox->lock);
+    return pending;
+}
 
-    /* init the curl session */
-    curl_handle = curl_easy_init();
 
-    /* Create the virtual multi part form */
-    form = curl_mime_init(curl_handle);
+// ***************************************************************************
+// stop draining and close the outbox: records not yet sent stay in the
+//  file and are sent when it is next opened
+// ***************************************************************************
+void tiki_outbox_close(tiki_outbox* outbox)
+{
+    // outbox: the outbox opened by tiki_outbox_open - NULL is ignored
+    if (outbox == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&outbox->lock);
+    outbox->stop = 1;
+    pthread_cond_signal(&outbox->wake);
+    pthread_mutex_unlock(&outbox->lock);
+    pthread_join(outbox->thread, NULL);
+
+    outbox_sync(outbox);
+    tiki_multi_destroy(outbox->multi);
+    munmap(outbox->map, outbox->mapsize);
+    close(outbox->fd);
+    pthread_mutex_destroy(&outbox->lock);
+    pthread_cond_destroy(&outbox->wake);
+    free(outbox->inflight);
+    free(outbox);
+}
 
-    /* Fill in the file upload field but only if it has been set*/
-    if (strlen(filepath) > 0) {
-        if (debug==1) { 
-            printf("file contents is being updated\n");
-        }
-        field = curl_mime_addpart(form);
-        curl_mime_name(field, "data");
-        curl_mime_filedata(field, filepath);
-    } else {
-        if (debug==1) { 
-            printf("file contents are NOT being updated\n");
-        }
+
+
+// ***************************************************************************
+// resumable File gallery download: the file is written to a .part file in
+//  filespath (named from the fileId, so a later call finds it again) with a
+//  small checkpoint file beside it recording how far each Range segment has
+//  got. A dropped connection only costs a retry of that segment from where
+//  it stopped, and if the hub itself stops, calling this function again
+//  carries on from the last checkpoint. The server's ETag (or Last-Modified)
+//  is sent as If-Range, so if the file has changed meanwhile the whole new
+//  file is fetched instead of splicing two versions together - a server that
+//  sends neither has nothing to check a change against, so its files are
+//  always fetched whole from byte 0, with no Range segments or carrying on
+// ***************************************************************************
+static void range_checkpoint(struct range_download *download)
+{
+    // the data is made durable before the progress that claims it
+    fdatasync(download->fd);
+    download->unsynced = 0;
+    char tempname[220];
+    snprintf(tempname, sizeof(tempname), "%s.tmp", download->checkpoint);
+    FILE *fp = fopen(tempname, "w");
+    if (fp == NULL) {
+        TIKI_ERROR("resumable download: %s could not be written\n", tempname);
+        return;
+    }
+    fprintf(fp, "%s\n%s\n%s\n%lld\n%d\n%d\n", TIKI_RANGE_MAGIC, download->filename, download->validator,
+            (long long)download->size, download->ranged, download->nsegments);
+    int i;
+    for (i = 0; i < download->nsegments; i++) {
+        struct range_segment *segment = &download->segments[i];
+        fprintf(fp, "%lld %lld %lld\n", (long long)segment->start, (long long)segment->next, (long long)segment->end);
+    }
+    if (fclose(fp) != 0 || rename(tempname, download->checkpoint) != 0) {
+        TIKI_ERROR("resumable download: %s could not be written\n", download->checkpoint);
+        remove(tempname);
     }
+}
 
-    /* Fill in the file name field but only if it has been set*/
-    //  it should be noted that if the file name is changed but
-    //  the file title is not explcitly set below, the title will 
-    //  still be changed to text similar to the new name
-    if (strlen(filename) > 0) {
-        if (debug==1) { 
-            printf("file name is being updated\n");
-        }
-        field = curl_mime_addpart(form);
-        curl_mime_name(field, "name");
-        curl_mime_data(field, filename, CURL_ZERO_TERMINATED);
-    } else {
-        if (debug==1) { 
-            printf("file name is NOT being updated\n");
-        }
+static int range_loadcheckpoint(struct range_download *download)
+{
+    // returns 1 if there is a checkpoint to carry on from
+    char line[200];
+    long long size = -1, start, next, end;
+    int i;
+    FILE *fp = fopen(download->checkpoint, "r");
+    if (fp == NULL) {
+        return 0;
     }
-    /* Fill in the file title field but only if it has been set*/
-    if (strlen(filetitle) > 0) {
-        if (debug==1) { 
-            printf("file title is being updated\n");
-        }
-        field = curl_mime_addpart(form);
-        curl_mime_name(field, "title");
-        curl_mime_data(field, filetitle, CURL_ZERO_TERMINATED);
-    } else {
-        if (debug==1) { 
-            printf("file title is NOT being updated\n");
+    int valid = (fgets(line, sizeof(line), fp) != NULL && strncmp(line, TIKI_RANGE_MAGIC, strlen(TIKI_RANGE_MAGIC)) == 0
+                 && fgets(download->filename, sizeof(download->filename), fp) != NULL
+                 && fgets(download->validator, sizeof(download->validator), fp) != NULL
+                 && fscanf(fp, "%lld %d %d", &size, &download->ranged, &download->nsegments) == 3
+                 && download->nsegments >= 1 && download->nsegments <= TIKI_RANGE_MAXSEGMENTS);
+    for (i = 0; valid && i < download->nsegments; i++) {
+        valid = (fscanf(fp, "%lld %lld %lld", &start, &next, &end) == 3 && next >= start && (end < 0 || next <= end + 1));
+        if (valid) {
+            download->segments[i].start = start;
+            download->segments[i].next = next;
+            download->segments[i].end = end;
         }
     }
+    fclose(fp);
+    download->filename[strcspn(download->filename, "\n")] = 0;
+    download->validator[strcspn(download->validator, "\n")] = 0;
+    download->size = size;
+    // ranges without a validator can not be carried on from safely (a checkpoint from before this was checked)
+    return valid && download->filename[0] != 0 && (!download->ranged || download->validator[0] != 0);
+}
 
-    /* Fill in the file description field but only if it has been set*/
-    if (strlen(filedesc) > 0) {
-        if (debug==1) { 
-            printf("file description is being updated\n");
+
+// ***************************************************************************
+// curl callbacks for the probe request, which asks for the first byte only
+//  to learn the file size, name and validator and whether ranges work
+// ***************************************************************************
+static size_t RangeProbeHeaderCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t realsize = size * nitems;
+    struct range_download *download = (struct range_download *)userp;
+    int isetag = (realsize > 5 && strncasecmp(buffer, "ETag:", 5) == 0);
+
+    if (realsize > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        download->ranged = 0;
+        download->size = -1;
+        download->validator[0] = 0;
+    } else if (realsize > 14 && strncasecmp(buffer, "Content-Range:", 14) == 0) {
+        /* e.g. Content-Range: bytes 0-0/1234567 */
+        const char *slash = memchr(buffer, '/', realsize);
+        if (slash != NULL && slash[1] >= '0' && slash[1] <= '9') {
+            download->size = strtoll(slash + 1, NULL, 10);
+            download->ranged = 1;
         }
-        field = curl_mime_addpart(form);
-        curl_mime_name(field, "description");
-        curl_mime_data(field, filedesc, CURL_ZERO_TERMINATED);
-    } else {
-        if (debug==1) { 
-            printf("file description is NOT being updated\n");
+    } else if (isetag || (realsize > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0)) {
+        /* If-Range needs a strong ETag, which is preferred to Last-Modified whichever comes first */
+        const char *value = memchr(buffer, ':', realsize) + 1;
+        size_t len = realsize - (value - buffer);
+        while (len > 0 && (*value == ' ' || *value == '\t')) {
+            value++;
+            len--;
+        }
+        while (len > 0 && (value[len - 1] == '\r' || value[len - 1] == '\n' || value[len - 1] == ' ')) {
+            len--;
+        }
+        int weak = (len > 2 && strncmp(value, "W/", 2) == 0);
+        if (len < sizeof(download->validator) && !weak && (isetag || download->validator[0] == 0)) {
+            memcpy(download->validator, value, len);
+            download->validator[len] = 0;
         }
+    } else if (download->filename[0] == 0) {
+        header_filename(buffer, realsize, download->filename, sizeof(download->filename));
     }
+    return realsize;
+}
 
-    /* specify URL to POST to */
-    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
+static size_t RangeProbeWriteCallback(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+    struct range_download *download = (struct range_download *)userp;
+    /* the first byte of a ranged reply is fetched again with its segment - and a server that
+       ignored the range is sending the whole file, so the probe is stopped */
+    return download->ranged ? size * nmemb : 0;
+}
 
-    /* send all returned data to this function  */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 
-    /* we pass our 'memchunk' struct to the callback function */
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&memchunk);
+// ***************************************************************************
+// curl callbacks for the segments: each writes its bytes at its own offset
+//  in the .part file, and only takes a 206 reply to its own Range request
+//  (or a 200 if the server does not do ranges and the whole file is wanted)
+// ***************************************************************************
+static size_t RangeHeaderCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t realsize = size * nitems;
+    struct range_segment *segment = (struct range_segment *)userp;
+    if (realsize > 9 && strncmp(buffer, "HTTP/", 5) == 0) {
+        const char *code = memchr(buffer, ' ', realsize);
+        segment->status = (code != NULL) ? strtol(code + 1, NULL, 10) : 0;
+    }
+    return realsize;
+}
 
-    /* some servers do not like requests that are made without a user-agent field, so we provide one */
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+static size_t RangeWriteCallback(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    struct range_segment *segment = (struct range_segment *)userp;
+    struct range_download *download = segment->download;
+
+    if (download->ranged && segment->status == 200) {
+        /* the file has changed since the download started, so it has to start again */
+        download->restart = 1;
+        return 0;
+    }
+    if (segment->status != (download->ranged ? 206 : 200)) {
+        return 0;
+    }
+    if (segment->end >= 0 && segment->next + (curl_off_t)realsize > segment->end + 1) {
+        return 0;     /* more than was asked for */
+    }
+    size_t written = 0;
+    while (written < realsize) {
+        ssize_t n = pwrite(download->fd, (const char *)ptr + written, realsize - written, segment->next + written);
+        if (n < 0) {
+            TIKI_ERROR("resumable download: %s could not be written\n", download->part);
+            return 0;
+        }
+        written += n;
+    }
+    segment->next += realsize;
+    download->unsynced += realsize;
+    return realsize;
+}
 
-    // set the custom headers - just needs the 'accept' and the access token
-    struct curl_slist *headchunk = NULL;
-    // Add the Content-Type header */
-    headchunk = curl_slist_append(headchunk, "Content-Type: multipart/form-data");
-    // Add the authorization access token header */
-    headchunk = curl_slist_append(headchunk, access_token);
-    // set the headers   
+static void range_start(CURLM *multi_handle, tiki_session *session, struct range_download *download, struct range_segment *segment, const char *API_URL, struct curl_slist *headchunk)
+{
+    CURL *curl_handle = (segment->curl_handle != NULL) ? segment->curl_handle : share_easy_init();
+    curl_easy_reset(curl_handle);
+    segment->curl_handle = curl_handle;
+    segment->status = 0;
+    curl_easy_setopt(curl_handle, CURLOPT_URL, API_URL);
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
     curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headchunk);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, RangeHeaderCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)segment);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, RangeWriteCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)segment);
+    curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, (void *)segment);
+    /* the session's time limits and cancel handle - so a stalled connection on flaky WiFi counts as a failure rather than hanging the download */
+    request_limits(session, curl_handle);
+    if (download->ranged) {
+        char range[64];
+        snprintf(range, sizeof(range), "%lld-%lld", (long long)segment->next, (long long)segment->end);
+        curl_easy_setopt(curl_handle, CURLOPT_RANGE, range);
+    }
+    curl_multi_add_handle(multi_handle, curl_handle);
+}
 
-    curl_easy_setopt(curl_handle, CURLOPT_MIMEPOST, form);
 
-    /* POST it! */
-    res = curl_easy_perform(curl_handle);
-    curl_slist_free_all(headchunk); /* free the list */
- 
-    /* check for errors */
-    if(res != CURLE_OK) {
-         fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-         returnstr = copyString("curl access to the Tiki site for File gallery file update failed");
-    } else if (memchunk.size == 0) {
-         printf("the curl request may have been processed BUT there was no response from the server API\n");
-         returnstr = copyString("no response from the curl request sent to the server API");
-    } else {
-         /*
-         * Now, our memchunk.memory points to a memory block that is memchunk.size
-         * bytes big and contains the returned text from the API, which what is returned
-         */
-	     if (debug==1)
-         { 
-             printf("%lu bytes retrieved\n", (unsigned long)memchunk.size);
-             printf("the full text response is: %s\n", memchunk.memory);
-         }
+char* gallery_filedownload_resume(int debug, const char* domain, char* access_token, const char* fileId, const char* filespath, const char* bodyfilename, int segments, int max_retries)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // domain: string used for the main URL text that must include https:// but no trailing /
+    // access_token: the API access token that enables specific permissions for the API usage
+    // the other parameters are exactly as for gallery_filedownload_resume_session
+
+    char *returnstr = "";
+    tiki_session *session = tiki_session_create(debug, domain, access_token);
+    if (session == NULL) {
+        return copyString("curl session could not be created for File gallery file download");
+    }
+    returnstr = gallery_filedownload_resume_session(debug, session, fileId, filespath, bodyfilename, segments, max_retries);
+    tiki_session_destroy(session);
+	return returnstr;
+}
 
-         // first of all check that the upload went OK by looking for "fileId" in memchunk
-         response = strstr(memchunk.memory, "fileId");        // response should now be the whole string from "fileId" onwards
 
-         if ( response != NULL )  {  // "fileId" string found! so we did a successful update
-	         if (debug==1) {
-                 printf ("fileId found! So update was successful\n");
-             }
+// ********************************************************************************
+// resumable File gallery file download using an existing persistent session -
+//  every segment request runs within the session's time limits and stops when
+//  its cancel handle is set or the circuit breaker of its domain opens
+// ********************************************************************************
+char* gallery_filedownload_resume_session(int debug, tiki_session* session, const char* fileId, const char* filespath, const char* bodyfilename, int segments, int max_retries)
+{
+    // debug: if set to 1 this produces (lots!!) of additional output
+    // session: the persistent session created by tiki_session_create with the domain and access token to use
+    // fileId is Id of the file to be downloaded
+    // filespath is the folder path on the calling device where the downloaded file is to be stored and should
+    //    include both the first and last / character
+    // bodyfilename dictates the stored file name, or if left blank the file name is taken from the Content-Disposition
+    //    response header (or is tempdownload followed by the fileId if there is none)
+    // segments: the most Range requests that the file is fetched with at the same time - files smaller than
+    //    1 MB per segment use fewer
+    // max_retries: the most times in a row that a segment is tried again without getting any further
+    // returns "<path and file name> downloaded OK" or the reason it was not - an interrupted download can be
+    //    carried on by calling again with the same fileId and filespath - unless the Tiki site sends neither an
+    //    ETag nor a Last-Modified header, when every attempt fetches the whole file again from byte 0
 
-             returnstr = copyString(memchunk.memory);
-	         if (debug==1)
-             {
-                 printf ("returnstr set to memchunk.memory\n");
-             }
+    char *returnstr = "";
+    struct range_download *download = calloc(1, sizeof(struct range_download));
+    if (download == NULL) {
+        return copyString("not enough memory for the resumable File gallery file download");
+    }
+    download->debug = debug;
+    download->fd = -1;
+    if (segments < 1) {
+        segments = 1;
+    }
+    if (segments > TIKI_RANGE_MAXSEGMENTS) {
+        segments = TIKI_RANGE_MAXSEGMENTS;
+    }
+    snprintf(download->part, sizeof(download->part), "%sdownload%s.part", filespath, fileId);
+    snprintf(download->checkpoint, sizeof(download->checkpoint), "%s.ckpt", download->part);
+
+    char API_URL[200] = "";
+    snprintf(API_URL, sizeof(API_URL), "%s/api/galleries/%s/download", session->domain, fileId);
+    TIKI_DEBUG(debug, "\n *** debug from gallery_filedownload_resume ...\n");
+    TIKI_DEBUG(debug, "API URL is       : %s\n", API_URL);
+    TIKI_DEBUG(debug, "part filename    : %s\n", download->part);
+
+    int attempt;
+    int complete = 0;
+    CURLM *multi_handle = curl_multi_init();
+    struct curl_slist *headchunk = NULL;
+    for (attempt = 0; attempt < 2 && !complete; attempt++) {
+        int i;
+        download->restart = 0;
+        int resumed = (attempt == 0 && range_loadcheckpoint(download));
+        if (resumed) {
+            download->fd = open(download->part, O_RDWR);
+            resumed = (download->fd >= 0);
+        }
+        if (!resumed) {
+            // ask for the first byte to learn the size, name and validator of the file and whether ranges work
+            download->filename[0] = 0;
+            download->validator[0] = 0;
+            CURL *curl_handle = session_request(session, API_URL, session->formchunk);
+            /* byte ranges of a compressed response would not be ranges of the file, so the file is never asked for compressed */
+            curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, NULL);
+            curl_easy_setopt(curl_handle, CURLOPT_RANGE, "0-0");
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, RangeProbeHeaderCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)download);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, RangeProbeWriteCallback);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)download);
+            CURLcode res = session_perform(session, curl_handle, TIKI_CALL_FILEDOWNLOAD);
+            transfer_account(curl_handle, TIKI_CALL_FILEDOWNLOAD, -1, -1);
+            long httpcode = 0;
+            curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpcode);
+            if ((res != CURLE_OK && res != CURLE_WRITE_ERROR) || httpcode >= 400) {
+                TIKI_ERROR("resumable download of fileId %s failed: %s (HTTP %ld)\n", fileId, curl_easy_strerror(res), httpcode);
+                returnstr = copyString("curl access to the Tiki site for File gallery file download failed");
+                break;
+            }
+            if (strlen(bodyfilename) > 0) {
+                snprintf(download->filename, sizeof(download->filename), "%s", bodyfilename);
+            } else if (download->filename[0] == 0) {
+                snprintf(download->filename, sizeof(download->filename), "tempdownload%s", fileId);
+            }
+            if (download->ranged && download->validator[0] == 0) {
+                // with no ETag or Last-Modified to send as If-Range a change to the file part way through could not
+                //  be seen, and the segments could splice two versions together - so it is fetched whole from byte 0
+                TIKI_DEBUG(debug, "no ETag or Last-Modified from the Tiki site - the file is fetched without ranges\n");
+                download->ranged = 0;
+            }
+            // split the file into segments of at least TIKI_RANGE_MINSEGMENT
+            int nsegments = 1;
+            if (download->ranged) {
+                while (nsegments < segments && download->size / (nsegments + 1) >= TIKI_RANGE_MINSEGMENT) {
+                    nsegments++;
+                }
+            }
+            download->nsegments = nsegments;
+            for (i = 0; i < nsegments; i++) {
+                struct range_segment *segment = &download->segments[i];
+                segment->start = download->ranged ? download->size * i / nsegments : 0;
+                segment->next = segment->start;
+                segment->end = download->ranged ? download->size * (i + 1) / nsegments - 1 : -1;
+            }
+            download->fd = open(download->part, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (download->fd < 0) {
+                returnstr = copyString("download file location could not be opened");
+                break;
+            }
+            range_checkpoint(download);
+        }
+        TIKI_DEBUG(debug, "%s %s: %lld bytes in %d segment(s)%s\n", resumed ? "resuming" : "starting", download->filename, (long long)download->size, download->nsegments, download->ranged ? "" : " - the server does not do ranges");
+
+        // the If-Range condition goes with every segment request
+        curl_slist_free_all(headchunk);
+        headchunk = NULL;
+        struct curl_slist *item;
+        for (item = session->formchunk; item != NULL; item = item->next) {
+            headchunk = curl_slist_append(headchunk, item->data);
+        }
+        if (download->ranged && download->validator[0] != 0) {
+            char condition[160];
+            snprintf(condition, sizeof(condition), "If-Range: %s", download->validator);
+            headchunk = curl_slist_append(headchunk, condition);
+        }
 
-         } else {
-             printf ("\n*** fileId text not found in response!! ***");
-             printf ("\n\n");
-             returnstr = copyString("fileId text not found - so update was not successful");
-	         if (debug==1)
-             {
-                 printf ("full response text is: %s\n", memchunk.memory);
-                 printf ("returnstr set to     : %s\n", returnstr);
-             }
+        int remaining = 0;
+        int failed = 0;
+        for (i = 0; i < download->nsegments && !failed; i++) {
+            struct range_segment *segment = &download->segments[i];
+            segment->download = download;
+            segment->failures = 0;
+            segment->retry_ms = 0;
+            if (!download->ranged) {
+                /* without ranges there is nothing to carry on from */
+                segment->next = segment->start;
+                if (ftruncate(download->fd, 0) != 0) {
+                    TIKI_ERROR("resumable download: %s could not be written\n", download->part);
+                    failed = 1;
+                    break;
+                }
+            }
+            if (segment->end < 0 || segment->next <= segment->end) {
+                range_start(multi_handle, session, download, segment, API_URL, headchunk);
+                remaining++;
+            }
+        }
 
-         }
+        while (remaining > 0 && !failed && !download->restart) {
+            int running = 0;
+            int msgs_left = 0;
+            CURLMsg *msg;
+            curl_multi_perform(multi_handle, &running);
+            curl_multi_wait(multi_handle, NULL, 0, 100, NULL);
+            curl_multi_perform(multi_handle, &running);
+            while ((msg = curl_multi_info_read(multi_handle, &msgs_left)) != NULL) {
+                if (msg->msg != CURLMSG_DONE) {
+                    continue;
+                }
+                CURL *curl_handle = msg->easy_handle;
+                CURLcode res = msg->data.result;
+                struct range_segment *segment = NULL;
+                curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char **)&segment);
+                curl_off_t before = segment->next;
+                transfer_account(curl_handle, TIKI_CALL_FILEDOWNLOAD, -1, -1);
+                breaker_record(session->breaker, curl_handle, res);
+                curl_multi_remove_handle(multi_handle, curl_handle);
+                if (res == CURLE_OK && segment->status < 300 && (segment->end < 0 || segment->next > segment->end)) {
+                    remaining--;
+                    continue;
+                }
+                if (download->restart) {
+                    break;
+                }
+                // a cancelled download, or one whose site's breaker has opened, stops rather than trying again
+                CURLcode refused = request_refused(session);
+                if (refused != CURLE_OK) {
+                    TIKI_ERROR("resumable download of fileId %s stopped: %s\n", fileId, curl_easy_strerror(refused));
+                    failed = 1;
+                    break;
+                }
+                if (segment->status >= 400 && segment->status != 408 && segment->status != 429 && segment->status < 500) {
+                    TIKI_ERROR("resumable download of fileId %s refused with HTTP %ld\n", fileId, segment->status);
+                    failed = 1;
+                    break;
+                }
+                // try the segment again from where it got to, after a wait that grows while it gets nowhere
+                if (!download->ranged) {
+                    segment->next = segment->start;
+                    if (ftruncate(download->fd, 0) != 0) {
+                        TIKI_ERROR("resumable download: %s could not be written\n", download->part);
+                        failed = 1;
+                        break;
+                    }
+                }
+                segment->failures = (segment->next > before || segment->failures == 0) ? 1 : segment->failures + 1;
+                if (segment->failures > max_retries) {
+                    TIKI_ERROR("resumable download of fileId %s failed: %s\n", fileId, curl_easy_strerror(res));
+                    failed = 1;
+                    break;
+                }
+                long long wait_ms = TIKI_RANGE_RETRYMS;
+                for (i = 1; i < segment->failures && wait_ms < TIKI_RANGE_MAXRETRYMS; i++) {
+                    wait_ms *= 2;
+                }
+                segment->retry_ms = batch_now_ms() + (wait_ms < TIKI_RANGE_MAXRETRYMS ? wait_ms : TIKI_RANGE_MAXRETRYMS);
+                TIKI_DEBUG(debug, "segment at %lld failed (%s) - trying again from %lld in %lld ms\n", (long long)segment->start, curl_easy_strerror(res), (long long)segment->next, wait_ms);
+                range_checkpoint(download);
+            }
+            if (download->unsynced >= TIKI_RANGE_CHECKPOINT) {
+                range_checkpoint(download);
+            }
+            // restart the failed segments whose wait is over
+            long long now_ms = batch_now_ms();
+            CURLcode refused = request_refused(session);
+            for (i = 0; i < download->nsegments && !failed && !download->restart; i++) {
+                struct range_segment *segment = &download->segments[i];
+                if (segment->retry_ms != 0 && refused != CURLE_OK) {
+                    TIKI_ERROR("resumable download of fileId %s stopped: %s\n", fileId, curl_easy_strerror(refused));
+                    failed = 1;
+                } else if (segment->retry_ms != 0 && segment->retry_ms <= now_ms) {
+                    segment->retry_ms = 0;
+                    range_start(multi_handle, session, download, segment, API_URL, headchunk);
+                }
+            }
+        }
+        for (i = 0; i < download->nsegments; i++) {
+            if (download->segments[i].curl_handle != NULL) {
+                curl_multi_remove_handle(multi_handle, download->segments[i].curl_handle);
+                curl_easy_cleanup(download->segments[i].curl_handle);
+                download->segments[i].curl_handle = NULL;
+            }
+        }
 
-    }
+        if (download->restart) {
+            // the file changed on the server, so the next attempt starts again from a new probe
+            TIKI_DEBUG(debug, "the file has changed on the Tiki site - starting the download again\n");
+            close(download->fd);
+            download->fd = -1;
+            continue;
+        }
+        if (failed) {
+            range_checkpoint(download);
+            returnstr = concatString(download->part, " download interrupted - call again to carry on from where it stopped");
+            break;
+        }
 
-    /* cleanup curl stuff */
-    curl_easy_cleanup(curl_handle);
-	if (debug==1)
-    {
-        printf ("curl_handle cleaned up\n");
+        // all segments are complete: move the file to its final name
+        char target[300] = "";
+        snprintf(target, sizeof(target), "%s%s", filespath, download->filename);
+        if (fsync(download->fd) != 0 || rename(download->part, target) != 0) {
+            returnstr = copyString("download file could not be moved to its final name");
+            break;
+        }
+        remove(download->checkpoint);
+        complete = 1;
+        returnstr = concatString(target, " downloaded OK");
     }
-    free(memchunk.memory);
-	if (debug==1)
-    {
-        printf ("memchunk.memory freed\n");
+    if (!complete && returnstr[0] == 0) {
+        returnstr = copyString("the file kept changing on the Tiki site during the download");
     }
-    /* we are done with libcurl, so clean it up */
-    curl_global_cleanup();
-	if (debug==1)
-    {
-        printf ("curl_global cleaned up, and ...\n");
+
+    if (download->fd >= 0) {
+        close(download->fd);
     }
+    curl_slist_free_all(headchunk);
+    curl_multi_cleanup(multi_handle);
+    free(download);
+    TIKI_DEBUG(debug, "return string is: %s\n", returnstr);
 	return returnstr;
-}	
-	
+}
@@ -1,29 +1,201 @@
+typedef struct tiki_session tiki_session;
+
+typedef struct tiki_multi tiki_multi;
+
+typedef void (*tiki_multi_callback)(int opId, const char* result, void* userdata);
+
+typedef struct tiki_batch tiki_batch;
+
+typedef void (*tiki_batch_callback)(int readingId, const char* trackerId, const char* itemId, void* userdata);
+
+typedef struct tiki_outbox tiki_outbox;
+
+typedef struct tiki_datetime tiki_datetime;
+
+typedef struct tiki_cancel tiki_cancel;
+
 long int findSize(const char* file_name);
 
 char* copyString(char s[]);
 
+char* concatString(const char* s1, const char* s2);
+
+void tiki_free(char* result);
+
 void removeString (char text[], int index, int rm_length);
 
 void connect_iot();
 
+int tiki_log_start(const char* filepath);
+
+void tiki_log_stop(void);
+
+tiki_session* tiki_session_create(int debug, const char* domain, char* access_token);
+
+void tiki_session_destroy(tiki_session* session);
+
+int tiki_prewarm(int debug, const char* domain, int connections);
+
+void tiki_session_setarena(tiki_session* session, size_t maxsize);
+
+void tiki_session_setcache(tiki_session* session, int max_entries, size_t max_bytes, const char* cachedir);
+
+void tiki_session_setdedup(tiki_session* session, const char* indexpath);
+
+void tiki_setcompression(int accept, size_t post_min);
+
+void tiki_session_setcompression(tiki_session* session, int accept, size_t post_min);
+
+void tiki_settimeouts(long connect_ms, long deadline_ms, long stall_ms);
+
+void tiki_session_settimeouts(tiki_session* session, long connect_ms, long deadline_ms, long stall_ms);
+
+tiki_cancel* tiki_cancel_create(void);
+
+void tiki_cancel_trigger(tiki_cancel* cancel);
+
+void tiki_cancel_reset(tiki_cancel* cancel);
+
+void tiki_cancel_destroy(tiki_cancel* cancel);
+
+void tiki_session_setcancel(tiki_session* session, tiki_cancel* cancel);
+
+void tiki_setbreaker(int failures, long probe_ms);
+
+int tiki_breaker_open(const char* domain);
+
+int tiki_setratelimit(const char* domain, double per_second, int burst);
+
+void tiki_wirestats(long long* sent, long long* sent_plain, long long* received, long long* received_plain);
+
+long long tiki_stats_latency(const char* call, const char* phase, double quantile, double* seconds);
+
+long long tiki_stats_bytes(const char* call, long long* sent, long long* received);
+
+long long tiki_stats_queuewait(const char* priority, double quantile, double* seconds);
+
+int tiki_stats_dump(const char* filepath);
+
+void tiki_session_setpriority(tiki_session* session, int priority);
+
 char* webpage_download(int debug, const char* domain, const char* page, char* access_token);
 
+char* webpage_download_session(int debug, tiki_session* session, const char* page);
+
 _Bool webpage_check(int debug, const char* domain, const char* page, char* access_token, const char* check_text);
 
+_Bool webpage_check_session(int debug, tiki_session* session, const char* page, const char* check_text);
+
+unsigned long long webpage_checkall(int debug, const char* domain, const char* page, char* access_token, const char** check_texts, int ntexts, long* offsets);
+
+unsigned long long webpage_checkall_session(int debug, tiki_session* session, const char* page, const char** check_texts, int ntexts, long* offsets);
+
 char* webpage_datetimecheck(int debug, const char* domain, const char* page, char* access_token, const char* infront_text, int datelen, const char* ref_datetime, const char* datetime_fmt);
 
+tiki_datetime* tiki_datetime_compile(const char* datetime_fmt);
+
+void tiki_datetime_free(tiki_datetime* parser);
+
+int tiki_datetime_parse(tiki_datetime* parser, const char* text, time_t* epoch);
+
+char* webpage_datetimecheck_session(int debug, tiki_session* session, const char* page, const char* infront_text, int datelen, const char* ref_datetime, const char* datetime_fmt);
+
+int webpage_datetimecheck_batch(int debug, tiki_session* session, tiki_datetime* parser, int npairs, const char** pages, const char** infront_texts, int datelen, const char* ref_datetime, int* results);
+
 static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp);
 
 static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream);
 
 char* tracker_itempost(int debug, const char* domain, char* access_token, const char* trackerId, const char* post_data);
 
+char* tracker_itempost_session(int debug, tiki_session* session, const char* trackerId, const char* post_data);
+
 char* tracker_itemupdate(int debug, const char* domain, char* access_token, const char* trackerId, const char* itemId, const char* post_data);
 
+char* tracker_itemupdate_session(int debug, tiki_session* session, const char* trackerId, const char* itemId, const char* post_data);
+
 char* tracker_itemget(int debug, const char* domain, char* access_token, const char* trackerId, const char* itemId);
 
+char* tracker_itemget_session(int debug, tiki_session* session, const char* trackerId, const char* itemId);
+
 char* gallery_filedownload(int debug, const char* domain, char* access_token, const char* fileId, const char* filespath, const char* bodyfilename, const char* headerfilename);
 
+char* gallery_filedownload_session(int debug, tiki_session* session, const char* fileId, const char* filespath, const char* bodyfilename, const char* headerfilename);
+
+int gallery_filedownload_batch(int debug, const char* domain, char* access_token, int nfiles, const char** fileIds, const char* filespath, int max_inflight, char** results, long long* bytes, double* seconds);
+
+char* gallery_filedownload_resume(int debug, const char* domain, char* access_token, const char* fileId, const char* filespath, const char* bodyfilename, int segments, int max_retries);
+
+char* gallery_filedownload_resume_session(int debug, tiki_session* session, const char* fileId, const char* filespath, const char* bodyfilename, int segments, int max_retries);
+
 char* gallery_fileupload(int debug, const char* domain, char* access_token, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc);
 
+char* gallery_fileupload_session(int debug, tiki_session* session, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc);
+
+char* gallery_fileupload_buffer(int debug, const char* domain, char* access_token, const char* buffer, size_t size, const char* galId, const char* filename, const char* filetitle, const char* filedesc);
+
+char* gallery_fileupload_buffer_session(int debug, tiki_session* session, const char* buffer, size_t size, const char* galId, const char* filename, const char* filetitle, const char* filedesc);
+
 char* gallery_fileupdate(int debug, const char* domain, char* access_token, const char* fileId, const char* filepath, const char* filename, const char* filetitle, const char* filedesc);
+
+char* gallery_fileupdate_session(int debug, tiki_session* session, const char* fileId, const char* filepath, const char* filename, const char* filetitle, const char* filedesc);
+
+char* gallery_fileupdate_buffer(int debug, const char* domain, char* access_token, const char* fileId, const char* buffer, size_t size, const char* filename, const char* filetitle, const char* filedesc);
+
+char* gallery_fileupdate_buffer_session(int debug, tiki_session* session, const char* fileId, const char* buffer, size_t size, const char* filename, const char* filetitle, const char* filedesc);
+
+tiki_multi* tiki_multi_create(int debug, const char* domain, char* access_token, int max_inflight);
+
+void tiki_multi_setcallback(tiki_multi* multi, tiki_multi_callback callback, void* userdata);
+
+void tiki_multi_setcancel(tiki_multi* multi, tiki_cancel* cancel);
+
+void tiki_multi_setpriority(tiki_multi* multi, int priority);
+
+int tiki_multi_itempost(tiki_multi* multi, const char* trackerId, const char* post_data);
+
+int tiki_multi_itemupdate(tiki_multi* multi, const char* trackerId, const char* itemId, const char* post_data);
+
+int tiki_multi_itemget(tiki_multi* multi, const char* trackerId, const char* itemId);
+
+int tiki_multi_filedownload(tiki_multi* multi, const char* fileId, const char* filespath, const char* bodyfilename);
+
+int tiki_multi_fileupload(tiki_multi* multi, const char* filepath, const char* galId, const char* filename, const char* filetitle, const char* filedesc);
+
+int tiki_multi_perform(tiki_multi* multi, int timeout_ms);
+
+void tiki_multi_wakeup(tiki_multi* multi);
+
+void tiki_multi_run(tiki_multi* multi);
+
+char* tiki_multi_poll(tiki_multi* multi, int* opId);
+
+void tiki_multi_destroy(tiki_multi* multi);
+
+tiki_batch* tiki_batch_create(int debug, const char* domain, char* access_token, int max_inflight, int max_pending, int max_count, size_t max_bytes, int max_age_ms);
+
+int tiki_batch_add(tiki_batch* batch, const char* trackerId, const char* post_data);
+
+void tiki_batch_flush(tiki_batch* batch);
+
+void tiki_batch_setcallback(tiki_batch* batch, tiki_batch_callback callback, void* userdata);
+
+int tiki_batch_perform(tiki_batch* batch, int timeout_ms);
+
+void tiki_batch_run(tiki_batch* batch);
+
+char* tiki_batch_poll(tiki_batch* batch, int* readingId);
+
+void tiki_batch_destroy(tiki_batch* batch);
+
+tiki_outbox* tiki_outbox_open(int debug, const char* filepath, const char* domain, char* access_token, int max_inflight);
+
+int tiki_outbox_itempost(tiki_outbox* outbox, const char* trackerId, const char* post_data);
+
+int tiki_outbox_itemupdate(tiki_outbox* outbox, const char* trackerId, const char* itemId, const char* post_data);
+
+int tiki_outbox_sync(tiki_outbox* outbox);
+
+int tiki_outbox_pending(tiki_outbox* outbox);
+
+void tiki_outbox_close(tiki_outbox* outbox);
@@ -0,0 +1,1367 @@
+// tiki_iot_module_240807.c - native CPython extension module 'tiki_iot' over the control_iot_240807.c functions
+// The ctypes route used by the Python templates works, but every call goes through ctypes argument
+//  conversion, every result is copied into a new Python string and then has to be handed back to
+//  tiki_free, and nothing can be awaited - so this module wraps the same functions directly:
+//   - tiki_iot.Session wraps a tiki_session, and releases the GIL for the whole of each call so other
+//      Python threads (e.g. the ones reading satellite sockets) keep running during the network I/O
+//   - every call returns a tiki_iot.Result, which owns the text the library returned and exposes it
+//      through the buffer protocol, so memoryview(result) uses the library's memory without a copy
+//      (bytes(result) and str(result) make a copy when one is really wanted)
+//   - the upload/update 'buffer' calls accept any bytes-like object (bytes, bytearray, memoryview,
+//      numpy arrays ...) and pass its memory straight to the library, again without a copy
+//   - tiki_iot.Multi wraps a tiki_multi driven by its own thread, and its calls return asyncio
+//      futures, so an asyncio hub can 'await' tracker posts while it carries on taking in readings
+
+// compiled using gcc on a local 'integrating' hub device using the command:
+// gcc -shared -fPIC -O2 -o /your_file_path/tiki_iot$(python3-config --extension-suffix) /your_file_path/tiki_iot_module_240807.c /your_file_path/control_iot_240807.c $(python3-config --includes) -I/usr/local/include -L/usr/local/lib -lcurl -lz -lpthread
+// The following 'install' may be needed on a RPi as well as the libcurl4-openssl-dev one:
+// sudo apt-get install python3-dev   (this is needed to avoid a gcc fatal error from Python.h not being found)
+// Python 3.7 or later is needed, e.g. the 3.9 of Raspberry Pi OS Bullseye
+
+// then in Python, with the compiled module in the same folder or on the PYTHONPATH:
+//  import tiki_iot
+//  session = tiki_iot.Session(domain, access_token)
+//  result = session.itempost(trackerId, post_data)    # all the arguments are ordinary str objects
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "control_iot_240807.h"
+
+// the tiki_multi calls that a Multi can queue
+#define MULTI_ITEMPOST       0
+#define MULTI_ITEMUPDATE     1
+#define MULTI_ITEMGET        2
+#define MULTI_FILEDOWNLOAD   3
+#define MULTI_FILEUPLOAD     4
+#define MULTI_MAXARGS        5    // the most string arguments a queued call has
+
+#define MULTI_WAIT_MS     1000    // longest the driver thread waits for network activity before checking for new calls
+
+static PyObject *resolve_func = NULL;    // tiki_iot._resolve, used to complete a future on its event loop
+
+
+// ***************************************************************************
+// ***************************************************************************
+// tiki_iot.Result - the text returned by one library call
+// ***************************************************************************
+// ***************************************************************************
+typedef struct {
+    PyObject_HEAD
+    char *text;            // the result exactly as returned by the library, released with tiki_free
+    Py_ssize_t len;
+} ResultObject;
+
+static PyTypeObject ResultType;
+
+
+// ***************************************************************************
+// wrap a result returned by the library - the new Result takes over the text
+// ***************************************************************************
+static PyObject* result_new(char* text)
+{
+    // text: result string returned by one of the library functions (NULL if it ran out of memory)
+
+    if (text == NULL) {
+        return PyErr_NoMemory();
+    }
+    ResultObject *self = PyObject_New(ResultObject, &ResultType);
+    if (self == NULL) {
+        tiki_free(text);
+        return NULL;
+    }
+    self->text = text;
+    self->len = (Py_ssize_t)strlen(text);
+    return (PyObject*)self;
+}
+
+
+static void result_dealloc(ResultObject *self)
+{
+    tiki_free(self->text);
+    PyObject_Free(self);
+}
+
+
+// ***************************************************************************
+// buffer protocol - a read only view straight onto the library's text, so a
+//  memoryview/bytearray/json.loads etc needs no intermediate copy; the view
+//  keeps the Result (and so the text) alive for as long as it is used
+// ***************************************************************************
+static int result_getbuffer(ResultObject *self, Py_buffer *view, int flags)
+{
+    return PyBuffer_FillInfo(view, (PyObject*)self, self->text, self->len, 1, flags);
+}
+
+
+static PyObject* result_str(ResultObject *self)
+{
+    return PyUnicode_DecodeUTF8(self->text, self->len, "replace");
+}
+
+
+static PyObject* result_repr(ResultObject *self)
+{
+    PyObject *text = result_str(self);
+    if (text == NULL) {
+        return NULL;
+    }
+    PyObject *repr = PyUnicode_FromFormat("tiki_iot.Result(%R)", text);
+    Py_DECREF(text);
+    return repr;
+}
+
+
+static PyObject* result_bytes(ResultObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return PyBytes_FromStringAndSize(self->text, self->len);
+}
+
+
+static Py_ssize_t result_length(ResultObject *self)
+{
+    return self->len;
+}
+
+
+static PyBufferProcs result_as_buffer = {
+    .bf_getbuffer = (getbufferproc)result_getbuffer,
+};
+
+static PySequenceMethods result_as_sequence = {
+    .sq_length = (lenfunc)result_length,
+};
+
+static PyMethodDef result_methods[] = {
+    {"__bytes__", (PyCFunction)result_bytes, METH_NOARGS, "copy of the result text as bytes"},
+    {NULL}
+};
+
+static PyTypeObject ResultType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "tiki_iot.Result",
+    .tp_doc = "text returned by a tiki_iot call - use memoryview() for zero copy access, or bytes()/str() for a copy",
+    .tp_basicsize = sizeof(ResultObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)result_dealloc,
+    .tp_repr = (reprfunc)result_repr,
+    .tp_str = (reprfunc)result_str,
+    .tp_as_buffer = &result_as_buffer,
+    .tp_as_sequence = &result_as_sequence,
+    .tp_methods = result_methods,
+};
+
+
+// ***************************************************************************
+// ***************************************************************************
+// tiki_iot.Cancel - a tiki_cancel handle that stops the calls of the Sessions
+//  and Multis it is given to, e.g. from another thread on shutdown
+// ***************************************************************************
+// ***************************************************************************
+typedef struct {
+    PyObject_HEAD
+    tiki_cancel *cancel;
+} CancelObject;
+
+static PyTypeObject CancelType;
+
+
+static int cancel_init(CancelObject *self, PyObject *args, PyObject *kwds)
+{
+    if (!PyArg_ParseTuple(args, "")) {
+        return -1;
+    }
+    if (self->cancel == NULL && (self->cancel = tiki_cancel_create()) == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+
+static void cancel_dealloc(CancelObject *self)
+{
+    // the Sessions and Multis it is set on hold a reference, so none of them can still be using it
+    if (self->cancel != NULL) {
+        tiki_cancel_destroy(self->cancel);
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+
+static PyObject* cancel_trigger(CancelObject *self, PyObject *Py_UNUSED(ignored))
+{
+    tiki_cancel_trigger(self->cancel);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* cancel_reset(CancelObject *self, PyObject *Py_UNUSED(ignored))
+{
+    tiki_cancel_reset(self->cancel);
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef cancel_methods[] = {
+    {"trigger", (PyCFunction)cancel_trigger, METH_NOARGS, "trigger() - abort the calls in flight and fail new ones, until reset"},
+    {"reset", (PyCFunction)cancel_reset, METH_NOARGS, "reset() - let calls go ahead again"},
+    {NULL}
+};
+
+static PyTypeObject CancelType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "tiki_iot.Cancel",
+    .tp_doc = "Cancel() - a cancel handle for Session.configure(cancel=...) and Multi(..., cancel=...)",
+    .tp_basicsize = sizeof(CancelObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)cancel_init,
+    .tp_dealloc = (destructor)cancel_dealloc,
+    .tp_methods = cancel_methods,
+};
+
+
+// ***************************************************************************
+// ***************************************************************************
+// tiki_iot.Session - blocking calls over one tiki_session, run without the GIL
+// ***************************************************************************
+// ***************************************************************************
+typedef struct {
+    PyObject_HEAD
+    tiki_session *session;
+    int debug;
+    int busy;              // set while a call is using the session with the GIL released
+    PyObject *cancel;      // the tiki_iot.Cancel set on the session, kept alive for as long as it is set
+} SessionObject;
+
+
+// ***************************************************************************
+// claim the session for one call - a tiki_session must only be used by one
+//  thread at a time, so a second Python thread gets an exception rather than
+//  two threads sharing the one curl handle
+// ***************************************************************************
+static int session_take(SessionObject *self)
+{
+    if (self->session == NULL) {
+        PyErr_SetString(PyExc_ValueError, "the tiki_iot.Session has been closed");
+        return 0;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the tiki_iot.Session is already in use by another thread - use one Session per thread");
+        return 0;
+    }
+    self->busy = 1;
+    return 1;
+}
+
+
+static int session_init(SessionObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"domain", "access_token", "debug", NULL};
+    const char *domain;
+    const char *access_token;
+    int debug = 0;
+    tiki_session *session;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss|i", kwlist, &domain, &access_token, &debug)) {
+        return -1;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the tiki_iot.Session is in use by another thread");
+        return -1;
+    }
+    if (self->session != NULL) {
+        tiki_session_destroy(self->session);
+        self->session = NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    session = tiki_session_create(debug, domain, (char*)access_token);
+    Py_END_ALLOW_THREADS
+
+    if (session == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tiki_session_create failed");
+        return -1;
+    }
+    self->session = session;
+    self->debug = debug;
+    return 0;
+}
+
+
+static void session_dealloc(SessionObject *self)
+{
+    if (self->session != NULL) {
+        tiki_session_destroy(self->session);
+    }
+    Py_XDECREF(self->cancel);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+
+static PyObject* session_close(SessionObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the tiki_iot.Session is in use by another thread");
+        return NULL;
+    }
+    if (self->session != NULL) {
+        tiki_session_destroy(self->session);
+        self->session = NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* session_enter(SessionObject *self, PyObject *Py_UNUSED(ignored))
+{
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+
+static PyObject* session_exit(SessionObject *self, PyObject *args)
+{
+    return session_close(self, NULL);
+}
+
+
+// ***************************************************************************
+// set the session options - the same as tiki_session_setarena/setcache/
+//  setdedup/setcompression/settimeouts/setcancel/setpriority, with the library
+//  defaults for anything not given
+// ***************************************************************************
+static PyObject* session_configure(SessionObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"arena", "cache_entries", "cache_bytes", "cachedir", "dedup", "compress", "compress_min",
+                             "timeouts", "cancel", "priority", NULL};
+    Py_ssize_t arena = -1;
+    int cache_entries = -1;
+    Py_ssize_t cache_bytes = 0;
+    const char *cachedir = NULL;
+    const char *dedup = NULL;
+    int compress = -1;
+    Py_ssize_t compress_min = 0;
+    long timeouts[3] = {-1, 0, 0};
+    PyObject *cancel = NULL;
+    int priority = -2;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$nnnzzin(lll)Oi", kwlist, &arena, &cache_entries, &cache_bytes,
+                                     &cachedir, &dedup, &compress, &compress_min,
+                                     &timeouts[0], &timeouts[1], &timeouts[2], &cancel, &priority)) {
+        return NULL;
+    }
+    if (cancel != NULL && cancel != Py_None && !PyObject_TypeCheck(cancel, &CancelType)) {
+        PyErr_SetString(PyExc_TypeError, "cancel must be a tiki_iot.Cancel or None");
+        return NULL;
+    }
+    if (!session_take(self)) {
+        return NULL;
+    }
+    if (cancel != NULL) {
+        tiki_session_setcancel(self->session, (cancel != Py_None) ? ((CancelObject*)cancel)->cancel : NULL);
+        if (cancel == Py_None) {
+            cancel = NULL;
+        }
+        Py_XINCREF(cancel);
+        Py_XSETREF(self->cancel, cancel);
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if (timeouts[0] >= 0) tiki_session_settimeouts(self->session, timeouts[0], timeouts[1], timeouts[2]);
+    if (priority >= -1) tiki_session_setpriority(self->session, priority);
+    if (arena >= 0) tiki_session_setarena(self->session, (size_t)arena);
+    if (cache_entries >= 0) tiki_session_setcache(self->session, cache_entries, (size_t)cache_bytes, cachedir);
+    if (dedup != NULL) tiki_session_setdedup(self->session, dedup);
+    if (compress >= 0) tiki_session_setcompression(self->session, compress, (size_t)compress_min);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* session_webpage_download(SessionObject *self, PyObject *args)
+{
+    const char *page;
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "s", &page) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = webpage_download_session(self->debug, self->session, page);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_webpage_check(SessionObject *self, PyObject *args)
+{
+    const char *page;
+    const char *check_text;
+    _Bool found;
+
+    if (!PyArg_ParseTuple(args, "ss", &page, &check_text) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    found = webpage_check_session(self->debug, self->session, page, check_text);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return PyBool_FromLong(found);
+}
+
+
+static PyObject* session_webpage_datetimecheck(SessionObject *self, PyObject *args)
+{
+    const char *page;
+    const char *infront_text;
+    int datelen;
+    const char *ref_datetime;
+    const char *datetime_fmt;
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "ssiss", &page, &infront_text, &datelen, &ref_datetime, &datetime_fmt) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = webpage_datetimecheck_session(self->debug, self->session, page, infront_text, datelen, ref_datetime, datetime_fmt);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_itempost(SessionObject *self, PyObject *args)
+{
+    const char *trackerId;
+    const char *post_data;
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "ss", &trackerId, &post_data) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = tracker_itempost_session(self->debug, self->session, trackerId, post_data);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_itemupdate(SessionObject *self, PyObject *args)
+{
+    const char *trackerId;
+    const char *itemId;
+    const char *post_data;
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "sss", &trackerId, &itemId, &post_data) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = tracker_itemupdate_session(self->debug, self->session, trackerId, itemId, post_data);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_itemget(SessionObject *self, PyObject *args)
+{
+    const char *trackerId;
+    const char *itemId;
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "ss", &trackerId, &itemId) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = tracker_itemget_session(self->debug, self->session, trackerId, itemId);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_filedownload(SessionObject *self, PyObject *args)
+{
+    const char *fileId;
+    const char *filespath;
+    const char *bodyfilename = "";
+    const char *headerfilename = "";
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "ss|ss", &fileId, &filespath, &bodyfilename, &headerfilename) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = gallery_filedownload_session(self->debug, self->session, fileId, filespath, bodyfilename, headerfilename);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_fileupload(SessionObject *self, PyObject *args)
+{
+    const char *filepath;
+    const char *galId;
+    const char *filename = "";
+    const char *filetitle = "";
+    const char *filedesc = "";
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "ss|sss", &filepath, &galId, &filename, &filetitle, &filedesc) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = gallery_fileupload_session(self->debug, self->session, filepath, galId, filename, filetitle, filedesc);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+// ***************************************************************************
+// upload the contents of any bytes-like object - the library reads the
+//  object's own memory, which stays pinned by the Py_buffer for the call
+// ***************************************************************************
+static PyObject* session_fileupload_buffer(SessionObject *self, PyObject *args)
+{
+    Py_buffer data;
+    const char *galId;
+    const char *filename;
+    const char *filetitle = "";
+    const char *filedesc = "";
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "y*ss|ss", &data, &galId, &filename, &filetitle, &filedesc)) {
+        return NULL;
+    }
+    if (!session_take(self)) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = gallery_fileupload_buffer_session(self->debug, self->session, data.buf, (size_t)data.len, galId, filename, filetitle, filedesc);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    PyBuffer_Release(&data);
+    return result_new(result);
+}
+
+
+static PyObject* session_fileupdate(SessionObject *self, PyObject *args)
+{
+    const char *fileId;
+    const char *filepath;
+    const char *filename = "";
+    const char *filetitle = "";
+    const char *filedesc = "";
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "ss|sss", &fileId, &filepath, &filename, &filetitle, &filedesc) || !session_take(self)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = gallery_fileupdate_session(self->debug, self->session, fileId, filepath, filename, filetitle, filedesc);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    return result_new(result);
+}
+
+
+static PyObject* session_fileupdate_buffer(SessionObject *self, PyObject *args)
+{
+    const char *fileId;
+    Py_buffer data;
+    const char *filename;
+    const char *filetitle = "";
+    const char *filedesc = "";
+    char *result;
+
+    if (!PyArg_ParseTuple(args, "sy*s|ss", &fileId, &data, &filename, &filetitle, &filedesc)) {
+        return NULL;
+    }
+    if (!session_take(self)) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    result = gallery_fileupdate_buffer_session(self->debug, self->session, fileId, data.buf, (size_t)data.len, filename, filetitle, filedesc);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    PyBuffer_Release(&data);
+    return result_new(result);
+}
+
+
+static PyMethodDef session_methods[] = {
+    {"configure", (PyCFunction)(void(*)(void))session_configure, METH_VARARGS | METH_KEYWORDS,
+     "configure(*, arena, cache_entries, cache_bytes, cachedir, dedup, compress, compress_min, timeouts, cancel, priority)"
+     " - set the session options, where timeouts is (connect_ms, deadline_ms, stall_ms)"},
+    {"webpage_download", (PyCFunction)session_webpage_download, METH_VARARGS, "webpage_download(page) -> Result"},
+    {"webpage_check", (PyCFunction)session_webpage_check, METH_VARARGS, "webpage_check(page, check_text) -> bool"},
+    {"webpage_datetimecheck", (PyCFunction)session_webpage_datetimecheck, METH_VARARGS,
+     "webpage_datetimecheck(page, infront_text, datelen, ref_datetime, datetime_fmt) -> Result"},
+    {"itempost", (PyCFunction)session_itempost, METH_VARARGS, "itempost(trackerId, post_data) -> Result"},
+    {"itemupdate", (PyCFunction)session_itemupdate, METH_VARARGS, "itemupdate(trackerId, itemId, post_data) -> Result"},
+    {"itemget", (PyCFunction)session_itemget, METH_VARARGS, "itemget(trackerId, itemId) -> Result"},
+    {"filedownload", (PyCFunction)session_filedownload, METH_VARARGS,
+     "filedownload(fileId, filespath, bodyfilename='', headerfilename='') -> Result"},
+    {"fileupload", (PyCFunction)session_fileupload, METH_VARARGS,
+     "fileupload(filepath, galId, filename='', filetitle='', filedesc='') -> Result"},
+    {"fileupload_buffer", (PyCFunction)session_fileupload_buffer, METH_VARARGS,
+     "fileupload_buffer(data, galId, filename, filetitle='', filedesc='') -> Result - data is any bytes-like object"},
+    {"fileupdate", (PyCFunction)session_fileupdate, METH_VARARGS,
+     "fileupdate(fileId, filepath, filename='', filetitle='', filedesc='') -> Result"},
+    {"fileupdate_buffer", (PyCFunction)session_fileupdate_buffer, METH_VARARGS,
+     "fileupdate_buffer(fileId, data, filename, filetitle='', filedesc='') -> Result - data is any bytes-like object"},
+    {"close", (PyCFunction)session_close, METH_NOARGS, "close() - release the session's connections"},
+    {"__enter__", (PyCFunction)session_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)session_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyTypeObject SessionType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "tiki_iot.Session",
+    .tp_doc = "Session(domain, access_token, debug=0) - a kept alive connection to a Tiki, use one per thread",
+    .tp_basicsize = sizeof(SessionObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)session_init,
+    .tp_dealloc = (destructor)session_dealloc,
+    .tp_methods = session_methods,
+};
+
+
+// ***************************************************************************
+// ***************************************************************************
+// tiki_iot.Multi - tiki_multi calls as asyncio awaitables
+// ***************************************************************************
+// ***************************************************************************
+// a tiki_multi must only be used by one thread, so each Multi has a driver
+//  thread that owns it: the Python side just hands new calls over through a
+//  mutex protected list and wakes the driver, which queues them, runs
+//  tiki_multi_perform without the GIL, and takes the GIL only to hand each
+//  result to the future's event loop with call_soon_threadsafe
+struct multi_request {
+    int optype;            // MULTI_ITEMPOST etc
+    char *args[MULTI_MAXARGS];   // the call's string arguments, copied so the driver thread never needs the GIL to read them
+    int priority;          // the call's priority class, as for tiki_multi_setpriority
+    int opId;              // tiki_multi operation id once the driver thread has queued it
+    PyObject *future;      // asyncio future completed with the Result
+    PyObject *loop;        // the event loop the future belongs to
+    struct multi_request *next;
+};
+
+typedef struct {
+    PyObject_HEAD
+    tiki_multi *multi;
+    int running;                       // the driver thread has been started and not yet joined
+    pthread_t thread;
+    pthread_mutex_t lock;              // protects submitted and stop
+    pthread_cond_t wake;               // signalled when a call is submitted or the Multi is closed
+    struct multi_request *submitted;   // calls waiting for the driver thread, oldest first
+    struct multi_request *lastsubmitted;
+    int stop;
+    struct multi_request *active;      // calls queued in the tiki_multi - only used by the driver thread
+    PyObject *cancel;                  // the tiki_iot.Cancel given to the constructor, or NULL
+} MultiObject;
+
+
+static void multi_request_free(struct multi_request *request)
+{
+    for (int i = 0; i < MULTI_MAXARGS; i++) {
+        free(request->args[i]);
+    }
+    free(request);
+}
+
+
+// ***************************************************************************
+// complete a call's future on its event loop - runs on the driver thread
+// ***************************************************************************
+static void multi_resolve(struct multi_request *request, char* result)
+{
+    // request: the finished call
+    // result: its result string, which the Result takes over
+
+    PyGILState_STATE gil = PyGILState_Ensure();
+    PyObject *value = result_new(result);
+    if (value == NULL) {
+        // hand the exception itself to the future
+        PyObject *type, *traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        PyErr_NormalizeException(&type, &value, &traceback);
+        Py_XDECREF(type);
+        Py_XDECREF(traceback);
+    }
+    PyObject *done = PyObject_CallMethod(request->loop, "call_soon_threadsafe", "OOO", resolve_func, request->future, value);
+    if (done == NULL) {
+        // the event loop has been closed - nothing is left waiting for the future
+        PyErr_Clear();
+    }
+    Py_XDECREF(done);
+    Py_XDECREF(value);
+    Py_DECREF(request->future);
+    Py_DECREF(request->loop);
+    PyGILState_Release(gil);
+    multi_request_free(request);
+}
+
+
+// ***************************************************************************
+// the driver thread - queues the submitted calls in the tiki_multi and runs
+//  it until the Multi is closed and every queued call has finished
+// ***************************************************************************
+static void* multi_driver(void *arg)
+{
+    MultiObject *self = arg;
+    struct multi_request *request;
+    struct multi_request **link;
+    int stop;
+    int opId;
+    char *result;
+
+    while (1) {
+        pthread_mutex_lock(&self->lock);
+        while (self->submitted == NULL && self->active == NULL && !self->stop) {
+            pthread_cond_wait(&self->wake, &self->lock);
+        }
+        request = self->submitted;
+        self->submitted = NULL;
+        self->lastsubmitted = NULL;
+        stop = self->stop;
+        pthread_mutex_unlock(&self->lock);
+
+        while (request != NULL) {
+            struct multi_request *next = request->next;
+            tiki_multi_setpriority(self->multi, request->priority);
+            switch (request->optype) {
+                case MULTI_ITEMPOST:
+                    request->opId = tiki_multi_itempost(self->multi, request->args[0], request->args[1]);
+                    break;
+                case MULTI_ITEMUPDATE:
+                    request->opId = tiki_multi_itemupdate(self->multi, request->args[0], request->args[1], request->args[2]);
+                    break;
+                case MULTI_ITEMGET:
+                    request->opId = tiki_multi_itemget(self->multi, request->args[0], request->args[1]);
+                    break;
+                case MULTI_FILEUPLOAD:
+                    request->opId = tiki_multi_fileupload(self->multi, request->args[0], request->args[1], request->args[2],
+                                                          request->args[3], request->args[4]);
+                    break;
+                default:
+                    request->opId = tiki_multi_filedownload(self->multi, request->args[0], request->args[1], request->args[2]);
+                    break;
+            }
+            if (request->opId <= 0) {
+                multi_resolve(request, copyString("*** tiki_multi could not queue the call ***"));
+            } else {
+                request->next = self->active;
+                self->active = request;
+            }
+            request = next;
+        }
+
+        if (self->active == NULL) {
+            if (stop) {
+                break;
+            }
+            continue;
+        }
+
+        tiki_multi_perform(self->multi, MULTI_WAIT_MS);
+        while ((result = tiki_multi_poll(self->multi, &opId)) != NULL) {
+            for (link = &self->active; *link != NULL && (*link)->opId != opId; link = &(*link)->next);
+            if (*link == NULL) {
+                tiki_free(result);
+                continue;
+            }
+            request = *link;
+            *link = request->next;
+            multi_resolve(request, result);
+        }
+    }
+    return NULL;
+}
+
+
+static int multi_init(MultiObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"domain", "access_token", "max_inflight", "debug", "cancel", NULL};
+    const char *domain;
+    const char *access_token;
+    int max_inflight = 4;
+    int debug = 0;
+    PyObject *cancel = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss|iiO", kwlist, &domain, &access_token, &max_inflight, &debug, &cancel)) {
+        return -1;
+    }
+    if (self->multi != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "the tiki_iot.Multi has already been initialised");
+        return -1;
+    }
+    if (cancel != Py_None && !PyObject_TypeCheck(cancel, &CancelType)) {
+        PyErr_SetString(PyExc_TypeError, "cancel must be a tiki_iot.Cancel or None");
+        return -1;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    self->multi = tiki_multi_create(debug, domain, (char*)access_token, max_inflight);
+    Py_END_ALLOW_THREADS
+
+    if (self->multi == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tiki_multi_create failed");
+        return -1;
+    }
+    if (cancel != Py_None) {
+        // set before the driver thread starts, and never changed while it runs
+        tiki_multi_setcancel(self->multi, ((CancelObject*)cancel)->cancel);
+        Py_INCREF(cancel);
+        self->cancel = cancel;
+    }
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->wake, NULL);
+    if (pthread_create(&self->thread, NULL, multi_driver, self) != 0) {
+        pthread_cond_destroy(&self->wake);
+        pthread_mutex_destroy(&self->lock);
+        tiki_multi_destroy(self->multi);
+        self->multi = NULL;
+        PyErr_SetString(PyExc_RuntimeError, "could not start the tiki_iot.Multi driver thread");
+        return -1;
+    }
+    self->running = 1;
+    return 0;
+}
+
+
+// ***************************************************************************
+// finish every call already submitted, then stop the driver thread - waits
+//  with the GIL released, so the driver can still complete the futures
+// ***************************************************************************
+static PyObject* multi_close(MultiObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (!self->running) {
+        Py_RETURN_NONE;
+    }
+    self->running = 0;
+    pthread_mutex_lock(&self->lock);
+    self->stop = 1;
+    pthread_cond_signal(&self->wake);
+    pthread_mutex_unlock(&self->lock);
+    tiki_multi_wakeup(self->multi);
+
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(self->thread, NULL);
+    tiki_multi_destroy(self->multi);
+    Py_END_ALLOW_THREADS
+
+    self->multi = NULL;
+    pthread_cond_destroy(&self->wake);
+    pthread_mutex_destroy(&self->lock);
+    Py_RETURN_NONE;
+}
+
+
+static void multi_dealloc(MultiObject *self)
+{
+    PyObject *done = multi_close(self, NULL);
+    Py_XDECREF(done);
+    Py_XDECREF(self->cancel);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+
+// ***************************************************************************
+// hand a call to the driver thread and return the future it will complete
+// ***************************************************************************
+static PyObject* multi_submit(MultiObject *self, int optype, int priority, const char* argv[MULTI_MAXARGS])
+{
+    // optype: MULTI_ITEMPOST etc
+    // priority: the call's priority class - -1 for the tiki_multi default
+    // argv: the call's string arguments in tiki_multi order, NULL if not used
+
+    if (!self->running) {
+        PyErr_SetString(PyExc_ValueError, "the tiki_iot.Multi has been closed");
+        return NULL;
+    }
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+        return NULL;
+    }
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL) {
+        return NULL;
+    }
+    PyObject *future = PyObject_CallMethod(loop, "create_future", NULL);
+    if (future == NULL) {
+        Py_DECREF(loop);
+        return NULL;
+    }
+
+    struct multi_request *request = calloc(1, sizeof(struct multi_request));
+    if (request == NULL) {
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        return PyErr_NoMemory();
+    }
+    for (int i = 0; i < MULTI_MAXARGS; i++) {
+        if (argv[i] != NULL && (request->args[i] = copyString((char*)argv[i])) == NULL) {
+            multi_request_free(request);
+            Py_DECREF(future);
+            Py_DECREF(loop);
+            return PyErr_NoMemory();
+        }
+    }
+    request->optype = optype;
+    request->priority = priority;
+    request->loop = loop;
+    Py_INCREF(future);
+    request->future = future;
+
+    pthread_mutex_lock(&self->lock);
+    if (self->lastsubmitted == NULL) {
+        self->submitted = request;
+    } else {
+        self->lastsubmitted->next = request;
+    }
+    self->lastsubmitted = request;
+    pthread_cond_signal(&self->wake);
+    pthread_mutex_unlock(&self->lock);
+    tiki_multi_wakeup(self->multi);
+    return future;
+}
+
+
+static PyObject* multi_itempost(MultiObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"trackerId", "post_data", "priority", NULL};
+    const char *argv[MULTI_MAXARGS] = {NULL};
+    int priority = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss|$i", kwlist, &argv[0], &argv[1], &priority)) {
+        return NULL;
+    }
+    return multi_submit(self, MULTI_ITEMPOST, priority, argv);
+}
+
+
+static PyObject* multi_itemupdate(MultiObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"trackerId", "itemId", "post_data", "priority", NULL};
+    const char *argv[MULTI_MAXARGS] = {NULL};
+    int priority = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sss|$i", kwlist, &argv[0], &argv[1], &argv[2], &priority)) {
+        return NULL;
+    }
+    return multi_submit(self, MULTI_ITEMUPDATE, priority, argv);
+}
+
+
+static PyObject* multi_itemget(MultiObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"trackerId", "itemId", "priority", NULL};
+    const char *argv[MULTI_MAXARGS] = {NULL};
+    int priority = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss|$i", kwlist, &argv[0], &argv[1], &priority)) {
+        return NULL;
+    }
+    return multi_submit(self, MULTI_ITEMGET, priority, argv);
+}
+
+
+static PyObject* multi_filedownload(MultiObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"fileId", "filespath", "bodyfilename", "priority", NULL};
+    const char *argv[MULTI_MAXARGS] = {NULL, NULL, "", NULL};
+    int priority = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss|s$i", kwlist, &argv[0], &argv[1], &argv[2], &priority)) {
+        return NULL;
+    }
+    return multi_submit(self, MULTI_FILEDOWNLOAD, priority, argv);
+}
+
+
+static PyObject* multi_fileupload(MultiObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"filepath", "galId", "filename", "filetitle", "filedesc", "priority", NULL};
+    const char *argv[MULTI_MAXARGS] = {NULL};
+    int priority = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sssss|$i", kwlist, &argv[0], &argv[1], &argv[2], &argv[3], &argv[4], &priority)) {
+        return NULL;
+    }
+    return multi_submit(self, MULTI_FILEUPLOAD, priority, argv);
+}
+
+
+// ***************************************************************************
+// 'async with' support - leaving the block closes the Multi in the loop's
+//  default executor, so the loop keeps running while the last calls finish
+// ***************************************************************************
+static PyObject* multi_aenter(MultiObject *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+        return NULL;
+    }
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL) {
+        return NULL;
+    }
+    PyObject *future = PyObject_CallMethod(loop, "create_future", NULL);
+    Py_DECREF(loop);
+    if (future == NULL) {
+        return NULL;
+    }
+    PyObject *done = PyObject_CallMethod(future, "set_result", "O", (PyObject*)self);
+    if (done == NULL) {
+        Py_DECREF(future);
+        return NULL;
+    }
+    Py_DECREF(done);
+    return future;
+}
+
+
+static PyObject* multi_aclose(MultiObject *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+        return NULL;
+    }
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL) {
+        return NULL;
+    }
+    PyObject *close = PyObject_GetAttrString((PyObject*)self, "close");
+    if (close == NULL) {
+        Py_DECREF(loop);
+        return NULL;
+    }
+    PyObject *future = PyObject_CallMethod(loop, "run_in_executor", "OO", Py_None, close);
+    Py_DECREF(close);
+    Py_DECREF(loop);
+    return future;
+}
+
+
+static PyObject* multi_aexit(MultiObject *self, PyObject *args)
+{
+    return multi_aclose(self, NULL);
+}
+
+
+static PyMethodDef multi_methods[] = {
+    {"itempost", (PyCFunction)(void(*)(void))multi_itempost, METH_VARARGS | METH_KEYWORDS,
+     "itempost(trackerId, post_data, *, priority=-1) -> awaitable Result"},
+    {"itemupdate", (PyCFunction)(void(*)(void))multi_itemupdate, METH_VARARGS | METH_KEYWORDS,
+     "itemupdate(trackerId, itemId, post_data, *, priority=-1) -> awaitable Result"},
+    {"itemget", (PyCFunction)(void(*)(void))multi_itemget, METH_VARARGS | METH_KEYWORDS, "itemget(trackerId, itemId, *, priority=-1) -> awaitable Result"},
+    {"filedownload", (PyCFunction)(void(*)(void))multi_filedownload, METH_VARARGS | METH_KEYWORDS,
+     "filedownload(fileId, filespath, bodyfilename='', *, priority=-1) -> awaitable Result"},
+    {"fileupload", (PyCFunction)(void(*)(void))multi_fileupload, METH_VARARGS | METH_KEYWORDS,
+     "fileupload(filepath, galId, filename, filetitle, filedesc, *, priority=-1) -> awaitable Result"},
+    {"close", (PyCFunction)multi_close, METH_NOARGS, "close() - wait for every submitted call to finish, then stop"},
+    {"aclose", (PyCFunction)multi_aclose, METH_NOARGS, "aclose() -> awaitable close() run in the event loop's executor"},
+    {"__aenter__", (PyCFunction)multi_aenter, METH_NOARGS, NULL},
+    {"__aexit__", (PyCFunction)multi_aexit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyTypeObject MultiType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "tiki_iot.Multi",
+    .tp_doc = "Multi(domain, access_token, max_inflight=4, debug=0, cancel=None) - concurrent calls that return asyncio awaitables,"
+              " close it (or use 'async with') before the program ends",
+    .tp_basicsize = sizeof(MultiObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)multi_init,
+    .tp_dealloc = (destructor)multi_dealloc,
+    .tp_methods = multi_methods,
+};
+
+
+// ***************************************************************************
+// ***************************************************************************
+// module level functions
+// ***************************************************************************
+// ***************************************************************************
+
+// ***************************************************************************
+// complete a future unless it has already been cancelled - scheduled on the
+//  future's own loop by the Multi driver thread
+// ***************************************************************************
+static PyObject* tiki_iot_resolve(PyObject *module, PyObject *args)
+{
+    PyObject *future;
+    PyObject *value;
+
+    if (!PyArg_ParseTuple(args, "OO", &future, &value)) {
+        return NULL;
+    }
+    PyObject *done = PyObject_CallMethod(future, "done", NULL);
+    if (done == NULL) {
+        return NULL;
+    }
+    int isdone = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if (isdone) {
+        Py_RETURN_NONE;
+    }
+    if (PyExceptionInstance_Check(value)) {
+        return PyObject_CallMethod(future, "set_exception", "O", value);
+    }
+    return PyObject_CallMethod(future, "set_result", "O", value);
+}
+
+
+static PyObject* tiki_iot_setcompression(PyObject *module, PyObject *args)
+{
+    int accept;
+    Py_ssize_t post_min = 0;
+
+    if (!PyArg_ParseTuple(args, "i|n", &accept, &post_min)) {
+        return NULL;
+    }
+    tiki_setcompression(accept, (size_t)post_min);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* tiki_iot_prewarm(PyObject *module, PyObject *args)
+{
+    const char *domain;
+    int connections = 1;
+    int debug = 0;
+    int ready;
+
+    if (!PyArg_ParseTuple(args, "s|ii", &domain, &connections, &debug)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ready = tiki_prewarm(debug, domain, connections);
+    Py_END_ALLOW_THREADS
+    return PyLong_FromLong(ready);
+}
+
+
+static PyObject* tiki_iot_settimeouts(PyObject *module, PyObject *args)
+{
+    long connect_ms;
+    long deadline_ms = 0;
+    long stall_ms = 30000;
+
+    if (!PyArg_ParseTuple(args, "l|ll", &connect_ms, &deadline_ms, &stall_ms)) {
+        return NULL;
+    }
+    tiki_settimeouts(connect_ms, deadline_ms, stall_ms);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* tiki_iot_setbreaker(PyObject *module, PyObject *args)
+{
+    int failures;
+    long probe_ms = 5000;
+
+    if (!PyArg_ParseTuple(args, "i|l", &failures, &probe_ms)) {
+        return NULL;
+    }
+    tiki_setbreaker(failures, probe_ms);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* tiki_iot_breaker_open(PyObject *module, PyObject *args)
+{
+    const char *domain;
+
+    if (!PyArg_ParseTuple(args, "s", &domain)) {
+        return NULL;
+    }
+    return PyBool_FromLong(tiki_breaker_open(domain));
+}
+
+
+static PyObject* tiki_iot_setratelimit(PyObject *module, PyObject *args)
+{
+    const char *domain;
+    double per_second;
+    int burst = 1;
+
+    if (!PyArg_ParseTuple(args, "sd|i", &domain, &per_second, &burst)) {
+        return NULL;
+    }
+    if (tiki_setratelimit(domain, per_second, burst) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "too many domains for this one to have a rate limit");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* tiki_iot_wirestats(PyObject *module, PyObject *Py_UNUSED(ignored))
+{
+    long long sent, sent_plain, received, received_plain;
+
+    tiki_wirestats(&sent, &sent_plain, &received, &received_plain);
+    return Py_BuildValue("(LLLL)", sent, sent_plain, received, received_plain);
+}
+
+
+static PyObject* tiki_iot_stats_latency(PyObject *module, PyObject *args)
+{
+    const char *call;
+    const char *phase;
+    double quantile;
+    double seconds = 0;
+    long long count;
+
+    if (!PyArg_ParseTuple(args, "ssd", &call, &phase, &quantile)) {
+        return NULL;
+    }
+    count = tiki_stats_latency(call, phase, quantile, &seconds);
+    return Py_BuildValue("(Ld)", count, seconds);
+}
+
+
+static PyObject* tiki_iot_stats_queuewait(PyObject *module, PyObject *args)
+{
+    const char *priority;
+    double quantile;
+    double seconds = 0;
+    long long count;
+
+    if (!PyArg_ParseTuple(args, "sd", &priority, &quantile)) {
+        return NULL;
+    }
+    count = tiki_stats_queuewait(priority, quantile, &seconds);
+    return Py_BuildValue("(Ld)", count, seconds);
+}
+
+
+static PyObject* tiki_iot_stats_dump(PyObject *module, PyObject *args)
+{
+    const char *filepath;
+    int failed;
+
+    if (!PyArg_ParseTuple(args, "s", &filepath)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    failed = tiki_stats_dump(filepath);
+    Py_END_ALLOW_THREADS
+    if (failed != 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filepath);
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* tiki_iot_log_start(PyObject *module, PyObject *args)
+{
+    const char *filepath = NULL;
+
+    if (!PyArg_ParseTuple(args, "|z", &filepath)) {
+        return NULL;
+    }
+    if (tiki_log_start(filepath) != 0) {
+        PyErr_SetString(PyExc_OSError, "tiki_log_start failed");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject* tiki_iot_log_stop(PyObject *module, PyObject *Py_UNUSED(ignored))
+{
+    Py_BEGIN_ALLOW_THREADS
+    tiki_log_stop();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef tiki_iot_functions[] = {
+    {"_resolve", tiki_iot_resolve, METH_VARARGS, NULL},
+    {"setcompression", tiki_iot_setcompression, METH_VARARGS, "setcompression(accept, post_min=0) - default compression for new sessions"},
+    {"prewarm", tiki_iot_prewarm, METH_VARARGS, "prewarm(domain, connections=1, debug=0) -> number of TLS sessions cached for the first connections"},
+    {"settimeouts", tiki_iot_settimeouts, METH_VARARGS, "settimeouts(connect_ms, deadline_ms=0, stall_ms=30000) - time limits for new sessions"},
+    {"setbreaker", tiki_iot_setbreaker, METH_VARARGS, "setbreaker(failures, probe_ms=5000) - when the per-domain circuit breakers open, 0 turns them off"},
+    {"breaker_open", tiki_iot_breaker_open, METH_VARARGS, "breaker_open(domain) -> True while calls to the domain fail fast"},
+    {"setratelimit", tiki_iot_setratelimit, METH_VARARGS, "setratelimit(domain, per_second, burst=1) - calls allowed to the domain, 0 for no limit"},
+    {"wirestats", tiki_iot_wirestats, METH_NOARGS, "wirestats() -> (sent, sent_plain, received, received_plain)"},
+    {"stats_latency", tiki_iot_stats_latency, METH_VARARGS, "stats_latency(call, phase, quantile) -> (count, seconds)"},
+    {"stats_queuewait", tiki_iot_stats_queuewait, METH_VARARGS, "stats_queuewait(priority, quantile) -> (count, seconds) - priority is 'urgent', 'normal', 'bulk' or ''"},
+    {"stats_dump", tiki_iot_stats_dump, METH_VARARGS, "stats_dump(filepath) - write the call statistics in Prometheus text format"},
+    {"log_start", tiki_iot_log_start, METH_VARARGS, "log_start(filepath=None) - write the library's log output from a background thread"},
+    {"log_stop", tiki_iot_log_stop, METH_NOARGS, "log_stop() - flush and stop the background log writer"},
+    {NULL}
+};
+
+static struct PyModuleDef tiki_iot_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "tiki_iot",
+    .m_doc = "native interface to the control_iot_240807.c Tiki API functions",
+    .m_size = -1,
+    .m_methods = tiki_iot_functions,
+};
+
+
+// PyModule_AddObject only takes over the reference when it succeeds (PyModule_AddObjectRef
+//  would do this, but it needs Python 3.10 and Raspberry Pi OS Bullseye has 3.9)
+static int module_addtype(PyObject *module, const char *name, PyTypeObject *type)
+{
+    Py_INCREF(type);
+    if (PyModule_AddObject(module, name, (PyObject*)type) < 0) {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+
+PyMODINIT_FUNC PyInit_tiki_iot(void)
+{
+    if (PyType_Ready(&ResultType) < 0 || PyType_Ready(&CancelType) < 0 || PyType_Ready(&SessionType) < 0 || PyType_Ready(&MultiType) < 0) {
+        return NULL;
+    }
+    PyObject *module = PyModule_Create(&tiki_iot_module);
+    if (module == NULL) {
+        return NULL;
+    }
+    if (module_addtype(module, "Result", &ResultType) < 0 ||
+        module_addtype(module, "Cancel", &CancelType) < 0 ||
+        module_addtype(module, "Session", &SessionType) < 0 ||
+        module_addtype(module, "Multi", &MultiType) < 0 ||
+        PyModule_AddIntConstant(module, "URGENT", 0) < 0 ||
+        PyModule_AddIntConstant(module, "NORMAL", 1) < 0 ||
+        PyModule_AddIntConstant(module, "BULK", 2) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    Py_XSETREF(resolve_func, PyObject_GetAttrString(module, "_resolve"));
+    if (resolve_func == NULL) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
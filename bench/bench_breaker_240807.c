@@ -0,0 +1,80 @@
+// bench_breaker_240807.c - hub call latency while the Tiki site is having an incident: the stand-in is told to
+//  answer every request after 5 seconds for a while and then to recover, while the hub keeps making tracker posts -
+//  first with no time limits, then with a per-call deadline, and then with the deadline and a circuit breaker - the
+//  latency of the calls made during the incident, and how soon a call succeeds again once it is over, are shown
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_breaker bench/bench_breaker_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./bench_breaker [domain] [seconds]     - the defaults are http://127.0.0.1:18080 and a 10 second incident
+
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define BREAKER_SLOWMS     5000    // how slowly the stand-in answers during the incident
+#define BREAKER_DEADLINE   1000    // the per-call deadline, in ms
+#define BREAKER_FAILURES   5       // failed calls in a row that open the breaker ...
+#define BREAKER_PROBEMS    1000    // ... and the wait before its first probe
+#define BREAKER_MAXCALLS   100000
+#define BREAKER_GAPUS      50000   // the hub's pause between calls
+
+static int compare_double(const void* a, const void* b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    double incident = (argc > 2) ? atof(argv[2]) : 10;
+    const char *names[] = { "no time limits", "deadline", "deadline + breaker" };
+    char token[] = BENCH_TOKEN;
+    static double latency[BREAKER_MAXCALLS];
+    char path[32];
+    int run;
+
+    for (run = 0; run < 3; run++) {
+        tiki_settimeouts(10000, run > 0 ? BREAKER_DEADLINE : 0, 0);
+        tiki_setbreaker(run == 2 ? BREAKER_FAILURES : 0, BREAKER_PROBEMS);
+        tiki_session *session = tiki_session_create(0, domain, token);
+        tiki_free(tracker_itempost_session(0, session, "1", "fields={\"IoTtestTextData\":\"before\"}"));
+
+        // the incident: every call the hub makes meanwhile is timed
+        int calls = 0;
+        int failed = 0;
+        snprintf(path, sizeof(path), "delay/%d", BREAKER_SLOWMS);
+        bench_stub(domain, path, NULL);
+        double start = bench_now();
+        while (bench_now() - start < incident && calls < BREAKER_MAXCALLS) {
+            double call_start = bench_now();
+            char *result = tracker_itempost_session(0, session, "1", "fields={\"IoTtestTextData\":\"incident\"}");
+            latency[calls++] = bench_now() - call_start;
+            failed += (atoi(result) <= 0);
+            tiki_free(result);
+            usleep(BREAKER_GAPUS);
+        }
+
+        // the recovery: how long after the site is well again before a call gets through
+        bench_stub(domain, "delay/0", NULL);
+        double recovered = bench_now();
+        for (;;) {
+            char *result = tracker_itempost_session(0, session, "1", "fields={\"IoTtestTextData\":\"after\"}");
+            int ok = (atoi(result) > 0);
+            tiki_free(result);
+            if (ok || bench_now() - recovered > 120) {
+                break;
+            }
+            usleep(BREAKER_GAPUS);
+        }
+        recovered = bench_now() - recovered;
+        tiki_session_destroy(session);
+
+        qsort(latency, calls, sizeof(double), compare_double);
+        printf ("%-20s %5d calls in the incident, %5d failed: p50 %8.1f ms  p99 %8.1f ms  max %8.1f ms, "
+                "first call OK %6.2fs after it ended\n", names[run], calls, failed, latency[calls / 2] * 1000,
+                latency[calls * 99 / 100] * 1000, latency[calls - 1] * 1000, recovered);
+    }
+    return 0;
+}
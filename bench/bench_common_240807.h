@@ -0,0 +1,79 @@
+// bench_common_240807.h - small helpers shared by the benchmark programs in this folder: a clock, the
+//  process's resident memory, and the counts kept by the tiki_stub_240807.py stand-in Tiki site
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <curl/curl.h>
+
+// the stand-in's address when none is given on the command line
+#define BENCH_DOMAIN  "http://127.0.0.1:18080"
+#define BENCH_TOKEN   "Authorization: Bearer benchmark_token"
+
+// seconds on a clock that only goes forward
+static inline double bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// the resident set size of this process in kB - 0 where /proc is not available
+static inline long bench_rss_kb(void)
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static inline size_t bench_collect(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    char *text = (char *)userp;
+    size_t have = strlen(text);
+    size_t len = size * nmemb;
+    if (have + len >= 1024) {
+        len = 1023 - have;
+    }
+    memcpy(text + have, contents, len);
+    text[have + len] = 0;
+    return size * nmemb;
+}
+
+// call one of the stand-in's own /stub/ paths, e.g. "reset" or "down/1", and return the value of key in its
+//  answer (the /stub/stats counts) - or -1 if the stand-in did not answer or the key is not there
+static inline long long bench_stub(const char* domain, const char* path, const char* key)
+{
+    char url[256];
+    char text[1024] = "";
+    char wanted[64];
+    snprintf(url, sizeof(url), "%s/stub/%s", domain, path);
+    CURL *curl_handle = curl_easy_init();
+    if (curl_handle == NULL) {
+        return -1;
+    }
+    curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, bench_collect);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)text);
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 10L);
+    CURLcode res = curl_easy_perform(curl_handle);
+    curl_easy_cleanup(curl_handle);
+    if (res != CURLE_OK) {
+        return -1;
+    }
+    if (key == NULL) {
+        return 0;
+    }
+    snprintf(wanted, sizeof(wanted), "\"%s\":", key);
+    char *found = strstr(text, wanted);
+    return (found != NULL) ? atoll(found + strlen(wanted)) : -1;
+}
@@ -0,0 +1,72 @@
+// bench_compress_240807.c - the body bytes that go over the wire for a hub's mix of calls, without and then with
+//  compression: short sensor readings, TextArea log posts of a few kB, item gets and wiki page downloads - as
+//  counted by tiki_wirestats, and by the stand-in as a check
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_compress bench/bench_compress_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./bench_compress [domain] [rounds]     - the defaults are http://127.0.0.1:18080 and 200 rounds of the mix
+// (the byte counts are of the request and response bodies only - the HTTP headers are the same either way)
+// (the stand-in pads its pages out with x's, which compress far better than a real page - so the received saving
+//  is an upper bound, and the sent saving on the log posts is the one to go by)
+
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define COMPRESS_POSTMIN  1024    // post data of this many bytes or more is sent compressed
+#define LOG_LINES         60      // lines of log text in each TextArea post
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    int rounds = (argc > 2) ? atoi(argv[2]) : 200;
+    char token[] = BENCH_TOKEN;
+    char reading[128];
+    char *logpost = malloc(LOG_LINES * 96 + 64);
+    int compress, r, line;
+
+    if (logpost == NULL) {
+        return 1;
+    }
+    for (compress = 0; compress <= 1; compress++) {
+        long long sent0, sent_plain0, received0, received_plain0;
+        long long sent, sent_plain, received, received_plain;
+        tiki_session *session = tiki_session_create(0, domain, token);
+        tiki_session_setcompression(session, compress, compress ? COMPRESS_POSTMIN : 0);
+        bench_stub(domain, "reset", NULL);
+        tiki_wirestats(&sent0, &sent_plain0, &received0, &received_plain0);
+        double start = bench_now();
+        for (r = 0; r < rounds; r++) {
+            // a short reading, as most of a hub's posts are
+            snprintf(reading, sizeof(reading), "fields={\"IoTtestTextData\":\"%d.%d\"}", 20 + r % 7, r % 10);
+            tiki_free(tracker_itempost_session(0, session, "1", reading));
+
+            // a log upload into a TextArea field
+            size_t len = snprintf(logpost, 64, "fields={\"IoTtestTextArea\":\"");
+            for (line = 0; line < LOG_LINES; line++) {
+                len += snprintf(logpost + len, 96, "2024-01-01 10:%02d:%02d sensor%03d temperature %d.%d humidity %d%%\\n",
+                                (r + line / 60) % 60, line % 60, line % 17, 15 + (r * line) % 11, line % 10, 40 + line % 23);
+            }
+            snprintf(logpost + len, 64, "\"}");
+            tiki_free(tracker_itempost_session(0, session, "1", logpost));
+
+            tiki_free(tracker_itemget_session(0, session, "1", "42"));
+            if (r % 10 == 0) {
+                tiki_free(webpage_download_session(0, session, "/HubStatus_size65536"));
+            }
+        }
+        double seconds = bench_now() - start;
+        tiki_wirestats(&sent, &sent_plain, &received, &received_plain);
+        sent -= sent0;
+        sent_plain -= sent_plain0;
+        received -= received0;
+        received_plain -= received_plain0;
+        printf ("compression %-3s sent %9lld bytes (%9lld plain), received %9lld bytes (%9lld plain) = %5.1f%% of "
+                "plain, in %5.2fs  (stand-in: %lld in, %lld out)\n", compress ? "on" : "off", sent, sent_plain,
+                received, received_plain, 100.0 * (sent + received) / (sent_plain + received_plain), seconds,
+                bench_stub(domain, "stats", "bytes_in"), bench_stub(domain, "stats", "bytes_out"));
+        tiki_session_destroy(session);
+    }
+    free(logpost);
+    return 0;
+}
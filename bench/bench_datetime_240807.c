@@ -0,0 +1,94 @@
+// bench_datetime_240807.c - the cost of reading the page dates that webpage_datetimecheck compares: first the
+//  date parsing alone, strptime and mktime per date as the check used to do against the compiled parser of
+//  tiki_datetime_parse, and then whole checks of a set of pages, one webpage_datetimecheck_session call per page
+//  against one webpage_datetimecheck_batch call for them all
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_datetime bench/bench_datetime_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./bench_datetime [domain] [dates]     - the defaults are http://127.0.0.1:18080 and 1000000 dates parsed
+// (the parsing part needs no site, and is the one to run on a Pi-class device)
+
+#define _XOPEN_SOURCE 700
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define DATE_FORMAT  "%a %b %d, %Y %H:%M:%S %Z"
+#define DATE_PAGES   20       // pages checked in each round of the page checks
+#define DATE_ROUNDS  50
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    long dates = (argc > 2) ? atol(argv[2]) : 1000000;
+    char token[] = BENCH_TOKEN;
+    // the stand-in's pages all have this date after "Last updated: ", and the reference is the day before
+    const char *datetext = "Mon Jan 01, 2024 10:00:00 GMT";
+    long long sum = 0;
+    long i;
+    int r, p;
+
+    // the old way: strptime and mktime for every date, with mktime's time zone look up each time
+    double start = bench_now();
+    for (i = 0; i < dates; i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        strptime(datetext, DATE_FORMAT, &tm);
+        tm.tm_isdst = -1;
+        sum += mktime(&tm);
+    }
+    double seconds = bench_now() - start;
+    printf ("%-28s %8ld dates in %6.3fs = %7.0f ns/date\n", "strptime + mktime", dates, seconds, seconds * 1e9 / dates);
+
+    // the format compiled once, and then the dates read with no strptime, mktime or time zone look up
+    tiki_datetime *parser = tiki_datetime_compile(DATE_FORMAT);
+    if (parser == NULL) {
+        return 1;
+    }
+    start = bench_now();
+    for (i = 0; i < dates; i++) {
+        time_t epoch = 0;
+        tiki_datetime_parse(parser, datetext, &epoch);
+        sum += epoch;
+    }
+    seconds = bench_now() - start;
+    printf ("%-28s %8ld dates in %6.3fs = %7.0f ns/date\n", "tiki_datetime_parse", dates, seconds, seconds * 1e9 / dates);
+
+    // whole page checks against the stand-in - each page is a different one so none is cached
+    const char *pages[DATE_PAGES];
+    const char *markers[DATE_PAGES];
+    int results[DATE_PAGES];
+    char names[DATE_PAGES][32];
+    for (p = 0; p < DATE_PAGES; p++) {
+        snprintf(names[p], sizeof(names[p]), "/DatePage%d", p);
+        pages[p] = names[p];
+        markers[p] = "Last updated:";
+    }
+    tiki_session *session = tiki_session_create(0, domain, token);
+    int newer = 0;
+    start = bench_now();
+    for (r = 0; r < DATE_ROUNDS; r++) {
+        for (p = 0; p < DATE_PAGES; p++) {
+            char *result = webpage_datetimecheck_session(0, session, pages[p], "Last updated:", 30, "1704016800", DATE_FORMAT);
+            newer += (strcmp(result, "true") == 0);
+            tiki_free(result);
+        }
+    }
+    seconds = bench_now() - start;
+    printf ("%-28s %8d pages in %6.3fs = %7.1f us/page, %d newer\n", "webpage_datetimecheck_session",
+            DATE_ROUNDS * DATE_PAGES, seconds, seconds * 1e6 / (DATE_ROUNDS * DATE_PAGES), newer);
+
+    newer = 0;
+    start = bench_now();
+    for (r = 0; r < DATE_ROUNDS; r++) {
+        newer += webpage_datetimecheck_batch(0, session, parser, DATE_PAGES, pages, markers, 30,
+                                             "Sun Dec 31, 2023 10:00:00 GMT", results);
+    }
+    seconds = bench_now() - start;
+    printf ("%-28s %8d pages in %6.3fs = %7.1f us/page, %d newer\n", "webpage_datetimecheck_batch",
+            DATE_ROUNDS * DATE_PAGES, seconds, seconds * 1e6 / (DATE_ROUNDS * DATE_PAGES), newer);
+
+    tiki_session_destroy(session);
+    tiki_datetime_free(parser);
+    return (sum == 0);    // sum is only used so the parsing loops are not optimised away
+}
@@ -0,0 +1,103 @@
+// bench_download_240807.c - time per page of multi-megabyte wiki page downloads: the old WriteMemoryCallback,
+//  which realloc'd the response for every chunk curl delivered, against webpage_download_session whose response
+//  memory is pre-sized from Content-Length (or grown by doubling when a page is sent chunked) - both with and
+//  without the session keeping its response memory between calls (tiki_session_setarena)
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_download bench/bench_download_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./bench_download [domain] [pages]     - the defaults are http://127.0.0.1:18080 and 50 downloads of each size
+// (the stand-in is Python and sends no more than a few hundred MB/s, which on a desktop machine hides most of the
+//  difference - a Pi-class device, or the stand-in on a faster machine, shows more of it)
+
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+struct old_memory {
+    char *memory;
+    size_t size;
+};
+
+// the WriteMemoryCallback as it was: one realloc (and so often a copy of everything so far) per chunk
+static size_t old_callback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    struct old_memory *mem = (struct old_memory *)userp;
+    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
+    if (ptr == NULL) {
+        return 0;
+    }
+    mem->memory = ptr;
+    memcpy(&(mem->memory[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->memory[mem->size] = 0;
+    return realsize;
+}
+
+// one page downloaded on a kept curl handle through old_callback - returns the bytes received
+static size_t old_download(CURL *curl_handle, const char* url)
+{
+    struct old_memory mem = { malloc(1), 0 };
+    curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, old_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&mem);
+    size_t size = (curl_easy_perform(curl_handle) == CURLE_OK) ? mem.size : 0;
+    free(mem.memory);
+    return size;
+}
+
+static void report(const char* name, const char* page, int pages, long long bytes, double seconds)
+{
+    printf ("%-30s %-28s %7.2f ms/page  %7.1f MB/s\n", name, page, seconds * 1000 / pages, bytes / seconds / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    int pages = (argc > 2) ? atoi(argv[2]) : 50;
+    char token[] = BENCH_TOKEN;
+    const char *sizes[] = { "/Page_size1048576", "/Page_size1048576_chunked",
+                            "/Page_size8388608", "/Page_size8388608_chunked" };
+    int s, i;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    for (s = 0; s < 4; s++) {
+        char url[256];
+        long long bytes = 0;
+        snprintf(url, sizeof(url), "%s/api/wiki/page%s", domain, sizes[s]);
+
+        // the old way, with the same kept connection so only the response memory handling differs
+        CURL *curl_handle = curl_easy_init();
+        struct curl_slist *headers = curl_slist_append(NULL, token);
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+        old_download(curl_handle, url);
+        double start = bench_now();
+        for (i = 0; i < pages; i++) {
+            bytes += old_download(curl_handle, url);
+        }
+        report("realloc per chunk", sizes[s], pages, bytes, bench_now() - start);
+        curl_easy_cleanup(curl_handle);
+        curl_slist_free_all(headers);
+
+        // the session without and then with its response memory kept between the calls
+        for (int arena = 0; arena <= 1; arena++) {
+            tiki_session *session = tiki_session_create(0, domain, token);
+            if (arena) {
+                tiki_session_setarena(session, 16 * 1024 * 1024);
+            }
+            tiki_free(webpage_download_session(0, session, sizes[s]));
+            bytes = 0;
+            start = bench_now();
+            for (i = 0; i < pages; i++) {
+                char *result = webpage_download_session(0, session, sizes[s]);
+                bytes += strlen(result);
+                tiki_free(result);
+            }
+            report(arena ? "session, kept response memory" : "webpage_download_session", sizes[s], pages, bytes,
+                   bench_now() - start);
+            tiki_session_destroy(session);
+        }
+    }
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,84 @@
+// bench_outbox_240807.c - replay throughput of the outbox: tracker posts are put in the outbox file and timed
+//  until the Tiki site has answered them all, first with the site up (but dropping connections and refusing
+//  requests as the stand-in is told to) and then with the site 'down' while the posts are added and brought
+//  back up part way through - the stand-in's counts show every post arrived, and none of them twice
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_outbox bench/bench_outbox_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with e.g.:
+//    python3 bench/tiki_stub_240807.py --drop 0.2 --busy 0.1
+//  ./bench_outbox [domain] [posts] [outbox file]   - the defaults are http://127.0.0.1:18080, 2000 posts
+//                                                    and /tmp/bench_outbox.obx (which is deleted first)
+
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define OUTBOX_INFLIGHT  8      // posts replayed at the same time
+#define OUTBOX_DOWNMS    3000   // how long the site is kept 'down' in the outage run
+
+// wait for the outbox to empty - returns the seconds waited, or -1 if it did not within a minute
+static double drain(tiki_outbox *outbox, double start)
+{
+    while (tiki_outbox_pending(outbox) > 0) {
+        if (bench_now() - start > 60) {
+            return -1;
+        }
+        usleep(1000);
+    }
+    return bench_now() - start;
+}
+
+static void report(const char* name, const char* domain, int posts, double append, double seconds)
+{
+    printf ("%-14s %6d posts: appended in %6.3fs, all answered after %6.2fs = %7.1f posts/s  (stand-in: %lld posts, "
+            "%lld duplicates, %lld dropped, %lld busy)\n", name, posts, append, seconds, posts / seconds,
+            bench_stub(domain, "stats", "posts"), bench_stub(domain, "stats", "duplicates"),
+            bench_stub(domain, "stats", "dropped"), bench_stub(domain, "stats", "busy"));
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    int posts = (argc > 2) ? atoi(argv[2]) : 2000;
+    const char *filepath = (argc > 3) ? argv[3] : "/tmp/bench_outbox.obx";
+    char token[] = BENCH_TOKEN;
+    char post_data[128];
+    int run, i;
+
+    unlink(filepath);
+    tiki_outbox *outbox = tiki_outbox_open(0, filepath, domain, token, OUTBOX_INFLIGHT);
+    if (outbox == NULL) {
+        printf ("could not open the outbox file %s\n", filepath);
+        return 1;
+    }
+    for (run = 0; run < 2; run++) {
+        bench_stub(domain, "reset", NULL);
+        if (run == 1) {
+            bench_stub(domain, "down/1", NULL);
+        }
+        double start = bench_now();
+        for (i = 0; i < posts; i++) {
+            // every post is different so the stand-in can tell a replayed duplicate from a new one
+            snprintf(post_data, sizeof(post_data), "fields={\"IoTtestTextData\":\"run %d reading %d\"}", run, i);
+            if (tiki_outbox_itempost(outbox, "1", post_data) != 0) {
+                printf ("post %d could not be added to the outbox\n", i);
+            }
+        }
+        double append = bench_now() - start;
+        if (run == 1) {
+            // the site comes back up after the outage - the time to drain includes the wait before the next try
+            usleep(OUTBOX_DOWNMS * 1000);
+            printf ("%d of %d posts kept in the outbox while the site was down\n", tiki_outbox_pending(outbox), posts);
+            bench_stub(domain, "down/0", NULL);
+        }
+        double seconds = drain(outbox, start);
+        if (seconds < 0) {
+            printf ("%d posts still not answered after a minute\n", tiki_outbox_pending(outbox));
+            break;
+        }
+        report(run ? "after outage" : "site up", domain, posts, append, seconds);
+    }
+    tiki_outbox_close(outbox);
+    unlink(filepath);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// bench_prewarm_240807.c - the latency of the first tracker post after a hub starts, without and with tiki_prewarm
+//  called first: each start is a new process (so nothing is cached from the one before), and the first call's
+//  DNS lookup, connect and TLS handshake times are read back with tiki_stats_latency
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_prewarm bench/bench_prewarm_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./bench_prewarm [domain] [starts]     - the defaults are http://localhost:18080 and 20 starts of each kind
+// (the stand-in has no TLS, so against it only the DNS lookup is saved - a https domain, e.g. a test Tiki site,
+//  shows the TLS handshake saved too)
+
+#include <sys/wait.h>
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define PREWARM_MAXSTARTS  100
+#define PREWARM_TIMES      6     // prewarm, first call, its dns, connect and tls phases, and a second call
+
+static const char *time_names[PREWARM_TIMES] = { "prewarm", "first call", "  dns", "  connect", "  tls", "second call" };
+
+// one hub start, in a child process - the times are written to fd
+static void one_start(const char* domain, int prewarm, int fd)
+{
+    char token[] = BENCH_TOKEN;
+    double times[PREWARM_TIMES] = { 0 };
+    double start = bench_now();
+    if (prewarm) {
+        tiki_prewarm(0, domain, 1);
+    }
+    times[0] = bench_now() - start;
+    start = bench_now();
+    tiki_free(tracker_itempost(0, domain, token, "1", "fields={\"IoTtestTextData\":\"first\"}"));
+    times[1] = bench_now() - start;
+    tiki_stats_latency("itempost", "dns", 0.5, &times[2]);
+    tiki_stats_latency("itempost", "connect", 0.5, &times[3]);
+    tiki_stats_latency("itempost", "tls", 0.5, &times[4]);
+    start = bench_now();
+    tiki_free(tracker_itempost(0, domain, token, "1", "fields={\"IoTtestTextData\":\"second\"}"));
+    times[5] = bench_now() - start;
+    if (write(fd, times, sizeof(times)) != sizeof(times)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : "http://localhost:18080";
+    int starts = (argc > 2) ? atoi(argv[2]) : 20;
+    static double times[2][PREWARM_TIMES][PREWARM_MAXSTARTS];
+    int prewarm, s, t;
+
+    if (starts > PREWARM_MAXSTARTS) {
+        starts = PREWARM_MAXSTARTS;
+    }
+    for (s = 0; s < starts; s++) {
+        for (prewarm = 0; prewarm <= 1; prewarm++) {
+            int fds[2];
+            double one[PREWARM_TIMES];
+            if (pipe(fds) != 0) {
+                return 1;
+            }
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                one_start(domain, prewarm, fds[1]);
+            }
+            close(fds[1]);
+            if (pid < 0 || read(fds[0], one, sizeof(one)) != sizeof(one)) {
+                printf ("a start did not report its times\n");
+                return 1;
+            }
+            close(fds[0]);
+            waitpid(pid, NULL, 0);
+            for (t = 0; t < PREWARM_TIMES; t++) {
+                times[prewarm][t][s] = one[t];
+            }
+        }
+    }
+    printf ("median of %d starts       %12s %12s\n", starts, "no prewarm", "prewarm");
+    for (t = 0; t < PREWARM_TIMES; t++) {
+        printf ("%-26s", time_names[t]);
+        for (prewarm = 0; prewarm <= 1; prewarm++) {
+            qsort(times[prewarm][t], starts, sizeof(double), compare_double);
+            printf (" %9.3f ms", times[prewarm][t][starts / 2] * 1000);
+        }
+        printf ("\n");
+    }
+    return 0;
+}
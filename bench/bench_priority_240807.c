@@ -0,0 +1,124 @@
+// bench_priority_240807.c - the latency of an alarm-status tracker post (as sense005 makes in the socket server
+//  example) while the hub is busy: worker threads keep up a stream of normal tracker posts and a bulk File gallery
+//  download runs, all held to a per-domain rate limit - the alarm posts are made first as normal calls and then
+//  as urgent ones, each run in its own process so the queue wait figures of tiki_stats_queuewait are its own
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_priority bench/bench_priority_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py --file-rate 2048
+//  ./bench_priority [domain] [seconds] [gap]   - the defaults are http://127.0.0.1:18080, 10 seconds for each run
+//                                               and a gap of 0 ms between each worker's posts, which keeps the rate
+//                                               limit full - e.g. 250 ms leaves it just short of full instead
+
+#include <pthread.h>
+#include <sys/wait.h>
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define PRIORITY_RATE     20      // calls a second allowed to the domain ...
+#define PRIORITY_BURST    2       // ... and straight after each other
+#define PRIORITY_WORKERS  4       // threads making normal tracker posts
+#define PRIORITY_GAPUS    200000  // the gap between alarm posts
+#define PRIORITY_MAXCALLS 1000
+
+struct worker {
+    pthread_t thread;
+    const char *domain;
+    double until;
+    int bulk;
+    int gap_ms;
+};
+
+static void* worker_run(void* arg)
+{
+    struct worker *worker = (struct worker *)arg;
+    char token[] = BENCH_TOKEN;
+    tiki_session *session = tiki_session_create(0, worker->domain, token);
+    while (bench_now() < worker->until) {
+        if (worker->bulk) {
+            tiki_free(gallery_filedownload_session(0, session, "7", "/tmp/", "bench_priority.bin", "bench_priority.head"));
+        } else {
+            tiki_free(tracker_itempost_session(0, session, "1", "fields={\"IoTtestTextData\":\"routine\"}"));
+            usleep(worker->gap_ms * 1000);
+        }
+    }
+    tiki_session_destroy(session);
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static void one_run(const char* domain, double seconds, int gap_ms, int urgent)
+{
+    char token[] = BENCH_TOKEN;
+    struct worker workers[PRIORITY_WORKERS + 1];
+    static double latency[PRIORITY_MAXCALLS];
+    const char *classes[] = { "urgent", "normal", "bulk" };
+    int calls = 0;
+    int failed = 0;
+    int i;
+
+    tiki_setratelimit(domain, PRIORITY_RATE, PRIORITY_BURST);
+    double start = bench_now();
+    for (i = 0; i <= PRIORITY_WORKERS; i++) {
+        workers[i].domain = domain;
+        workers[i].until = start + seconds;
+        workers[i].bulk = (i == PRIORITY_WORKERS);
+        workers[i].gap_ms = gap_ms;
+        pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    }
+    tiki_session *alarm = tiki_session_create(0, domain, token);
+    tiki_session_setpriority(alarm, urgent ? 0 : 1);
+    while (bench_now() - start < seconds && calls < PRIORITY_MAXCALLS) {
+        usleep(PRIORITY_GAPUS);
+        double call_start = bench_now();
+        char *result = tracker_itempost_session(0, alarm, "1", "fields={\"IoTtestTextData\":\"ALARM\"}");
+        latency[calls++] = bench_now() - call_start;
+        failed += (atoi(result) <= 0);
+        tiki_free(result);
+    }
+    tiki_session_destroy(alarm);
+    for (i = 0; i <= PRIORITY_WORKERS; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    qsort(latency, calls, sizeof(double), compare_double);
+    printf ("alarm posts as %-7s %4d calls, %d failed: p50 %7.1f ms  p99 %7.1f ms  max %7.1f ms\n", urgent ? "urgent" : "normal",
+            calls, failed, latency[calls / 2] * 1000, latency[calls * 99 / 100] * 1000, latency[calls - 1] * 1000);
+    for (i = 0; i < 3; i++) {
+        double p50 = 0;
+        double p99 = 0;
+        long long counted = tiki_stats_queuewait(classes[i], 0.5, &p50);
+        tiki_stats_queuewait(classes[i], 0.99, &p99);
+        printf ("   queue wait %-7s %6lld calls: p50 %7.1f ms  p99 %7.1f ms\n", classes[i], counted, p50 * 1000, p99 * 1000);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    double seconds = (argc > 2) ? atof(argv[2]) : 10;
+    int gap_ms = (argc > 3) ? atoi(argv[3]) : 0;
+    int urgent;
+
+    for (urgent = 0; urgent <= 1; urgent++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            one_run(domain, seconds, gap_ms, urgent);
+            _exit(0);
+        }
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+    }
+    unlink("/tmp/bench_priority.bin");
+    unlink("/tmp/bench_priority.head");
+    return 0;
+}
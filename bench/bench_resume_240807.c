@@ -0,0 +1,108 @@
+// bench_resume_240807.c - File gallery downloads over a link that drops connections part way through: a hub
+//  calling gallery_filedownload_session again until the file arrives whole, which starts from byte 0 each time,
+//  against gallery_filedownload_resume_session with 1 and then 4 Range segments, which carries on from where
+//  each dropped request got to - the stand-in's bytes sent show how much of each file was sent more than once,
+//  and every resumed file is compared with the same file downloaded whole
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_resume bench/bench_resume_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with e.g.:
+//    python3 bench/tiki_stub_240807.py --drop 0.3
+//  ./bench_resume [domain] [files] [folder]   - the defaults are http://127.0.0.1:18080, 5 files of the stand-in's
+//                                              8 MB and /tmp/bench_resume/ (which must end with a /)
+
+#include <sys/stat.h>
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define RESUME_TRIES    50    // the most times the whole file is asked for again
+#define RESUME_RETRIES  10    // max_retries for the resumed downloads
+
+// 1 if the two files hold the same bytes
+static int same_file(const char* name1, const char* name2)
+{
+    FILE *fp1 = fopen(name1, "rb");
+    FILE *fp2 = fopen(name2, "rb");
+    int same = (fp1 != NULL && fp2 != NULL);
+    while (same) {
+        int c1 = getc(fp1);
+        int c2 = getc(fp2);
+        same = (c1 == c2);
+        if (c1 == EOF) {
+            break;
+        }
+    }
+    if (fp1 != NULL) {
+        fclose(fp1);
+    }
+    if (fp2 != NULL) {
+        fclose(fp2);
+    }
+    return same;
+}
+
+static int downloaded_ok(const char* result)
+{
+    size_t len = strlen(result);
+    return (len >= 13 && strcmp(result + len - 13, "downloaded OK") == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    int files = (argc > 2) ? atoi(argv[2]) : 5;
+    const char *folder = (argc > 3) ? argv[3] : "/tmp/bench_resume/";
+    char token[] = BENCH_TOKEN;
+    const char *names[] = { "restart from byte 0", "resume, 1 segment", "resume, 4 segments" };
+    char filespath[3][256];
+    char fileId[16], bodyname[32], fullname[512], wholename[512];
+    long long file_bytes = 0;
+    int method, f;
+
+    mkdir(folder, 0755);
+    for (method = 0; method < 3; method++) {
+        snprintf(filespath[method], sizeof(filespath[method]), "%s%d/", folder, method);
+        mkdir(filespath[method], 0755);
+    }
+    tiki_session *session = tiki_session_create(0, domain, token);
+    for (method = 0; method < 3; method++) {
+        int ok = 0;
+        int same = 0;
+        long tries = 0;
+        bench_stub(domain, "reset", NULL);
+        double start = bench_now();
+        for (f = 0; f < files; f++) {
+            char *result = NULL;
+            snprintf(fileId, sizeof(fileId), "%d", 100 + f);
+            snprintf(bodyname, sizeof(bodyname), "file%d.bin", 100 + f);
+            if (method == 0) {
+                do {
+                    tiki_free(result);
+                    result = gallery_filedownload_session(0, session, fileId, filespath[0], bodyname, "file.head");
+                    tries++;
+                } while (!downloaded_ok(result) && tries < (long)(f + 1) * RESUME_TRIES);
+            } else {
+                result = gallery_filedownload_resume_session(0, session, fileId, filespath[method], bodyname,
+                                                             method == 1 ? 1 : 4, RESUME_RETRIES);
+                tries++;
+            }
+            snprintf(fullname, sizeof(fullname), "%s%s", filespath[method], bodyname);
+            snprintf(wholename, sizeof(wholename), "%s%s", filespath[0], bodyname);
+            if (downloaded_ok(result)) {
+                ok++;
+                if (method == 0 && file_bytes == 0) {
+                    file_bytes = findSize(fullname);
+                }
+                same += (method == 0 || same_file(fullname, wholename));
+            }
+            tiki_free(result);
+        }
+        double seconds = bench_now() - start;
+        long long sent = bench_stub(domain, "stats", "bytes_out");
+        printf ("%-20s %d of %d files OK (%d the same as whole) in %6.2fs, %ld calls, %lld dropped: "
+                "%.2f times the file bytes sent\n", names[method], ok, files, same, seconds, tries,
+                bench_stub(domain, "stats", "dropped"), file_bytes > 0 ? (double)sent / (file_bytes * files) : 0.0);
+    }
+    tiki_session_destroy(session);
+    return 0;
+}
@@ -0,0 +1,51 @@
+// bench_session_240807.c - requests/sec of tracker posts made with the one-shot functions, which set up a new
+//  curl handle (and so a new TCP connection and, for https, TLS handshake) for every call, against the same
+//  posts made through one persistent tiki_session that keeps its connection alive between calls
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_session bench/bench_session_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./bench_session [domain] [calls]     - the defaults are http://127.0.0.1:18080 and 2000 calls
+// (a https domain, e.g. a test Tiki site, shows the TLS handshakes saved too)
+
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+static void report(const char* name, const char* domain, int calls, int failed, double seconds)
+{
+    printf ("%-24s %6d calls in %6.2fs = %8.1f calls/s, %lld new connections, %d failed\n", name, calls, seconds,
+            calls / seconds, bench_stub(domain, "stats", "connections") - 1, failed);    // less the stats call's own
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    int calls = (argc > 2) ? atoi(argv[2]) : 2000;
+    char token[] = BENCH_TOKEN;
+    int failed = 0;
+    int i;
+
+    // one-shot: tracker_itempost does all of its own set up and clean up on every call
+    bench_stub(domain, "reset", NULL);
+    double start = bench_now();
+    for (i = 0; i < calls; i++) {
+        char *result = tracker_itempost(0, domain, token, "1", "fields={\"IoTtestTextData\":\"bench\"}");
+        failed += (atoi(result) <= 0);
+        tiki_free(result);
+    }
+    report("one-shot tracker_itempost", domain, calls, failed, bench_now() - start);
+
+    // persistent: one session, whose connection is kept alive between the calls
+    bench_stub(domain, "reset", NULL);
+    failed = 0;
+    start = bench_now();
+    tiki_session *session = tiki_session_create(0, domain, token);
+    for (i = 0; i < calls; i++) {
+        char *result = tracker_itempost_session(0, session, "1", "fields={\"IoTtestTextData\":\"bench\"}");
+        failed += (atoi(result) <= 0);
+        tiki_free(result);
+    }
+    tiki_session_destroy(session);
+    report("tracker_itempost_session", domain, calls, failed, bench_now() - start);
+    return 0;
+}
@@ -0,0 +1,78 @@
+// bench_threads_240807.c - a stress test of the library from many hub threads at once: each worker thread has
+//  its own tiki_session and makes tracker posts with no lock around them, for 1, 2, 4, 8 and 16 threads - with
+//  the stand-in answering each request after a delay, as a real Tiki site does, the calls/s should grow in step
+//  with the threads
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o bench_threads bench/bench_threads_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py --delay 20
+//  ./bench_threads [domain] [seconds]     - the defaults are http://127.0.0.1:18080 and 3 seconds for each number of threads
+
+#include <pthread.h>
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define MAX_THREADS  16
+
+struct worker {
+    pthread_t thread;
+    const char *domain;
+    double until;
+    int number;
+    long calls;
+    long failed;
+};
+
+static void* worker_run(void* arg)
+{
+    struct worker *worker = (struct worker *)arg;
+    char token[] = BENCH_TOKEN;
+    char post_data[128];
+    tiki_session *session = tiki_session_create(0, worker->domain, token);
+    while (bench_now() < worker->until) {
+        snprintf(post_data, sizeof(post_data), "fields={\"IoTtestTextData\":\"thread %d call %ld\"}", worker->number, worker->calls);
+        char *result = tracker_itempost_session(0, session, "1", post_data);
+        worker->failed += (atoi(result) <= 0);
+        worker->calls++;
+        tiki_free(result);
+    }
+    tiki_session_destroy(session);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    double seconds = (argc > 2) ? atof(argv[2]) : 3;
+    struct worker workers[MAX_THREADS];
+    double one_thread = 0;
+    int threads, i;
+
+    for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        long calls = 0;
+        long failed = 0;
+        bench_stub(domain, "reset", NULL);
+        double start = bench_now();
+        for (i = 0; i < threads; i++) {
+            workers[i].domain = domain;
+            workers[i].until = start + seconds;
+            workers[i].number = i;
+            workers[i].calls = 0;
+            workers[i].failed = 0;
+            pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+        }
+        for (i = 0; i < threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+            calls += workers[i].calls;
+            failed += workers[i].failed;
+        }
+        double rate = calls / (bench_now() - start);
+        if (threads == 1) {
+            one_thread = rate;
+        }
+        printf ("%2d threads: %7ld calls = %8.1f calls/s (x%5.2f), %ld failed, stand-in: %lld posts, %lld duplicates\n",
+                threads, calls, rate, rate / one_thread, failed, bench_stub(domain, "stats", "posts"),
+                bench_stub(domain, "stats", "duplicates"));
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// soak_results_240807.c - a soak test of the result ownership: a million calls (by default), each of whose
+//  result is handed back with tiki_free, with the resident memory of the process sampled as it goes - RSS
+//  that stays flat once the first calls have warmed up shows no result, header list or curl handle leaks
+
+// compiled using gcc, from the folder above this one, using the command:
+// gcc -O2 -o soak_results bench/soak_results_240807.c Tiki_API_C_code/control_iot_240807.c -ITiki_API_C_code -lcurl -lz -lpthread -lm
+// then run against the stand-in Tiki site started in another CLI window with:  python3 bench/tiki_stub_240807.py
+//  ./soak_results [domain] [calls]     - the defaults are http://127.0.0.1:18080 and 1000000 calls
+// (a million calls take a few minutes against the stand-in, which is the slower of the two)
+
+#include "bench_common_240807.h"
+#include "control_iot_240807.h"
+
+#define SOAK_SAMPLES  20    // RSS samples taken over the run
+
+int main(int argc, char *argv[])
+{
+    const char *domain = (argc > 1) ? argv[1] : BENCH_DOMAIN;
+    long calls = (argc > 2) ? atol(argv[2]) : 1000000;
+    char token[] = BENCH_TOKEN;
+    long failed = 0;
+    long i;
+
+    tiki_session *session = tiki_session_create(0, domain, token);
+    if (session == NULL) {
+        return 1;
+    }
+    double start = bench_now();
+    long warm_kb = 0;
+    long peak_kb = 0;
+    for (i = 1; i <= calls; i++) {
+        char *result;
+        // mostly tracker posts as a hub makes, with item gets and page downloads mixed in
+        if (i % 10 == 0) {
+            result = tracker_itemget_session(0, session, "1", "42");
+            failed += (strstr(result, "IoTtestTextData") == NULL);
+        } else if (i % 10 == 5) {
+            result = webpage_download_session(0, session, "/SoakPage");
+            failed += (strstr(result, "Last updated") == NULL);
+        } else {
+            result = tracker_itempost_session(0, session, "1", "fields={\"IoTtestTextData\":\"soak\"}");
+            failed += (atoi(result) <= 0);
+        }
+        tiki_free(result);
+
+        if (i % (calls / SOAK_SAMPLES > 0 ? calls / SOAK_SAMPLES : 1) == 0) {
+            long rss_kb = bench_rss_kb();
+            if (warm_kb == 0) {
+                warm_kb = rss_kb;    // after the first sample's worth of calls everything has been allocated once
+            }
+            if (rss_kb > peak_kb) {
+                peak_kb = rss_kb;
+            }
+            printf ("%8ld calls  %7.1fs  RSS %6ld kB\n", i, bench_now() - start, rss_kb);
+            fflush(stdout);
+        }
+    }
+    tiki_session_destroy(session);
+    printf ("%ld calls, %ld failed: RSS %ld kB after the first %ld calls, at most %ld kB (+%ld kB) after that\n",
+            calls, failed, warm_kb, calls / SOAK_SAMPLES, peak_kb, peak_kb - warm_kb);
+    return 0;
+}
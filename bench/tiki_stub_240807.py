@@ -0,0 +1,301 @@
+#!/usr/bin/python
+# version: 240807
+# file name: tiki_stub_240807.py - a local HTTP stand-in for a Tiki site, that the benchmark programs in this
+#  folder are run against so their numbers can be reproduced without a real Tiki site or network
+# Author : Geoff Brickell
+# Date   : 240807
+# command to run in a CLI window - adjust the file path to suit your local device system:
+#    python3 /your_file_path/tiki_stub_240807.py [port] [options]
+#  where the default port is 18080 and the options are:
+#    --delay MS         every API request is answered after MS milliseconds, as a busy Tiki site would be
+#    --drop FRACTION    this fraction of the API requests have their connection dropped - before the response,
+#                        or part way through the body of a file download
+#    --busy FRACTION    this fraction of the API requests are answered 503 Service Unavailable
+#    --file-bytes N     the size of every File gallery file (default 8 MB)
+#    --file-rate KB     File gallery downloads are sent at no more than KB kilobytes a second (default no limit)
+#    --no-etag          File gallery downloads are sent with no ETag (and no Last-Modified)
+#
+# The stand-in answers the API calls the control_iot_YYMMDD.c functions make:
+#    POST /api/trackers/<trackerId>/items               - a new item, with itemIds counting up from 1
+#    POST /api/trackers/<trackerId>/items/<itemId>      - an item update, or with an empty body the item itself
+#    GET  /api/trackers/<trackerId>/items/<itemId>      - an item
+#    GET  /api/wiki/page/<page>                         - a page with "Last updated: <date>" near its start - a
+#                                                          page name with sizeN in it is padded out to N bytes, and
+#                                                          one with chunked in it is sent without a Content-Length
+#    GET  /api/galleries/<fileId>/download              - a file, with byte Range requests and If-Range
+#    POST /api/galleries/upload and /api/galleries/<fileId>/update
+#    HEAD of anything
+#  responses are sent gzip compressed when the request asks for that, and gzip compressed request bodies are accepted
+#
+# and a few of its own, which are never delayed, dropped or refused:
+#    GET /stub/stats    - JSON counts: connections, requests, dropped, busy, posts (distinct post bodies),
+#                          duplicates (post bodies seen before), bytes_in and bytes_out (bodies as on the wire)
+#    GET /stub/reset    - sets all the counts back to 0
+#    GET /stub/down/1   - the site goes 'down': every API request has its connection dropped, until /stub/down/0
+#    GET /stub/delay/MS - every API request is answered after MS milliseconds from now on, as --delay
+#
+# In the code/comments below YYMMDD is used to signify version control/release
+#  and should be substituted for the versions being used e.g. 240807
+
+import sys
+import re
+import time
+import gzip
+import random
+import socket
+import threading
+import http.server
+
+#+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+# settings - from the command line
+#+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+port = 18080
+delay = 0.0
+drop = 0.0
+busy = 0.0
+file_bytes = 8 * 1024 * 1024
+file_rate = 0
+etag = True
+
+args = sys.argv[1:]
+while args:
+    arg = args.pop(0)
+    if arg == "--delay":
+        delay = float(args.pop(0)) / 1000
+    elif arg == "--drop":
+        drop = float(args.pop(0))
+    elif arg == "--busy":
+        busy = float(args.pop(0))
+    elif arg == "--file-bytes":
+        file_bytes = int(args.pop(0))
+    elif arg == "--file-rate":
+        file_rate = int(args.pop(0)) * 1024
+    elif arg == "--no-etag":
+        etag = False
+    else:
+        port = int(arg)
+
+lock = threading.Lock()
+counts = {}
+seen = set()
+down = False
+next_itemId = 0
+files = {}
+
+def reset():
+    global next_itemId
+    with lock:
+        for key in ("connections", "requests", "dropped", "busy", "posts", "duplicates", "bytes_in", "bytes_out"):
+            counts[key] = 0
+        seen.clear()
+        next_itemId = 0
+
+def count(key, n = 1):
+    with lock:
+        counts[key] += n
+
+def file_content(fileId):
+    # the same bytes every time for a fileId, so a resumed download can be checked
+    with lock:
+        if fileId not in files:
+            files[fileId] = random.Random(fileId).randbytes(file_bytes)
+        return files[fileId]
+
+PAGE_HEAD = b'{"page":"stub","data":"Last updated: Mon Jan 01, 2024 10:00:00 GMT - '
+PAGE_TAIL = b'"}'
+ITEM = b'{"feedback":{"Success":true},"trackerId":%s,"itemId":%s,"status":"o","fields":{"IoTtestTextData":"stub"}}'
+
+
+#+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+# the request handler - one thread per connection, kept alive between requests
+#+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+class StubHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def setup(self):
+        super().setup()
+        self.request.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        count("connections")
+
+    def hang_up(self):
+        count("dropped")
+        self.close_connection = True
+        self.request.shutdown(socket.SHUT_RDWR)
+
+    def reply(self, body, status = 200, headers = None):
+        if "gzip" in self.headers.get("Accept-Encoding", "") and len(body) > 0:
+            body = gzip.compress(body, 1)
+            headers = dict(headers or {})
+            headers["Content-Encoding"] = "gzip"
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if self.command != "HEAD":
+            self.wfile.write(body)
+            count("bytes_out", len(body))
+
+    def read_body(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0) or 0))
+        count("bytes_in", len(body))
+        if self.headers.get("Content-Encoding", "") == "gzip":
+            body = gzip.decompress(body)
+        return body
+
+    def stub_call(self):
+        # the stand-in's own calls - returns True if this was one of them
+        global down, delay
+        if self.path == "/stub/stats":
+            with lock:
+                text = "{" + ",".join('"%s":%d' % item for item in counts.items()) + "}"
+            self.reply(text.encode())
+        elif self.path == "/stub/reset":
+            reset()
+            self.reply(b"{}")
+        elif self.path.startswith("/stub/down/"):
+            down = self.path.endswith("/1")
+            self.reply(b"{}")
+        elif self.path.startswith("/stub/delay/"):
+            delay = float(self.path[len("/stub/delay/"):]) / 1000
+            self.reply(b"{}")
+        else:
+            return False
+        return True
+
+    def api_start(self):
+        # returns False if the request has been dropped or refused rather than being answered
+        count("requests")
+        if delay > 0:
+            time.sleep(delay)
+        luck = random.random()
+        if down or luck < drop:
+            if self.command != "GET" or "/download" not in self.path:
+                self.hang_up()
+                return False
+        elif luck < drop + busy:
+            count("busy")
+            self.reply(b"busy", 503)
+            return False
+        return True
+
+    def do_HEAD(self):
+        self.reply(b"")
+
+    def do_GET(self):
+        global next_itemId
+        if self.stub_call() or not self.api_start():
+            return
+        match = re.match(r"/api/galleries/(\d+)/download", self.path)
+        if match:
+            self.send_file(int(match.group(1)))
+            return
+        if self.path.startswith("/api/wiki/page"):
+            size = re.search(r"size(\d+)", self.path)
+            body = PAGE_HEAD + b"x" * max(0, int(size.group(1)) - len(PAGE_HEAD) - len(PAGE_TAIL) if size else 0) + PAGE_TAIL
+            if "chunked" in self.path:
+                self.send_chunked(body)
+            else:
+                self.reply(body)
+            return
+        match = re.match(r"/api/trackers/(\d+)/items/(\d+)", self.path)
+        if match:
+            self.reply(ITEM % (match.group(1).encode(), match.group(2).encode()))
+            return
+        self.reply(b'{"code":404,"message":"not found"}', 404)
+
+    def do_POST(self):
+        global next_itemId
+        if self.stub_call():
+            return
+        body = self.read_body()
+        if not self.api_start():
+            return
+        match = re.match(r"/api/trackers/(\d+)/items(/(\d+))?$", self.path)
+        if match and match.group(3) and len(body) == 0:
+            # tracker_itemget POSTs an empty body to fetch the item
+            self.reply(ITEM % (match.group(1).encode(), match.group(3).encode()))
+            return
+        with lock:
+            if body in seen:
+                counts["duplicates"] += 1
+            else:
+                seen.add(body)
+                counts["posts"] += 1
+        if match and match.group(3):
+            self.reply(b'{"feedback":{"Success":true,"mes":["Item updated"]},"itemId":%s,"fields":{}}' % match.group(3).encode())
+        elif match:
+            with lock:
+                next_itemId += 1
+                itemId = next_itemId
+            self.reply(b'{"trackerId":%s,"itemId":%d,"status":"o","fields":{}}' % (match.group(1).encode(), itemId))
+        elif self.path.startswith("/api/galleries/"):
+            self.reply(b'{"fileId":"77","galleryId":"1","name":"stub"}')
+        else:
+            self.reply(b'{"code":404,"message":"not found"}', 404)
+
+    def send_chunked(self, body):
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        for start in range(0, len(body), 16384):
+            chunk = body[start:start + 16384]
+            self.wfile.write(b"%x\r\n" % len(chunk) + chunk + b"\r\n")
+        self.wfile.write(b"0\r\n\r\n")
+        count("bytes_out", len(body))
+
+    def send_file(self, fileId):
+        content = file_content(fileId)
+        total = len(content)
+        validator = '"%d-1"' % fileId
+        first, last, status = 0, total - 1, 200
+        ranged = self.headers.get("Range")
+        condition = self.headers.get("If-Range")
+        if ranged and (condition is None or condition == validator):
+            match = re.match(r"bytes=(\d+)-(\d*)", ranged)
+            first = int(match.group(1))
+            last = min(int(match.group(2)) if match.group(2) else total - 1, total - 1)
+            status = 206
+        body = content[first:last + 1]
+        self.send_response(status)
+        if etag:
+            self.send_header("ETag", validator)
+        self.send_header("Content-Disposition", 'attachment; filename="stubfile%d.bin"' % fileId)
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (first, last, total))
+        else:
+            self.send_header("Accept-Ranges", "bytes")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        # a dropped download is cut off part way through its body, as a flaky WiFi link would
+        cut = len(body)
+        if len(body) > 1 and (down or random.random() < drop):
+            cut = random.randrange(len(body))
+        step = 65536
+        for start in range(0, cut, step):
+            piece = body[start:min(start + step, cut)]
+            self.wfile.write(piece)
+            count("bytes_out", len(piece))
+            if file_rate > 0:
+                time.sleep(len(piece) / file_rate)
+        if cut < len(body):
+            self.wfile.flush()
+            self.hang_up()
+
+
+########################################################
+####                   main code                    ####
+########################################################
+
+reset()
+http.server.ThreadingHTTPServer.daemon_threads = True
+http.server.ThreadingHTTPServer.request_queue_size = 256
+http.server.ThreadingHTTPServer.allow_reuse_address = True
+server = http.server.ThreadingHTTPServer(("127.0.0.1", port), StubHandler)
+print("Tiki stand-in listening on http://127.0.0.1:%d" % port, flush=True)
+server.serve_forever()